@@ -23,20 +23,34 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-
-#include <samplerate.h>
+#include <time.h>
 
 #include "audiodevice.h"
 #include "glasslimits.h"
 #include "logging.h"
+#include "pcmkernels.h"
 
 AudioDevice::AudioDevice(unsigned pregap,Codec *codec,QObject *parent)
   : QObject(parent)
 {
   audio_pregap=pregap;
+  audio_src_quality=AudioDevice::SrcLinear;
   audio_codec=codec;
+  audio_prebuffer_msecs=0;
+  audio_adaptive_prebuffer=false;
+  audio_prebuffer_frames=0;
+  audio_underruns=0;
+  audio_first_sample_msecs=-1;
+  clock_gettime(CLOCK_MONOTONIC,&audio_start_time);
   audio_play_position_changed=true;
   audio_ring_read_space_prev=0;
+  for(unsigned i=0;i<MAX_AUDIO_CHANNELS;i++) {
+    audio_meter_levels[i]=10000;
+    audio_meter_rms_levels[i]=10000;
+  }
+  memset(&audio_meter_pending,0,sizeof(audio_meter_pending));
+  audio_meter_ring=
+    glass_ringbuffer_create(AUDIO_METER_BLOCKS*sizeof(MeterBlock));
 
   if(codec!=NULL) {
     connect(codec,SIGNAL(audioWritten(unsigned,bool)),
@@ -47,6 +61,7 @@ AudioDevice::AudioDevice(unsigned pregap,Codec *codec,QObject *parent)
 
 AudioDevice::~AudioDevice()
 {
+  glass_ringbuffer_free(audio_meter_ring);
 }
 
 
@@ -71,6 +86,27 @@ void AudioDevice::getStats(QStringList *hdrs,QStringList *values,bool is_first)
 
   loadStats(hdrs,values,is_first);
 
+  if(is_first) {
+    hdrs->push_back("Device|Adaptive Prebuffer");
+    if(audio_adaptive_prebuffer) {
+      values->push_back("Yes");
+    }
+    else {
+      values->push_back("No");
+    }
+  }
+  hdrs->push_back("Device|Prebuffer Frames");
+  values->push_back(QString().sprintf("%u",prebufferFrames()));
+
+  hdrs->push_back("Device|Underruns");
+  values->push_back(QString().sprintf("%u",(unsigned)audio_underruns));
+
+  if(audio_first_sample_msecs>=0) {
+    hdrs->push_back("Device|Time to First Sample");
+    values->push_back(QString().sprintf("%d ms",
+					(int)audio_first_sample_msecs));
+  }
+
   unsigned space=codec()->ring()->readSpace();
   if(space!=audio_ring_read_space_prev) {
     hdrs->push_back("Device|PLL Current Frames");
@@ -80,6 +116,44 @@ void AudioDevice::getStats(QStringList *hdrs,QStringList *values,bool is_first)
 }
 
 
+AudioDevice::SrcQuality AudioDevice::srcQuality() const
+{
+  return audio_src_quality;
+}
+
+
+void AudioDevice::setSrcQuality(AudioDevice::SrcQuality qual)
+{
+  audio_src_quality=qual;
+}
+
+
+unsigned AudioDevice::prebufferMsecs() const
+{
+  return audio_prebuffer_msecs;
+}
+
+
+void AudioDevice::setPrebufferMsecs(unsigned msecs)
+{
+  audio_prebuffer_msecs=msecs;
+  audio_prebuffer_frames=
+    ClampPrebuffer((uint64_t)msecs*(uint64_t)codec()->samplerate()/1000);
+}
+
+
+bool AudioDevice::adaptivePrebuffer() const
+{
+  return audio_adaptive_prebuffer;
+}
+
+
+void AudioDevice::setAdaptivePrebuffer(bool state)
+{
+  audio_adaptive_prebuffer=state;
+}
+
+
 void AudioDevice::meterLevels(int *lvls) const
 {
   for(unsigned i=0;i<MAX_AUDIO_CHANNELS;i++) {
@@ -88,6 +162,14 @@ void AudioDevice::meterLevels(int *lvls) const
 }
 
 
+void AudioDevice::rmsMeterLevels(int *lvls) const
+{
+  for(unsigned i=0;i<MAX_AUDIO_CHANNELS;i++) {
+    lvls[i]=audio_meter_rms_levels[i];
+  }
+}
+
+
 QString AudioDevice::typeText(AudioDevice::Type type)
 {
   QString ret=tr("Unknown Device");
@@ -193,6 +275,55 @@ QString AudioDevice::formatString(AudioDevice::Format fmt)
     ret="S32_LE";
     break;
 
+  case AudioDevice::S24_LE:
+    ret="S24_LE";
+    break;
+
+  case AudioDevice::S24_3LE:
+    ret="S24_3LE";
+    break;
+
+  case AudioDevice::LastFormat:
+    break;
+  }
+
+  return ret;
+}
+
+
+AudioDevice::Format AudioDevice::format(const QString &str)
+{
+  AudioDevice::Format ret=AudioDevice::LastFormat;
+
+  for(int i=0;i<AudioDevice::LastFormat;i++) {
+    if(formatString((AudioDevice::Format)i)==str.toUpper()) {
+      ret=(AudioDevice::Format)i;
+    }
+  }
+
+  return ret;
+}
+
+
+unsigned AudioDevice::formatSize(AudioDevice::Format fmt)
+{
+  unsigned ret=0;
+
+  switch(fmt) {
+  case AudioDevice::S16_LE:
+    ret=2;
+    break;
+
+  case AudioDevice::S24_3LE:
+    ret=3;
+    break;
+
+  case AudioDevice::FLOAT:
+  case AudioDevice::S32_LE:
+  case AudioDevice::S24_LE:
+    ret=4;
+    break;
+
   case AudioDevice::LastFormat:
     break;
   }
@@ -201,6 +332,78 @@ QString AudioDevice::formatString(AudioDevice::Format fmt)
 }
 
 
+QString AudioDevice::srcQualityText(AudioDevice::SrcQuality qual)
+{
+  QString ret=tr("Unknown");
+
+  switch(qual) {
+  case AudioDevice::SrcLinear:
+    ret=tr("Linear");
+    break;
+
+  case AudioDevice::SrcSincFastest:
+    ret=tr("Sinc (fastest)");
+    break;
+
+  case AudioDevice::SrcSincMedium:
+    ret=tr("Sinc (medium quality)");
+    break;
+
+  case AudioDevice::SrcPolyphase:
+    ret=tr("Polyphase");
+    break;
+
+  case AudioDevice::SrcLastQuality:
+    break;
+  }
+
+  return ret;
+}
+
+
+QString AudioDevice::srcQualityKeyword(AudioDevice::SrcQuality qual)
+{
+  QString ret;
+
+  switch(qual) {
+  case AudioDevice::SrcLinear:
+    ret="linear";
+    break;
+
+  case AudioDevice::SrcSincFastest:
+    ret="sinc-fastest";
+    break;
+
+  case AudioDevice::SrcSincMedium:
+    ret="sinc-medium";
+    break;
+
+  case AudioDevice::SrcPolyphase:
+    ret="polyphase";
+    break;
+
+  case AudioDevice::SrcLastQuality:
+    break;
+  }
+
+  return ret;
+}
+
+
+AudioDevice::SrcQuality AudioDevice::srcQuality(const QString &key)
+{
+  AudioDevice::SrcQuality ret=AudioDevice::SrcLastQuality;
+
+  for(int i=0;i<AudioDevice::SrcLastQuality;i++) {
+    if(srcQualityKeyword((AudioDevice::SrcQuality)i)==key.toLower()) {
+      ret=(AudioDevice::SrcQuality)i;
+    }
+  }
+
+  return ret;
+}
+
+
 void AudioDevice::synchronousWrite(unsigned frames,bool is_last)
 {
 }
@@ -232,6 +435,52 @@ unsigned AudioDevice::pregap() const
 }
 
 
+unsigned AudioDevice::prebufferFrames() const
+{
+  //
+  // Frames of decoded audio to queue before starting (or, after an
+  // underrun, restarting) output
+  //
+  if(audio_prebuffer_frames==0) {
+    return ClampPrebuffer((uint64_t)AUDIO_DEFAULT_PREBUFFER_MSECS*
+			  (uint64_t)audio_codec->samplerate()/1000);
+  }
+  return audio_prebuffer_frames;
+}
+
+
+void AudioDevice::prebufferUnderrun()
+{
+  //
+  // Called from the audio thread when the ringbuffer runs dry. In
+  // adaptive mode, each underrun doubles the prebuffer.
+  //
+  audio_underruns++;
+  if(audio_adaptive_prebuffer) {
+    uint64_t frames=2*(uint64_t)prebufferFrames();
+    uint64_t max_frames=(uint64_t)AUDIO_MAX_PREBUFFER_MSECS*
+      (uint64_t)audio_codec->samplerate()/1000;
+    if(frames>max_frames) {
+      frames=max_frames;
+    }
+    audio_prebuffer_frames=ClampPrebuffer(frames);
+  }
+}
+
+
+void AudioDevice::firstSampleOutput()
+{
+  struct timespec now;
+
+  if(audio_first_sample_msecs<0) {
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    audio_first_sample_msecs=
+      1000*(now.tv_sec-audio_start_time.tv_sec)+
+      (now.tv_nsec-audio_start_time.tv_nsec)/1000000;
+  }
+}
+
+
 void AudioDevice::setMeterLevels(int *lvls)
 {
   for(unsigned i=0;i<MAX_AUDIO_CHANNELS;i++) {
@@ -264,6 +513,79 @@ void AudioDevice::updatePlayPosition(long unsigned frames)
 }
 
 
+void AudioDevice::meterPcm(const float *pcm,unsigned nframes,unsigned chans)
+{
+  //
+  // Called from the audio thread. Block statistics are accumulated locally
+  // and passed to the main thread through a lock-free ring; if the main
+  // thread falls behind they are folded into the next block rather than
+  // dropped, so no peak is ever lost.
+  //
+  float peaks[MAX_AUDIO_CHANNELS];
+  float sums[MAX_AUDIO_CHANNELS];
+
+  if(chans>MAX_AUDIO_CHANNELS) {
+    return;
+  }
+  PcmPeaks(peaks,pcm,nframes,chans);
+  PcmSumSquares(sums,pcm,nframes,chans);
+  for(unsigned i=0;i<chans;i++) {
+    if(peaks[i]>audio_meter_pending.peaks[i]) {
+      audio_meter_pending.peaks[i]=peaks[i];
+    }
+    audio_meter_pending.sums[i]+=sums[i];
+  }
+  audio_meter_pending.frames+=nframes;
+  if(glass_ringbuffer_write_space(audio_meter_ring)>=sizeof(MeterBlock)) {
+    glass_ringbuffer_write(audio_meter_ring,
+			   (const char *)&audio_meter_pending,
+			   sizeof(MeterBlock));
+    memset(&audio_meter_pending,0,sizeof(audio_meter_pending));
+  }
+}
+
+
+bool AudioDevice::collectMeterLevels(float *lvls)
+{
+  //
+  // Called from the main thread. Returns the absolute peak of each channel
+  // since the last call in 'lvls' and updates the RMS levels, or returns
+  // false if no audio has been metered since then.
+  //
+  MeterBlock block;
+  double sums[MAX_AUDIO_CHANNELS];
+  unsigned frames=0;
+
+  for(unsigned i=0;i<MAX_AUDIO_CHANNELS;i++) {
+    lvls[i]=0.0;
+    sums[i]=0.0;
+  }
+  while(glass_ringbuffer_read(audio_meter_ring,(char *)&block,
+			      sizeof(block))==sizeof(block)) {
+    for(unsigned i=0;i<MAX_AUDIO_CHANNELS;i++) {
+      if(block.peaks[i]>lvls[i]) {
+	lvls[i]=block.peaks[i];
+      }
+      sums[i]+=block.sums[i];
+    }
+    frames+=block.frames;
+  }
+  if(frames==0) {
+    return false;
+  }
+  for(unsigned i=0;i<MAX_AUDIO_CHANNELS;i++) {
+    if(sums[i]==0.0) {
+      audio_meter_rms_levels[i]=10000;
+    }
+    else {
+      audio_meter_rms_levels[i]=(int)(-1000.0*log10(sums[i]/frames));
+    }
+  }
+
+  return true;
+}
+
+
 Codec *AudioDevice::codec()
 {
   return audio_codec;
@@ -278,16 +600,11 @@ void AudioDevice::remixChannels(float *pcm_out,unsigned chans_out,float *pcm_in,
     return;
   }
   if((chans_in==1)&&(chans_out==2)) {
-    for(unsigned i=0;i<nframes;i++) {
-      pcm_out[2*i]=pcm_in[i];
-      pcm_out[2*i+1]=pcm_in[i];
-    }
+    PcmMonoToStereo(pcm_out,pcm_in,nframes);
     return;
   }
   if((chans_in==2)&&(chans_out==1)) {
-    for(unsigned i=0;i<nframes;i++) {
-      pcm_out[i]=(pcm_in[2*i]+pcm_in[2*i+1])/2.0;
-    }
+    PcmStereoToMono(pcm_out,pcm_in,nframes);
     return;
   }
   Log(LOG_ERR,
@@ -300,34 +617,55 @@ void AudioDevice::remixChannels(float *pcm_out,unsigned chans_out,float *pcm_in,
 void AudioDevice::convertFromFloat(int16_t *pcm_out,const float *pcm_in,
 				   unsigned nframes,unsigned chans)
 {
-  src_float_to_short_array(pcm_in,(short *)pcm_out,nframes*chans);
+  PcmFloatToS16(pcm_out,pcm_in,nframes*chans);
 }
 
 
 void AudioDevice::convertFromFloat(int32_t *pcm_out,const float *pcm_in,
 				   unsigned nframes,unsigned chans)
 {
-  src_float_to_int_array(pcm_in,(int *)pcm_out,nframes*chans);
+  PcmFloatToInt(pcm_out,pcm_in,nframes*chans,32);
 }
 
 
-void AudioDevice::peakLevels(float *lvls,const float *pcm,unsigned nframes,
-			     unsigned chans)
+void AudioDevice::convertFromFloat(void *pcm_out,AudioDevice::Format fmt,
+				   const float *pcm_in,unsigned nframes,
+				   unsigned chans)
 {
-  for(unsigned i=0;i<chans;i++) {
-    lvls[i]=0.0;
-  }
+  switch(fmt) {
+  case AudioDevice::FLOAT:
+    memcpy(pcm_out,pcm_in,nframes*chans*sizeof(float));
+    break;
 
-  for(unsigned i=0;i<nframes;i+=chans) {
-    for(unsigned j=0;j<chans;j++) {
-      if(pcm[i+j]>lvls[j]) {
-	lvls[j]=pcm[i+j];
-      }
-    }
+  case AudioDevice::S16_LE:
+    PcmFloatToS16((int16_t *)pcm_out,pcm_in,nframes*chans);
+    break;
+
+  case AudioDevice::S32_LE:
+    PcmFloatToInt((int32_t *)pcm_out,pcm_in,nframes*chans,32);
+    break;
+
+  case AudioDevice::S24_LE:
+    PcmFloatToInt((int32_t *)pcm_out,pcm_in,nframes*chans,24);
+    break;
+
+  case AudioDevice::S24_3LE:
+    PcmFloatToS24Packed((uint8_t *)pcm_out,pcm_in,nframes*chans);
+    break;
+
+  case AudioDevice::LastFormat:
+    break;
   }
 }
 
 
+void AudioDevice::peakLevels(float *lvls,const float *pcm,unsigned nframes,
+			     unsigned chans)
+{
+  PcmPeaks(lvls,pcm,nframes,chans);
+}
+
+
 void AudioDevice::peakLevels(int *lvls,const float *pcm,unsigned nframes,
 			     unsigned chans)
 {
@@ -344,3 +682,21 @@ void AudioDevice::peakLevels(int *lvls,const float *pcm,unsigned nframes,
     }
   }
 }
+
+
+unsigned AudioDevice::ClampPrebuffer(uint64_t frames) const
+{
+  //
+  // Leave room in the ringbuffer for the decoder to keep writing while
+  // we wait
+  //
+  uint64_t limit=3*(uint64_t)audio_codec->ring()->size()/4;
+
+  if(frames>limit) {
+    frames=limit;
+  }
+  if(frames==0) {
+    frames=1;
+  }
+  return frames;
+}
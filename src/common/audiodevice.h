@@ -22,7 +22,9 @@
 #define AUDIODEVICE_H
 
 #include <stdint.h>
+#include <time.h>
 
+#include <atomic>
 #include <queue>
 #include <vector>
 
@@ -32,18 +34,24 @@
 #include "codec.h"
 #include "glasslimits.h"
 #include "metaevent.h"
+#include "ringbuffer.h"
 
 #define AUDIO_METER_INTERVAL 50
-#define PLL_SETTLE_INTERVAL 100
-#define PLL_CORRECTION 0.00001
+#define AUDIO_METER_BLOCKS 64
 #define PLL_CORRECTION_LIMIT 0.001
+#define AUDIO_DEFAULT_PREBUFFER_MSECS 2000
+#define AUDIO_ADAPTIVE_PREBUFFER_MSECS 250
+#define AUDIO_MAX_PREBUFFER_MSECS 8000
+#define AUDIO_MAX_PERIOD_MSECS 250
 
 class AudioDevice : public QObject
 {
   Q_OBJECT;
  public:
   enum Type {Stdout=0,Alsa=1,AsiHpi=2,File=3,Jack=4,Mme=5,LastType=6};
-  enum Format {FLOAT=0,S16_LE=1,S32_LE=2,LastFormat=3};
+  enum Format {FLOAT=0,S16_LE=1,S32_LE=2,S24_LE=3,S24_3LE=4,LastFormat=5};
+  enum SrcQuality {SrcLinear=0,SrcSincFastest=1,SrcSincMedium=2,
+		   SrcPolyphase=3,SrcLastQuality=4};
   AudioDevice(unsigned pregap,Codec *codec,QObject *parent=0);
   ~AudioDevice();
   virtual bool isAvailable() const;
@@ -52,11 +60,23 @@ class AudioDevice : public QObject
   virtual bool start(QString *err)=0;
   virtual void stop();
   virtual void getStats(QStringList *hdrs,QStringList *values,bool is_first);
+  SrcQuality srcQuality() const;
+  void setSrcQuality(SrcQuality qual);
+  unsigned prebufferMsecs() const;
+  void setPrebufferMsecs(unsigned msecs);
+  bool adaptivePrebuffer() const;
+  void setAdaptivePrebuffer(bool state);
   void meterLevels(int *lvls) const;
+  void rmsMeterLevels(int *lvls) const;
   static QString typeText(AudioDevice::Type type);
   static QString optionKeyword(AudioDevice::Type type);
   static AudioDevice::Type type(const QString &key);
   static QString formatString(AudioDevice::Format fmt);
+  static AudioDevice::Format format(const QString &str);
+  static unsigned formatSize(AudioDevice::Format fmt);
+  static QString srcQualityText(AudioDevice::SrcQuality qual);
+  static QString srcQualityKeyword(AudioDevice::SrcQuality qual);
+  static AudioDevice::SrcQuality srcQuality(const QString &key);
 
  public slots:
   virtual void synchronousWrite(unsigned frames,bool is_last);
@@ -68,10 +88,15 @@ class AudioDevice : public QObject
 
  protected:
   unsigned pregap() const;
+  unsigned prebufferFrames() const;
+  void prebufferUnderrun();
+  void firstSampleOutput();
   void setMeterLevels(float *lvls);
   void setMeterLevels(int *lvls);
   void updateMeterLevels(int *lvls);
   void updatePlayPosition(long unsigned frames);
+  void meterPcm(const float *pcm,unsigned nframes,unsigned chans);
+  bool collectMeterLevels(float *lvls);
   Codec *codec();
   void remixChannels(float *pcm_out,unsigned chans_out,
 		     float *pcm_in,unsigned chans_in,unsigned nframes); 
@@ -79,14 +104,32 @@ class AudioDevice : public QObject
 			unsigned nframes,unsigned chans);
   void convertFromFloat(int32_t *pcm_out,const float *pcm_in,
 			unsigned nframes,unsigned chans);
+  void convertFromFloat(void *pcm_out,AudioDevice::Format fmt,
+			const float *pcm_in,unsigned nframes,unsigned chans);
   void peakLevels(float *lvls,const float *pcm,unsigned nframes,unsigned chans);
   void peakLevels(int *lvls,const float *pcm,unsigned nframes,unsigned chans);
   virtual void loadStats(QStringList *hdrs,QStringList *values,bool is_first)=0;
 
  private:
+  unsigned ClampPrebuffer(uint64_t frames) const;
   unsigned audio_pregap;
+  SrcQuality audio_src_quality;
+  unsigned audio_prebuffer_msecs;
+  bool audio_adaptive_prebuffer;
+  std::atomic<unsigned> audio_prebuffer_frames;
+  std::atomic<unsigned> audio_underruns;
+  std::atomic<int> audio_first_sample_msecs;
+  struct timespec audio_start_time;
   Codec *audio_codec;
   int audio_meter_levels[MAX_AUDIO_CHANNELS];
+  int audio_meter_rms_levels[MAX_AUDIO_CHANNELS];
+  struct MeterBlock {
+    float peaks[MAX_AUDIO_CHANNELS];
+    double sums[MAX_AUDIO_CHANNELS];
+    unsigned frames;
+  };
+  MeterBlock audio_meter_pending;
+  glass_ringbuffer_t *audio_meter_ring;
   long unsigned audio_play_position;
   bool audio_play_position_changed;
   unsigned audio_ring_read_space_prev;
@@ -26,12 +26,22 @@
 
 #include "codec.h"
 #include "logging.h"
+#include "pcmkernels.h"
 
 Codec::Codec(Codec::Type type,unsigned bitrate,QObject *parent)
 {
   codec_type=type;
   codec_bitrate=bitrate;
   codec_ring=NULL;
+  codec_buffer_msecs=0;
+  codec_max_latency_msecs=0;
+  codec_ring_size=0;
+  codec_threaded=false;
+  codec_aborting=false;
+  codec_backlog_offset=0;
+  codec_backlog_is_last=false;
+  codec_space_notifier=NULL;
+  codec_pcm_in_ring=false;
   codec_channels=2;
   codec_quality=0.5;
   codec_samplerate=48000;
@@ -49,6 +59,9 @@ Codec::Codec(Codec::Type type,unsigned bitrate,QObject *parent)
 
 Codec::~Codec()
 {
+  if(codec_space_notifier!=NULL) {
+    delete codec_space_notifier;
+  }
   if(codec_ring!=NULL) {
     delete codec_ring;
   }
@@ -127,6 +140,51 @@ Ringbuffer *Codec::ring()
 }
 
 
+unsigned Codec::bufferMsecs() const
+{
+  return codec_buffer_msecs;
+}
+
+
+void Codec::setBufferMsecs(unsigned msecs)
+{
+  codec_buffer_msecs=msecs;
+}
+
+
+unsigned Codec::maxLatencyMsecs() const
+{
+  return codec_max_latency_msecs;
+}
+
+
+void Codec::setMaxLatencyMsecs(unsigned msecs)
+{
+  codec_max_latency_msecs=msecs;
+}
+
+
+bool Codec::isThreaded() const
+{
+  return codec_threaded;
+}
+
+
+void Codec::setThreaded(bool state)
+{
+  codec_threaded=state;
+}
+
+
+void Codec::abortWrites()
+{
+  codec_aborting=true;
+  if(codec_ring!=NULL) {
+    codec_ring->abortWait();
+  }
+}
+
+
 void Codec::getStats(QStringList *hdrs,QStringList *values,bool is_first)
 {
   if(codec_is_framed_changed) {
@@ -154,6 +212,12 @@ void Codec::getStats(QStringList *hdrs,QStringList *values,bool is_first)
     codec_bytes_processed_changed=false;
   }
 
+  if((codec_ring!=NULL)&&(codec_ring->size()!=codec_ring_size)) {
+    codec_ring_size=codec_ring->size();
+    hdrs->push_back("Codec|Ringbuffer Size");
+    values->push_back(QString().sprintf("%u",codec_ring_size));
+  }
+
   loadStats(hdrs,values,is_first);
 }
 
@@ -161,11 +225,7 @@ void Codec::getStats(QStringList *hdrs,QStringList *values,bool is_first)
 void Codec::interleave(float *pcm_out,float **pcm_in,
 		       unsigned chans,unsigned frames)
 {
-  for(unsigned i=0;i<frames;i++) {
-    for(unsigned j=0;j<chans;j++) {
-      pcm_out[i*chans+j]=pcm_in[j][i];
-    }
-  }
+  PcmInterleave(pcm_out,pcm_in,chans,frames);
 }
 
 
@@ -367,7 +427,38 @@ void Codec::setFramed(unsigned chans,unsigned samprate,unsigned bitrate)
   codec_bytes_processed_changed=true;
   codec_frames_generated=0;
 
-  codec_ring=new Ringbuffer(CODEC_RINGBUFFER_SIZE,chans);
+  //
+  // Size the ringbuffer from the requested latency. If a maximum latency
+  // greater than the buffer size was given, start small and let the ring
+  // grow toward the maximum only when the producer actually needs it.
+  //
+  if((codec_buffer_msecs==0)&&(codec_max_latency_msecs==0)) {
+    codec_ring=new Ringbuffer(CODEC_RINGBUFFER_SIZE,chans,0,true);
+  }
+  else {
+    size_t frame_bytes=sizeof(float)*chans;
+    unsigned msecs=codec_buffer_msecs;
+    size_t max_bytes=0;
+    if(msecs==0) {
+      msecs=codec_max_latency_msecs;
+    }
+    if(codec_max_latency_msecs>msecs) {
+      max_bytes=frame_bytes*((uint64_t)samprate*codec_max_latency_msecs/1000);
+    }
+    codec_ring=new Ringbuffer(frame_bytes*((uint64_t)samprate*msecs/1000),
+			      chans,max_bytes,true);
+  }
+  if(global_log_verbose) {
+    Log(LOG_INFO,QString().sprintf("using a %u frame ringbuffer",
+				   codec_ring->size()));
+  }
+  if((!codec_threaded)&&(codec_ring->spaceNotifyDescriptor()>=0)) {
+    codec_space_notifier=
+      new QSocketNotifier(codec_ring->spaceNotifyDescriptor(),
+			  QSocketNotifier::Read,this);
+    connect(codec_space_notifier,SIGNAL(activated(int)),
+	    this,SLOT(spaceAvailableData(int)));
+  }
 
   emit framed(chans,samprate,bitrate,codec_ring);
 }
@@ -375,10 +466,132 @@ void Codec::setFramed(unsigned chans,unsigned samprate,unsigned bitrate)
 
 void Codec::writePcm(float *pcm,unsigned frames,bool is_last)
 {
+  unsigned n;
+
+  //
+  // Running on a decode thread, or with no way to be told about freed
+  // space: simply sleep until the device has drained enough of the ring.
+  //
+  if(codec_threaded||(codec_space_notifier==NULL)) {
+    while((!codec_ring->growToFit(frames))&&(!codec_aborting)) {
+      codec_ring->waitWriteSpace(frames,CODEC_WRITE_WAIT_INTERVAL);
+    }
+    if(!codec_aborting) {
+      WriteRing(pcm,frames,is_last);
+    }
+    return;
+  }
+
+  //
+  // On the event loop: write what fits now and hold the remainder until
+  // spaceAvailableData() is called, so the connector can keep reading.
+  //
+  if(BacklogFrames()==0) {
+    codec_ring->growToFit(frames);
+    if((n=codec_ring->writeSpace())>frames) {
+      n=frames;
+    }
+    if((n>0)||(frames==0)) {
+      WriteRing(pcm,n,is_last&&(n==frames));
+    }
+    if(n==frames) {
+      return;
+    }
+    pcm+=n*codec_channels;
+    frames-=n;
+  }
+  codec_backlog.insert(codec_backlog.end(),pcm,pcm+frames*codec_channels);
+  codec_backlog_is_last=is_last;
+
+  //
+  // Don't let a persistently stalled device consume unbounded memory
+  //
+  while((BacklogFrames()>CODEC_MAX_BACKLOG_SECONDS*codec_samplerate)&&
+	(!codec_aborting)) {
+    codec_ring->waitWriteSpace(BacklogFrames()-
+			       CODEC_MAX_BACKLOG_SECONDS*codec_samplerate,
+			       CODEC_WRITE_WAIT_INTERVAL);
+    FlushBacklog();
+  }
+  if(BacklogFrames()>0) {
+    codec_ring->requestSpaceNotify(BacklogFrames()<codec_ring->size()/8?
+				   BacklogFrames():codec_ring->size()/8);
+  }
+}
+
+
+float *Codec::acquirePcmSpace(unsigned frames)
+{
+  //
+  // Return a buffer for the decoder to write up to 'frames' of PCM into.
+  // Where the ring can take all of it contiguously right now, this is
+  // the ring memory itself; otherwise it is a scratch buffer that
+  // commitPcm() will hand to writePcm().
+  //
+  float *pcm=NULL;
+  unsigned n=frames;
+
+  codec_pcm_in_ring=false;
+  if(codec_threaded||(codec_space_notifier==NULL)) {
+    while((!codec_ring->growToFit(frames))&&(!codec_aborting)) {
+      codec_ring->waitWriteSpace(frames,CODEC_WRITE_WAIT_INTERVAL);
+    }
+    if(!codec_aborting) {
+      pcm=codec_ring->reserveContiguous(&n);
+    }
+  }
+  else {
+    if((BacklogFrames()==0)&&codec_ring->growToFit(frames)) {
+      pcm=codec_ring->reserveContiguous(&n);
+    }
+  }
+  if((pcm!=NULL)&&(n==frames)) {
+    codec_pcm_in_ring=true;
+    return pcm;
+  }
+  if(codec_pcm_scratch.size()<(frames*codec_channels)) {
+    codec_pcm_scratch.resize(frames*codec_channels);
+  }
+
+  return codec_pcm_scratch.data();
+}
+
+
+void Codec::commitPcm(unsigned frames,bool is_last)
+{
+  //
+  // Publish 'frames' of PCM written into the buffer returned by the last
+  // call to acquirePcmSpace(). May be less than was acquired.
+  //
+  if(codec_pcm_in_ring) {
+    codec_pcm_in_ring=false;
+    codec_ring->commitWrite(frames);
+    codec_frames_generated+=frames;
+    emit audioWritten(frames,is_last);
+    if(is_last) {
+      ring()->setFinished();
+    }
+    return;
+  }
+  if((frames>0)||is_last) {
+    writePcm(codec_pcm_scratch.data(),frames,is_last);
+  }
+}
+
 
-  while(codec_ring->writeSpace()<frames) {
-    usleep(100000);
+void Codec::spaceAvailableData(int fd)
+{
+  codec_ring->clearSpaceNotify();
+  FlushBacklog();
+  if(BacklogFrames()>0) {
+    codec_ring->requestSpaceNotify(BacklogFrames()<codec_ring->size()/8?
+				   BacklogFrames():codec_ring->size()/8);
   }
+}
+
+
+void Codec::WriteRing(float *pcm,unsigned frames,bool is_last)
+{
   codec_ring->write(pcm,frames);
   codec_frames_generated+=frames;
   emit audioWritten(frames,is_last);
@@ -386,3 +599,38 @@ void Codec::writePcm(float *pcm,unsigned frames,bool is_last)
     ring()->setFinished();
   }
 }
+
+
+void Codec::FlushBacklog()
+{
+  unsigned n=BacklogFrames();
+
+  if(n==0) {
+    return;
+  }
+  if(!codec_ring->growToFit(n)) {
+    n=codec_ring->writeSpace();
+  }
+  if(n>0) {
+    codec_backlog_offset+=n*codec_channels;
+    WriteRing(codec_backlog.data()+codec_backlog_offset-n*codec_channels,n,
+	      codec_backlog_is_last&&(BacklogFrames()==0));
+  }
+  if(BacklogFrames()==0) {
+    codec_backlog.clear();
+    codec_backlog_offset=0;
+  }
+  else {
+    if(codec_backlog_offset>(codec_backlog.size()/2)) {
+      codec_backlog.erase(codec_backlog.begin(),
+			  codec_backlog.begin()+codec_backlog_offset);
+      codec_backlog_offset=0;
+    }
+  }
+}
+
+
+unsigned Codec::BacklogFrames() const
+{
+  return (codec_backlog.size()-codec_backlog_offset)/codec_channels;
+}
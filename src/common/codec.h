@@ -21,6 +21,7 @@
 #ifndef CODEC_H
 #define CODEC_H
 
+#include <atomic>
 #include <queue>
 #include <vector>
 
@@ -35,6 +36,7 @@
 #include <samplerate.h>
 
 #include <QObject>
+#include <QSocketNotifier>
 
 #include "glasslimits.h"
 #include "metaevent.h"
@@ -42,6 +44,8 @@
 
 #define MAX_AUDIO_BUFFER 4096
 #define CODEC_RINGBUFFER_SIZE 33554432
+#define CODEC_WRITE_WAIT_INTERVAL 100
+#define CODEC_MAX_BACKLOG_SECONDS 2
 
 class Codec : public QObject
 {
@@ -63,6 +67,13 @@ class Codec : public QObject
   uint64_t bytesProcessed() const;
   uint64_t framesGenerated() const;
   Ringbuffer *ring();
+  unsigned bufferMsecs() const;
+  void setBufferMsecs(unsigned msecs);
+  unsigned maxLatencyMsecs() const;
+  void setMaxLatencyMsecs(unsigned msecs);
+  bool isThreaded() const;
+  void setThreaded(bool state);
+  void abortWrites();
   virtual void getStats(QStringList *hdrs,QStringList *values,bool is_first);
   virtual bool isAvailable() const=0;
   virtual QString defaultExtension() const=0;
@@ -84,19 +95,38 @@ class Codec : public QObject
   void processBitstream(const QByteArray &data,bool is_last);
   void processMetadata(uint64_t bytes,MetaEvent *e);
 
+ private slots:
+  void spaceAvailableData(int fd);
+
  protected:
   virtual void process(const QByteArray &data,bool is_last)=0;
   virtual void setFramed(unsigned chans,unsigned samprate,unsigned bitrate);
   virtual void writePcm(float *pcm,unsigned frames,bool is_last);
+  float *acquirePcmSpace(unsigned frames);
+  void commitPcm(unsigned frames,bool is_last);
   virtual void loadStats(QStringList *hdrs,QStringList *values,bool is_first)=0;
 
  private:
+  void WriteRing(float *pcm,unsigned frames,bool is_last);
+  void FlushBacklog();
+  unsigned BacklogFrames() const;
   long unsigned codec_bytes_processed;
   bool codec_bytes_processed_changed;
   uint64_t codec_frames_generated;
   std::queue<uint64_t> codec_metadata_bytes;
   std::queue<MetaEvent *> codec_metadata_events;
   Ringbuffer *codec_ring;
+  unsigned codec_buffer_msecs;
+  unsigned codec_max_latency_msecs;
+  unsigned codec_ring_size;
+  bool codec_threaded;
+  std::atomic<bool> codec_aborting;
+  std::vector<float> codec_backlog;
+  size_t codec_backlog_offset;
+  bool codec_backlog_is_last;
+  QSocketNotifier *codec_space_notifier;
+  std::vector<float> codec_pcm_scratch;
+  bool codec_pcm_in_ring;
   unsigned codec_bitrate;
   unsigned codec_channels;
   double codec_quality;
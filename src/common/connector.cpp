@@ -54,6 +54,10 @@ Connector::Connector(const QString &mimetype,QObject *parent)
   conn_dropouts_changed=true;
   conn_content_type=mimetype;
   conn_start_metadata=false;
+  conn_prebuffer_msecs=0;
+  conn_receive_buffer_size=0;
+  conn_minimum_chunk_size=0;
+  conn_read_window_size=0;
 
   for(unsigned i=0;i<Codec::TypeLast;i++) {
     if(Codec::acceptsContentType((Codec::Type)i,mimetype)) {
@@ -80,6 +84,54 @@ void Connector::setPostData(const QString &str)
 }
 
 
+unsigned Connector::prebufferMsecs() const
+{
+  return conn_prebuffer_msecs;
+}
+
+
+void Connector::setPrebufferMsecs(unsigned msecs)
+{
+  conn_prebuffer_msecs=msecs;
+}
+
+
+unsigned Connector::receiveBufferSize() const
+{
+  return conn_receive_buffer_size;
+}
+
+
+void Connector::setReceiveBufferSize(unsigned bytes)
+{
+  conn_receive_buffer_size=bytes;
+}
+
+
+unsigned Connector::minimumChunkSize() const
+{
+  return conn_minimum_chunk_size;
+}
+
+
+void Connector::setMinimumChunkSize(unsigned bytes)
+{
+  conn_minimum_chunk_size=bytes;
+}
+
+
+unsigned Connector::readWindowSize() const
+{
+  return conn_read_window_size;
+}
+
+
+void Connector::setReadWindowSize(unsigned bytes)
+{
+  conn_read_window_size=bytes;
+}
+
+
 QString Connector::serverUsername() const
 {
   return conn_server_username;
@@ -250,6 +302,12 @@ void Connector::connectToServer()
 }
 
 
+bool Connector::adoptConnection(QTcpSocket *sock,const QByteArray &data)
+{
+  return false;
+}
+
+
 void Connector::stop()
 {
   disconnectFromHostConnector();
@@ -335,6 +393,10 @@ QString Connector::serverTypeText(Connector::ServerType type)
     ret=tr("Signal Generator");
     break;
 
+  case Connector::HttpFileServer:
+    ret=tr("HTTP File");
+    break;
+
   case Connector::LastServer:
     break;
   }
@@ -364,6 +426,10 @@ QString Connector::optionKeyword(Connector::ServerType type)
     ret="tone";
     break;
 
+  case Connector::HttpFileServer:
+    ret="httpfile";
+    break;
+
   case Connector::LastServer:
     break;
   }
@@ -397,8 +463,9 @@ bool Connector:: acceptsContentType(Connector::ServerType type,
       (mimetype.toLower()=="audio/aacp");
     break;
 
-  case Connector::HlsServer:    // We don't list any mimetypes here because
-  case Connector::FileServer:   // ServerId handles it.
+  case Connector::HlsServer:       // We don't list any mimetypes here
+  case Connector::FileServer:      // because ServerId handles it.
+  case Connector::HttpFileServer:
     break;
 
   case Connector::SignalGenerator:  // Doesn't use the mimetype at all
@@ -1305,6 +1372,14 @@ QString Connector::socketErrorText(QAbstractSocket::SocketError err)
     ret=tr("unsupported socket operation");
     break;
 
+  case QAbstractSocket::SslHandshakeFailedError:
+    ret=tr("TLS handshake failed");
+    break;
+
+  case QAbstractSocket::SslInternalError:
+    ret=tr("TLS internal error");
+    break;
+
   default:
     break;
   }
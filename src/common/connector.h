@@ -41,12 +41,20 @@ class Connector : public QObject
   Q_OBJECT;
  public:
   enum ServerType {XCastServer=1,HlsServer=2,FileServer=3,SignalGenerator=4,
-		   LastServer=5};
+		   HttpFileServer=5,LastServer=6};
   Connector(const QString &mimetype,QObject *parent=0);
   ~Connector();
   virtual Connector::ServerType serverType() const=0;
   QString postData() const;
   void setPostData(const QString &str);
+  unsigned prebufferMsecs() const;
+  void setPrebufferMsecs(unsigned msecs);
+  unsigned receiveBufferSize() const;
+  void setReceiveBufferSize(unsigned bytes);
+  unsigned minimumChunkSize() const;
+  void setMinimumChunkSize(unsigned bytes);
+  unsigned readWindowSize() const;
+  void setReadWindowSize(unsigned bytes);
   QString serverUsername() const;
   void setServerUsername(const QString &str);
   QString serverPassword() const;
@@ -72,6 +80,7 @@ class Connector : public QObject
   QString contentType() const;
   bool isConnected() const;
   virtual void connectToServer();
+  virtual bool adoptConnection(QTcpSocket *sock,const QByteArray &data);
   void stop();
   virtual void reset()=0;
   QString scriptUp() const;
@@ -120,6 +129,10 @@ class Connector : public QObject
   QUrl conn_server_url;
   QUrl conn_public_url;
   QString conn_post_data;
+  unsigned conn_prebuffer_msecs;
+  unsigned conn_receive_buffer_size;
+  unsigned conn_minimum_chunk_size;
+  unsigned conn_read_window_size;
   std::vector<unsigned> conn_audio_bitrates;
   QString conn_stream_name;
   QString conn_stream_description;
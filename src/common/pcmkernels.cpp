@@ -0,0 +1,749 @@
+// pcmkernels.cpp
+//
+// Vectorized inner loops for PCM sample processing.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#include <math.h>
+
+#if defined(__GNUC__)&&(defined(__x86_64__)||defined(__i386__))
+#define PCMKERNELS_X86
+#include <immintrin.h>
+#endif  // __GNUC__
+
+#include "pcmkernels.h"
+
+struct PcmKernelTable
+{
+  const char *name;
+  void (*interleave)(float *,float *const *,unsigned,unsigned);
+  void (*deinterleave)(float *const *,const float *,unsigned,unsigned);
+  void (*interleave_fixed)(float *,const int32_t *const *,unsigned,unsigned,
+			   unsigned);
+  void (*mono_to_stereo)(float *,const float *,unsigned);
+  void (*stereo_to_mono)(float *,const float *,unsigned);
+  void (*peaks)(float *,const float *,unsigned,unsigned);
+  void (*sum_squares)(float *,const float *,unsigned,unsigned);
+  void (*float_to_s16)(int16_t *,const float *,unsigned);
+  void (*float_to_int)(int32_t *,const float *,unsigned,unsigned);
+};
+
+
+//
+// Float to integer conversions scale by 2^(bits-1), clip and round to
+// nearest (even), matching libsamplerate's src_float_to_*_array(). The
+// upper clip is the largest float that still fits, which for 32 bits is
+// 0x7FFFFF80 rather than 0x7FFFFFFF.
+//
+static float IntScale(unsigned bits)
+{
+  return (float)(1u<<(bits-1));
+}
+
+
+static float IntLimit(unsigned bits)
+{
+  float scale=IntScale(bits);
+  float lim=scale-1.0f;
+
+  if(lim>=scale) {
+    lim=nextafterf(scale,0.0f);
+  }
+  return lim;
+}
+
+
+//
+// Plain C
+//
+static void InterleaveC(float *pcm_out,float *const *pcm_in,
+			unsigned chans,unsigned frames)
+{
+  for(unsigned i=0;i<frames;i++) {
+    for(unsigned j=0;j<chans;j++) {
+      pcm_out[i*chans+j]=pcm_in[j][i];
+    }
+  }
+}
+
+
+static void DeinterleaveC(float *const *pcm_out,const float *pcm_in,
+			  unsigned chans,unsigned frames)
+{
+  for(unsigned i=0;i<frames;i++) {
+    for(unsigned j=0;j<chans;j++) {
+      pcm_out[j][i]=pcm_in[i*chans+j];
+    }
+  }
+}
+
+
+static void InterleaveFixedC(float *pcm_out,const int32_t *const *pcm_in,
+			     unsigned chans,unsigned frames,unsigned fracbits)
+{
+  float scale=1.0f/(float)(1u<<fracbits);
+
+  for(unsigned i=0;i<frames;i++) {
+    for(unsigned j=0;j<chans;j++) {
+      pcm_out[i*chans+j]=(float)pcm_in[j][i]*scale;
+    }
+  }
+}
+
+
+static void MonoToStereoC(float *pcm_out,const float *pcm_in,unsigned frames)
+{
+  for(unsigned i=0;i<frames;i++) {
+    pcm_out[2*i]=pcm_in[i];
+    pcm_out[2*i+1]=pcm_in[i];
+  }
+}
+
+
+static void StereoToMonoC(float *pcm_out,const float *pcm_in,unsigned frames)
+{
+  for(unsigned i=0;i<frames;i++) {
+    pcm_out[i]=(pcm_in[2*i]+pcm_in[2*i+1])*0.5f;
+  }
+}
+
+
+static void PeaksC(float *lvls,const float *pcm,unsigned frames,
+		   unsigned chans)
+{
+  for(unsigned i=0;i<chans;i++) {
+    lvls[i]=0.0;
+  }
+  for(unsigned i=0;i<frames;i++) {
+    for(unsigned j=0;j<chans;j++) {
+      if(fabsf(pcm[i*chans+j])>lvls[j]) {
+	lvls[j]=fabsf(pcm[i*chans+j]);
+      }
+    }
+  }
+}
+
+
+static void SumSquaresC(float *sums,const float *pcm,unsigned frames,
+			unsigned chans)
+{
+  for(unsigned i=0;i<chans;i++) {
+    sums[i]=0.0;
+  }
+  for(unsigned i=0;i<frames;i++) {
+    for(unsigned j=0;j<chans;j++) {
+      sums[j]+=pcm[i*chans+j]*pcm[i*chans+j];
+    }
+  }
+}
+
+
+static void FloatToS16C(int16_t *pcm_out,const float *pcm_in,
+			unsigned samples)
+{
+  for(unsigned i=0;i<samples;i++) {
+    float v=pcm_in[i]*32768.0f;
+    if(v>32767.0f) {
+      v=32767.0f;
+    }
+    if(!(v>=-32768.0f)) {
+      v=-32768.0f;
+    }
+    pcm_out[i]=(int16_t)lrintf(v);
+  }
+}
+
+
+static void FloatToIntC(int32_t *pcm_out,const float *pcm_in,
+			unsigned samples,unsigned bits)
+{
+  float scale=IntScale(bits);
+  float lim=IntLimit(bits);
+
+  for(unsigned i=0;i<samples;i++) {
+    float v=pcm_in[i]*scale;
+    if(v>lim) {
+      v=lim;
+    }
+    if(!(v>=-scale)) {
+      v=-scale;
+    }
+    pcm_out[i]=(int32_t)lrintf(v);
+  }
+}
+
+
+static const PcmKernelTable pcm_kernels_c=
+  {"C",InterleaveC,DeinterleaveC,InterleaveFixedC,
+   MonoToStereoC,StereoToMonoC,PeaksC,SumSquaresC,
+   FloatToS16C,FloatToIntC};
+
+
+#ifdef PCMKERNELS_X86
+//
+// SSE2
+//
+__attribute__((target("sse2")))
+static void InterleaveSse2(float *pcm_out,float *const *pcm_in,
+			   unsigned chans,unsigned frames)
+{
+  unsigned i=0;
+
+  if(chans!=2) {
+    InterleaveC(pcm_out,pcm_in,chans,frames);
+    return;
+  }
+  for(;(i+4)<=frames;i+=4) {
+    __m128 l=_mm_loadu_ps(pcm_in[0]+i);
+    __m128 r=_mm_loadu_ps(pcm_in[1]+i);
+    _mm_storeu_ps(pcm_out+2*i,_mm_unpacklo_ps(l,r));
+    _mm_storeu_ps(pcm_out+2*i+4,_mm_unpackhi_ps(l,r));
+  }
+  for(;i<frames;i++) {
+    pcm_out[2*i]=pcm_in[0][i];
+    pcm_out[2*i+1]=pcm_in[1][i];
+  }
+}
+
+
+__attribute__((target("sse2")))
+static void DeinterleaveSse2(float *const *pcm_out,const float *pcm_in,
+			     unsigned chans,unsigned frames)
+{
+  unsigned i=0;
+
+  if(chans!=2) {
+    DeinterleaveC(pcm_out,pcm_in,chans,frames);
+    return;
+  }
+  for(;(i+4)<=frames;i+=4) {
+    __m128 a=_mm_loadu_ps(pcm_in+2*i);
+    __m128 b=_mm_loadu_ps(pcm_in+2*i+4);
+    _mm_storeu_ps(pcm_out[0]+i,_mm_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0)));
+    _mm_storeu_ps(pcm_out[1]+i,_mm_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1)));
+  }
+  for(;i<frames;i++) {
+    pcm_out[0][i]=pcm_in[2*i];
+    pcm_out[1][i]=pcm_in[2*i+1];
+  }
+}
+
+
+__attribute__((target("sse2")))
+static void InterleaveFixedSse2(float *pcm_out,const int32_t *const *pcm_in,
+				unsigned chans,unsigned frames,
+				unsigned fracbits)
+{
+  float scale=1.0f/(float)(1u<<fracbits);
+  __m128 s=_mm_set1_ps(scale);
+  unsigned i=0;
+
+  if(chans==1) {
+    for(;(i+4)<=frames;i+=4) {
+      __m128i m=_mm_loadu_si128((const __m128i *)(pcm_in[0]+i));
+      _mm_storeu_ps(pcm_out+i,_mm_mul_ps(_mm_cvtepi32_ps(m),s));
+    }
+  }
+  if(chans==2) {
+    for(;(i+4)<=frames;i+=4) {
+      __m128 l=_mm_mul_ps(_mm_cvtepi32_ps(
+	_mm_loadu_si128((const __m128i *)(pcm_in[0]+i))),s);
+      __m128 r=_mm_mul_ps(_mm_cvtepi32_ps(
+	_mm_loadu_si128((const __m128i *)(pcm_in[1]+i))),s);
+      _mm_storeu_ps(pcm_out+2*i,_mm_unpacklo_ps(l,r));
+      _mm_storeu_ps(pcm_out+2*i+4,_mm_unpackhi_ps(l,r));
+    }
+  }
+  for(;i<frames;i++) {
+    for(unsigned j=0;j<chans;j++) {
+      pcm_out[i*chans+j]=(float)pcm_in[j][i]*scale;
+    }
+  }
+}
+
+
+__attribute__((target("sse2")))
+static void MonoToStereoSse2(float *pcm_out,const float *pcm_in,
+			     unsigned frames)
+{
+  unsigned i=0;
+
+  for(;(i+4)<=frames;i+=4) {
+    __m128 m=_mm_loadu_ps(pcm_in+i);
+    _mm_storeu_ps(pcm_out+2*i,_mm_unpacklo_ps(m,m));
+    _mm_storeu_ps(pcm_out+2*i+4,_mm_unpackhi_ps(m,m));
+  }
+  MonoToStereoC(pcm_out+2*i,pcm_in+i,frames-i);
+}
+
+
+__attribute__((target("sse2")))
+static void StereoToMonoSse2(float *pcm_out,const float *pcm_in,
+			     unsigned frames)
+{
+  __m128 half=_mm_set1_ps(0.5f);
+  unsigned i=0;
+
+  for(;(i+4)<=frames;i+=4) {
+    __m128 a=_mm_loadu_ps(pcm_in+2*i);
+    __m128 b=_mm_loadu_ps(pcm_in+2*i+4);
+    __m128 l=_mm_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0));
+    __m128 r=_mm_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1));
+    _mm_storeu_ps(pcm_out+i,_mm_mul_ps(_mm_add_ps(l,r),half));
+  }
+  StereoToMonoC(pcm_out+i,pcm_in+2*i,frames-i);
+}
+
+
+__attribute__((target("sse2")))
+static void PeaksSse2(float *lvls,const float *pcm,unsigned frames,
+		      unsigned chans)
+{
+  //
+  // Lane N of the accumulator always holds channel N%chans, so this only
+  // works where the channel count divides the vector width.
+  //
+  __m128 mask=_mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 acc=_mm_setzero_ps();
+  float lanes[4];
+  unsigned samples=frames*chans;
+  unsigned i=0;
+
+  if((chans==0)||((4%chans)!=0)) {
+    PeaksC(lvls,pcm,frames,chans);
+    return;
+  }
+  for(;(i+4)<=samples;i+=4) {
+    acc=_mm_max_ps(acc,_mm_and_ps(_mm_loadu_ps(pcm+i),mask));
+  }
+  _mm_storeu_ps(lanes,acc);
+  PeaksC(lvls,pcm+i,(samples-i)/chans,chans);
+  for(unsigned j=0;j<4;j++) {
+    if(lanes[j]>lvls[j%chans]) {
+      lvls[j%chans]=lanes[j];
+    }
+  }
+}
+
+
+__attribute__((target("sse2")))
+static void SumSquaresSse2(float *sums,const float *pcm,unsigned frames,
+			   unsigned chans)
+{
+  __m128 acc=_mm_setzero_ps();
+  float lanes[4];
+  unsigned samples=frames*chans;
+  unsigned i=0;
+
+  if((chans==0)||((4%chans)!=0)) {
+    SumSquaresC(sums,pcm,frames,chans);
+    return;
+  }
+  for(;(i+4)<=samples;i+=4) {
+    __m128 v=_mm_loadu_ps(pcm+i);
+    acc=_mm_add_ps(acc,_mm_mul_ps(v,v));
+  }
+  _mm_storeu_ps(lanes,acc);
+  SumSquaresC(sums,pcm+i,(samples-i)/chans,chans);
+  for(unsigned j=0;j<4;j++) {
+    sums[j%chans]+=lanes[j];
+  }
+}
+
+
+__attribute__((target("sse2")))
+static void FloatToS16Sse2(int16_t *pcm_out,const float *pcm_in,
+			   unsigned samples)
+{
+  __m128 s=_mm_set1_ps(32768.0f);
+  __m128 hi=_mm_set1_ps(32767.0f);
+  __m128 lo=_mm_set1_ps(-32768.0f);
+  unsigned i=0;
+
+  for(;(i+8)<=samples;i+=8) {
+    __m128 a=_mm_mul_ps(_mm_loadu_ps(pcm_in+i),s);
+    __m128 b=_mm_mul_ps(_mm_loadu_ps(pcm_in+i+4),s);
+    a=_mm_min_ps(_mm_max_ps(a,lo),hi);
+    b=_mm_min_ps(_mm_max_ps(b,lo),hi);
+    _mm_storeu_si128((__m128i *)(pcm_out+i),
+		     _mm_packs_epi32(_mm_cvtps_epi32(a),_mm_cvtps_epi32(b)));
+  }
+  FloatToS16C(pcm_out+i,pcm_in+i,samples-i);
+}
+
+
+__attribute__((target("sse2")))
+static void FloatToIntSse2(int32_t *pcm_out,const float *pcm_in,
+			   unsigned samples,unsigned bits)
+{
+  __m128 s=_mm_set1_ps(IntScale(bits));
+  __m128 hi=_mm_set1_ps(IntLimit(bits));
+  __m128 lo=_mm_set1_ps(-IntScale(bits));
+  unsigned i=0;
+
+  for(;(i+4)<=samples;i+=4) {
+    __m128 v=_mm_mul_ps(_mm_loadu_ps(pcm_in+i),s);
+    v=_mm_min_ps(_mm_max_ps(v,lo),hi);
+    _mm_storeu_si128((__m128i *)(pcm_out+i),_mm_cvtps_epi32(v));
+  }
+  FloatToIntC(pcm_out+i,pcm_in+i,samples-i,bits);
+}
+
+
+static const PcmKernelTable pcm_kernels_sse2=
+  {"SSE2",InterleaveSse2,DeinterleaveSse2,InterleaveFixedSse2,
+   MonoToStereoSse2,StereoToMonoSse2,PeaksSse2,SumSquaresSse2,
+   FloatToS16Sse2,FloatToIntSse2};
+
+
+//
+// AVX2
+//
+__attribute__((target("avx2")))
+static void InterleaveAvx2(float *pcm_out,float *const *pcm_in,
+			   unsigned chans,unsigned frames)
+{
+  unsigned i=0;
+
+  if(chans!=2) {
+    InterleaveC(pcm_out,pcm_in,chans,frames);
+    return;
+  }
+  for(;(i+8)<=frames;i+=8) {
+    __m256 l=_mm256_loadu_ps(pcm_in[0]+i);
+    __m256 r=_mm256_loadu_ps(pcm_in[1]+i);
+    __m256 lo=_mm256_unpacklo_ps(l,r);
+    __m256 hi=_mm256_unpackhi_ps(l,r);
+    _mm256_storeu_ps(pcm_out+2*i,_mm256_permute2f128_ps(lo,hi,0x20));
+    _mm256_storeu_ps(pcm_out+2*i+8,_mm256_permute2f128_ps(lo,hi,0x31));
+  }
+  for(;i<frames;i++) {
+    pcm_out[2*i]=pcm_in[0][i];
+    pcm_out[2*i+1]=pcm_in[1][i];
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void DeinterleaveAvx2(float *const *pcm_out,const float *pcm_in,
+			     unsigned chans,unsigned frames)
+{
+  unsigned i=0;
+
+  if(chans!=2) {
+    DeinterleaveC(pcm_out,pcm_in,chans,frames);
+    return;
+  }
+  for(;(i+8)<=frames;i+=8) {
+    __m256 a=_mm256_loadu_ps(pcm_in+2*i);
+    __m256 b=_mm256_loadu_ps(pcm_in+2*i+8);
+    __m256d l=_mm256_castps_pd(_mm256_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0)));
+    __m256d r=_mm256_castps_pd(_mm256_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1)));
+    _mm256_storeu_ps(pcm_out[0]+i,_mm256_castpd_ps(
+      _mm256_permute4x64_pd(l,_MM_SHUFFLE(3,1,2,0))));
+    _mm256_storeu_ps(pcm_out[1]+i,_mm256_castpd_ps(
+      _mm256_permute4x64_pd(r,_MM_SHUFFLE(3,1,2,0))));
+  }
+  for(;i<frames;i++) {
+    pcm_out[0][i]=pcm_in[2*i];
+    pcm_out[1][i]=pcm_in[2*i+1];
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void InterleaveFixedAvx2(float *pcm_out,const int32_t *const *pcm_in,
+				unsigned chans,unsigned frames,
+				unsigned fracbits)
+{
+  float scale=1.0f/(float)(1u<<fracbits);
+  __m256 s=_mm256_set1_ps(scale);
+  unsigned i=0;
+
+  if(chans==1) {
+    for(;(i+8)<=frames;i+=8) {
+      __m256i m=_mm256_loadu_si256((const __m256i *)(pcm_in[0]+i));
+      _mm256_storeu_ps(pcm_out+i,_mm256_mul_ps(_mm256_cvtepi32_ps(m),s));
+    }
+  }
+  if(chans==2) {
+    for(;(i+8)<=frames;i+=8) {
+      __m256 l=_mm256_mul_ps(_mm256_cvtepi32_ps(
+	_mm256_loadu_si256((const __m256i *)(pcm_in[0]+i))),s);
+      __m256 r=_mm256_mul_ps(_mm256_cvtepi32_ps(
+	_mm256_loadu_si256((const __m256i *)(pcm_in[1]+i))),s);
+      __m256 lo=_mm256_unpacklo_ps(l,r);
+      __m256 hi=_mm256_unpackhi_ps(l,r);
+      _mm256_storeu_ps(pcm_out+2*i,_mm256_permute2f128_ps(lo,hi,0x20));
+      _mm256_storeu_ps(pcm_out+2*i+8,_mm256_permute2f128_ps(lo,hi,0x31));
+    }
+  }
+  for(;i<frames;i++) {
+    for(unsigned j=0;j<chans;j++) {
+      pcm_out[i*chans+j]=(float)pcm_in[j][i]*scale;
+    }
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void MonoToStereoAvx2(float *pcm_out,const float *pcm_in,
+			     unsigned frames)
+{
+  unsigned i=0;
+
+  for(;(i+8)<=frames;i+=8) {
+    __m256 m=_mm256_loadu_ps(pcm_in+i);
+    __m256 lo=_mm256_unpacklo_ps(m,m);
+    __m256 hi=_mm256_unpackhi_ps(m,m);
+    _mm256_storeu_ps(pcm_out+2*i,_mm256_permute2f128_ps(lo,hi,0x20));
+    _mm256_storeu_ps(pcm_out+2*i+8,_mm256_permute2f128_ps(lo,hi,0x31));
+  }
+  MonoToStereoC(pcm_out+2*i,pcm_in+i,frames-i);
+}
+
+
+__attribute__((target("avx2")))
+static void StereoToMonoAvx2(float *pcm_out,const float *pcm_in,
+			     unsigned frames)
+{
+  __m256 half=_mm256_set1_ps(0.5f);
+  unsigned i=0;
+
+  for(;(i+8)<=frames;i+=8) {
+    __m256 a=_mm256_loadu_ps(pcm_in+2*i);
+    __m256 b=_mm256_loadu_ps(pcm_in+2*i+8);
+    __m256 l=_mm256_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0));
+    __m256 r=_mm256_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1));
+    __m256d m=_mm256_castps_pd(_mm256_mul_ps(_mm256_add_ps(l,r),half));
+    _mm256_storeu_ps(pcm_out+i,_mm256_castpd_ps(
+      _mm256_permute4x64_pd(m,_MM_SHUFFLE(3,1,2,0))));
+  }
+  StereoToMonoC(pcm_out+i,pcm_in+2*i,frames-i);
+}
+
+
+__attribute__((target("avx2")))
+static void PeaksAvx2(float *lvls,const float *pcm,unsigned frames,
+		      unsigned chans)
+{
+  __m256 mask=_mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 acc=_mm256_setzero_ps();
+  float lanes[8];
+  unsigned samples=frames*chans;
+  unsigned i=0;
+
+  if((chans==0)||((8%chans)!=0)) {
+    PeaksC(lvls,pcm,frames,chans);
+    return;
+  }
+  for(;(i+8)<=samples;i+=8) {
+    acc=_mm256_max_ps(acc,_mm256_and_ps(_mm256_loadu_ps(pcm+i),mask));
+  }
+  _mm256_storeu_ps(lanes,acc);
+  PeaksC(lvls,pcm+i,(samples-i)/chans,chans);
+  for(unsigned j=0;j<8;j++) {
+    if(lanes[j]>lvls[j%chans]) {
+      lvls[j%chans]=lanes[j];
+    }
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void SumSquaresAvx2(float *sums,const float *pcm,unsigned frames,
+			   unsigned chans)
+{
+  __m256 acc=_mm256_setzero_ps();
+  float lanes[8];
+  unsigned samples=frames*chans;
+  unsigned i=0;
+
+  if((chans==0)||((8%chans)!=0)) {
+    SumSquaresC(sums,pcm,frames,chans);
+    return;
+  }
+  for(;(i+8)<=samples;i+=8) {
+    __m256 v=_mm256_loadu_ps(pcm+i);
+    acc=_mm256_add_ps(acc,_mm256_mul_ps(v,v));
+  }
+  _mm256_storeu_ps(lanes,acc);
+  SumSquaresC(sums,pcm+i,(samples-i)/chans,chans);
+  for(unsigned j=0;j<8;j++) {
+    sums[j%chans]+=lanes[j];
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void FloatToS16Avx2(int16_t *pcm_out,const float *pcm_in,
+			   unsigned samples)
+{
+  __m256 s=_mm256_set1_ps(32768.0f);
+  __m256 hi=_mm256_set1_ps(32767.0f);
+  __m256 lo=_mm256_set1_ps(-32768.0f);
+  unsigned i=0;
+
+  for(;(i+16)<=samples;i+=16) {
+    __m256 a=_mm256_mul_ps(_mm256_loadu_ps(pcm_in+i),s);
+    __m256 b=_mm256_mul_ps(_mm256_loadu_ps(pcm_in+i+8),s);
+    a=_mm256_min_ps(_mm256_max_ps(a,lo),hi);
+    b=_mm256_min_ps(_mm256_max_ps(b,lo),hi);
+
+    //
+    // The pack works within 128 bit lanes, so put the quadwords back
+    // in order afterwards
+    //
+    __m256i p=_mm256_packs_epi32(_mm256_cvtps_epi32(a),_mm256_cvtps_epi32(b));
+    _mm256_storeu_si256((__m256i *)(pcm_out+i),
+			_mm256_permute4x64_epi64(p,_MM_SHUFFLE(3,1,2,0)));
+  }
+  FloatToS16Sse2(pcm_out+i,pcm_in+i,samples-i);
+}
+
+
+__attribute__((target("avx2")))
+static void FloatToIntAvx2(int32_t *pcm_out,const float *pcm_in,
+			   unsigned samples,unsigned bits)
+{
+  __m256 s=_mm256_set1_ps(IntScale(bits));
+  __m256 hi=_mm256_set1_ps(IntLimit(bits));
+  __m256 lo=_mm256_set1_ps(-IntScale(bits));
+  unsigned i=0;
+
+  for(;(i+8)<=samples;i+=8) {
+    __m256 v=_mm256_mul_ps(_mm256_loadu_ps(pcm_in+i),s);
+    v=_mm256_min_ps(_mm256_max_ps(v,lo),hi);
+    _mm256_storeu_si256((__m256i *)(pcm_out+i),_mm256_cvtps_epi32(v));
+  }
+  FloatToIntC(pcm_out+i,pcm_in+i,samples-i,bits);
+}
+
+
+static const PcmKernelTable pcm_kernels_avx2=
+  {"AVX2",InterleaveAvx2,DeinterleaveAvx2,InterleaveFixedAvx2,
+   MonoToStereoAvx2,StereoToMonoAvx2,PeaksAvx2,SumSquaresAvx2,
+   FloatToS16Avx2,FloatToIntAvx2};
+#endif  // PCMKERNELS_X86
+
+
+static const PcmKernelTable *SelectKernels()
+{
+#ifdef PCMKERNELS_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) {
+    return &pcm_kernels_avx2;
+  }
+  if(__builtin_cpu_supports("sse2")) {
+    return &pcm_kernels_sse2;
+  }
+#endif  // PCMKERNELS_X86
+  return &pcm_kernels_c;
+}
+
+
+static const PcmKernelTable *Kernels()
+{
+  static const PcmKernelTable *table=SelectKernels();
+
+  return table;
+}
+
+
+void PcmInterleave(float *pcm_out,float *const *pcm_in,
+		   unsigned chans,unsigned frames)
+{
+  Kernels()->interleave(pcm_out,pcm_in,chans,frames);
+}
+
+
+void PcmDeinterleave(float *const *pcm_out,const float *pcm_in,
+		     unsigned chans,unsigned frames)
+{
+  Kernels()->deinterleave(pcm_out,pcm_in,chans,frames);
+}
+
+
+void PcmInterleaveFixed(float *pcm_out,const int32_t *const *pcm_in,
+			unsigned chans,unsigned frames,unsigned fracbits)
+{
+  Kernels()->interleave_fixed(pcm_out,pcm_in,chans,frames,fracbits);
+}
+
+
+void PcmMonoToStereo(float *pcm_out,const float *pcm_in,unsigned frames)
+{
+  Kernels()->mono_to_stereo(pcm_out,pcm_in,frames);
+}
+
+
+void PcmStereoToMono(float *pcm_out,const float *pcm_in,unsigned frames)
+{
+  Kernels()->stereo_to_mono(pcm_out,pcm_in,frames);
+}
+
+
+void PcmPeaks(float *lvls,const float *pcm,unsigned frames,unsigned chans)
+{
+  Kernels()->peaks(lvls,pcm,frames,chans);
+}
+
+
+void PcmSumSquares(float *sums,const float *pcm,unsigned frames,
+		   unsigned chans)
+{
+  Kernels()->sum_squares(sums,pcm,frames,chans);
+}
+
+
+void PcmFloatToS16(int16_t *pcm_out,const float *pcm_in,unsigned samples)
+{
+  Kernels()->float_to_s16(pcm_out,pcm_in,samples);
+}
+
+
+void PcmFloatToInt(int32_t *pcm_out,const float *pcm_in,unsigned samples,
+		   unsigned bits)
+{
+  Kernels()->float_to_int(pcm_out,pcm_in,samples,bits);
+}
+
+
+void PcmFloatToS24Packed(uint8_t *pcm_out,const float *pcm_in,
+			 unsigned samples)
+{
+  int32_t block[256];
+
+  while(samples>0) {
+    unsigned n=samples<256?samples:256;
+    Kernels()->float_to_int(block,pcm_in,n,24);
+    for(unsigned i=0;i<n;i++) {
+      pcm_out[3*i]=block[i]&0xFF;
+      pcm_out[3*i+1]=(block[i]>>8)&0xFF;
+      pcm_out[3*i+2]=(block[i]>>16)&0xFF;
+    }
+    pcm_out+=3*n;
+    pcm_in+=n;
+    samples-=n;
+  }
+}
+
+
+const char *PcmKernelName()
+{
+  return Kernels()->name;
+}
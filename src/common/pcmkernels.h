@@ -0,0 +1,90 @@
+// pcmkernels.h
+//
+// Vectorized inner loops for PCM sample processing.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#ifndef PCMKERNELS_H
+#define PCMKERNELS_H
+
+#include <stdint.h>
+
+//
+// Each of these picks the widest implementation the running CPU supports
+// (AVX2, SSE2 or plain C) the first time it is called.
+//
+
+//
+// Interleave 'chans' planar float channels
+//
+void PcmInterleave(float *pcm_out,float *const *pcm_in,
+		   unsigned chans,unsigned frames);
+
+//
+// De-interleave into 'chans' planar float channels
+//
+void PcmDeinterleave(float *const *pcm_out,const float *pcm_in,
+		     unsigned chans,unsigned frames);
+
+//
+// Interleave 'chans' planar fixed-point channels with 'fracbits'
+// fractional bits (e.g. libmad's mad_fixed_t) into float
+//
+void PcmInterleaveFixed(float *pcm_out,const int32_t *const *pcm_in,
+			unsigned chans,unsigned frames,unsigned fracbits);
+
+//
+// Channel remixing
+//
+void PcmMonoToStereo(float *pcm_out,const float *pcm_in,unsigned frames);
+void PcmStereoToMono(float *pcm_out,const float *pcm_in,unsigned frames);
+
+//
+// Absolute peak of each channel of interleaved PCM
+//
+void PcmPeaks(float *lvls,const float *pcm,unsigned frames,unsigned chans);
+
+//
+// Sum of the squared samples of each channel of interleaved PCM
+//
+void PcmSumSquares(float *sums,const float *pcm,unsigned frames,
+		   unsigned chans);
+
+//
+// Float to signed 16 bit
+//
+void PcmFloatToS16(int16_t *pcm_out,const float *pcm_in,unsigned samples);
+
+//
+// Float to signed 'bits' wide integer (24 or 32), right justified
+//
+void PcmFloatToInt(int32_t *pcm_out,const float *pcm_in,unsigned samples,
+		   unsigned bits);
+
+//
+// Float to signed 24 bit packed in three little-endian bytes (S24_3LE)
+//
+void PcmFloatToS24Packed(uint8_t *pcm_out,const float *pcm_in,
+			 unsigned samples);
+
+//
+// Name of the implementation in use ("AVX2", "SSE2" or "C")
+//
+const char *PcmKernelName();
+
+
+#endif  // PCMKERNELS_H
@@ -26,13 +26,24 @@
 
 #include <ringbuffer.h>
 
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#ifdef USE_MLOCK
+#include <time.h>
+#include <unistd.h>
+#ifndef WIN32
+#include <sys/eventfd.h>
 #include <sys/mman.h>
-#endif /* USE_MLOCK */
+#define USE_MLOCK
+#endif  // WIN32
+
+#include <new>
 
 glass_ringbuffer_t *glass_ringbuffer_create(int sz);
+glass_ringbuffer_t *glass_ringbuffer_create_growable(int sz,int max_sz);
+glass_ringbuffer_t *glass_ringbuffer_create_mirrored(int sz);
+int glass_ringbuffer_grow(glass_ringbuffer_t *rb,size_t cnt);
 void glass_ringbuffer_free(glass_ringbuffer_t *rb);
 void glass_ringbuffer_get_read_vector(const glass_ringbuffer_t *rb,
                                          glass_ringbuffer_data_t *vec);
@@ -59,24 +70,166 @@ glass_ringbuffer_create (int sz)
   	int power_of_two;
 	glass_ringbuffer_t *rb;
 
-	if ((rb = (glass_ringbuffer_t *) malloc (sizeof (glass_ringbuffer_t))) == NULL) {
+	if ((rb = new (std::nothrow) glass_ringbuffer_t ()) == NULL) {
 		return NULL;
 	}
 
 	for (power_of_two = 1; 1 << power_of_two < sz; power_of_two++);
 
 	rb->size = 1 << power_of_two;
-	rb->size_mask = rb->size;
-	rb->size_mask -= 1;
-	rb->write_ptr = 0;
-	rb->read_ptr = 0;
+	rb->size_mask = (1 << power_of_two) - 1;
+	rb->reserved = rb->size;
+	rb->write_ptr.store (0, std::memory_order_relaxed);
+	rb->read_ptr.store (0, std::memory_order_relaxed);
+	rb->cached_read_ptr = 0;
+	rb->cached_write_ptr = 0;
 	if ((rb->buf = (char *) malloc (rb->size)) == NULL) {
-		free (rb);
+		delete rb;
+		return NULL;
+	}
+	rb->mlocked = 0;
+	rb->mirrored = 0;
+
+	return rb;
+}
+
+/* Create a new ringbuffer to hold at least `sz' bytes of data, with
+   the same pages mapped twice back to back so that any span of up to
+   `size' bytes starting inside the buffer is contiguous in memory.  The
+   actual size is rounded up to the next power of two that is also a
+   multiple of the page size.  Falls back to glass_ringbuffer_create()
+   where memfd_create() is unavailable.  */
+
+glass_ringbuffer_t *
+glass_ringbuffer_create_mirrored (int sz)
+{
+#ifdef MFD_CLOEXEC
+	int power_of_two;
+	size_t size;
+	int fd;
+	char *base;
+	glass_ringbuffer_t *rb;
+
+	for (power_of_two = 1; 1 << power_of_two < sz; power_of_two++);
+	size = 1 << power_of_two;
+	if (size < (size_t) sysconf (_SC_PAGESIZE)) {
+		size = sysconf (_SC_PAGESIZE);
+	}
+
+	if ((fd = memfd_create ("glass_ringbuffer", MFD_CLOEXEC)) < 0) {
+		return glass_ringbuffer_create (sz);
+	}
+	if (ftruncate (fd, size) != 0) {
+		close (fd);
+		return glass_ringbuffer_create (sz);
+	}
+	base = (char *) mmap (NULL, 2 * size, PROT_NONE,
+			      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close (fd);
+		return glass_ringbuffer_create (sz);
+	}
+	if ((mmap (base, size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+	    (mmap (base + size, size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+		munmap (base, 2 * size);
+		close (fd);
+		return glass_ringbuffer_create (sz);
+	}
+	close (fd);
+
+	if ((rb = new (std::nothrow) glass_ringbuffer_t ()) == NULL) {
+		munmap (base, 2 * size);
 		return NULL;
 	}
+	rb->buf = base;
+	rb->size = size;
+	rb->size_mask = size - 1;
+	rb->reserved = size;
+	rb->write_ptr.store (0, std::memory_order_relaxed);
+	rb->read_ptr.store (0, std::memory_order_relaxed);
+	rb->cached_read_ptr = 0;
+	rb->cached_write_ptr = 0;
 	rb->mlocked = 0;
+	rb->mirrored = 1;
 
 	return rb;
+#else
+	return glass_ringbuffer_create (sz);
+#endif  /* MFD_CLOEXEC */
+}
+
+/* Create a new ringbuffer that starts out holding at least `sz' bytes
+   of data and can later be grown with glass_ringbuffer_grow() to hold
+   up to `max_sz' bytes.  Address space for the maximum size is reserved
+   up front, but pages beyond the active size are never touched until
+   the ringbuffer grows into them.  */
+
+glass_ringbuffer_t *
+glass_ringbuffer_create_growable (int sz, int max_sz)
+{
+	int power_of_two;
+	glass_ringbuffer_t *rb;
+
+	if ((rb = glass_ringbuffer_create (sz)) == NULL) {
+		return NULL;
+	}
+
+	for (power_of_two = 1; 1 << power_of_two < max_sz; power_of_two++);
+
+	if ((size_t)(1 << power_of_two) > rb->size) {
+		free (rb->buf);
+		rb->reserved = 1 << power_of_two;
+		if ((rb->buf = (char *) malloc (rb->reserved)) == NULL) {
+			delete rb;
+			return NULL;
+		}
+	}
+
+	return rb;
+}
+
+/* Producer side: double the active size of `rb' until at least `cnt'
+   bytes can be written or the reserved size is reached.  This can only
+   be done while the readable data does not wrap, as then every byte
+   already in the buffer keeps its offset and the consumer sees either
+   the old or the new size consistently.  Returns 1 if the ringbuffer
+   grew.  */
+
+int
+glass_ringbuffer_grow (glass_ringbuffer_t * rb, size_t cnt)
+{
+	size_t w, r;
+	size_t size;
+	int grown = 0;
+
+	w = rb->write_ptr.load (std::memory_order_relaxed);
+	r = rb->read_ptr.load (std::memory_order_acquire);
+	if (r > w) {
+		return 0;
+	}
+	size = rb->size.load (std::memory_order_relaxed);
+	while ((((r - w - 1) & (size - 1)) < cnt) &&
+	       (2 * size <= rb->reserved)) {
+		size *= 2;
+		grown = 1;
+	}
+	if (grown) {
+#ifdef USE_MLOCK
+		/* Keep the whole active area locked */
+		if (rb->mlocked) {
+			size_t old =
+				rb->size.load (std::memory_order_relaxed);
+			mlock (rb->buf + old, size - old);
+		}
+#endif /* USE_MLOCK */
+		/* Published to the consumer by the next write_ptr release */
+		rb->size_mask.store (size - 1, std::memory_order_relaxed);
+		rb->size.store (size, std::memory_order_relaxed);
+	}
+
+	return grown;
 }
 
 /* Free all data associated with the ringbuffer `rb'. */
@@ -89,11 +242,20 @@ glass_ringbuffer_free (glass_ringbuffer_t * rb)
 		munlock (rb->buf, rb->size);
 	}
 #endif /* USE_MLOCK */
+#ifndef WIN32
+	if (rb->mirrored) {
+		munmap (rb->buf, 2 * rb->size);
+		delete rb;
+		return;
+	}
+#endif  /* WIN32 */
 	free (rb->buf);
-	free (rb);
+	delete rb;
 }
 
-/* Lock the data block of `rb' using the system call 'mlock'.  */
+/* Lock the data block of `rb' using the system call 'mlock'.  Only the
+   active size is locked; glass_ringbuffer_grow() locks the rest as the
+   ringbuffer grows into it.  */
 
 int
 glass_ringbuffer_mlock (glass_ringbuffer_t * rb)
@@ -113,8 +275,10 @@ glass_ringbuffer_mlock (glass_ringbuffer_t * rb)
 void
 glass_ringbuffer_reset (glass_ringbuffer_t * rb)
 {
-	rb->read_ptr = 0;
-	rb->write_ptr = 0;
+	rb->read_ptr.store (0, std::memory_order_relaxed);
+	rb->write_ptr.store (0, std::memory_order_relaxed);
+	rb->cached_read_ptr = 0;
+	rb->cached_write_ptr = 0;
     memset(rb->buf, 0, rb->size);
 }
 
@@ -125,50 +289,78 @@ void
 glass_ringbuffer_reset_size (glass_ringbuffer_t * rb, size_t sz)
 {
     rb->size = sz;
-    rb->size_mask = rb->size;
-    rb->size_mask -= 1;
-    rb->read_ptr = 0;
-    rb->write_ptr = 0;
+    rb->size_mask = sz - 1;
+    rb->read_ptr.store (0, std::memory_order_relaxed);
+    rb->write_ptr.store (0, std::memory_order_relaxed);
+    rb->cached_read_ptr = 0;
+    rb->cached_write_ptr = 0;
 }
 
 /* Return the number of bytes available for reading.  This is the
    number of bytes in front of the read pointer and behind the write
-   pointer.  */
+   pointer.  Safe to call from either side. */
 
 size_t
 glass_ringbuffer_read_space (const glass_ringbuffer_t * rb)
 {
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	w = rb->write_ptr.load (std::memory_order_acquire);
+	r = rb->read_ptr.load (std::memory_order_acquire);
 
-	if (w > r) {
-		return w - r;
-	} else {
-		return (w - r + rb->size) & rb->size_mask;
-	}
+	return (w - r) & rb->size_mask;
 }
 
 /* Return the number of bytes available for writing.  This is the
    number of bytes in front of the write pointer and behind the read
-   pointer.  */
+   pointer.  Safe to call from either side. */
 
 size_t
 glass_ringbuffer_write_space (const glass_ringbuffer_t * rb)
 {
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	w = rb->write_ptr.load (std::memory_order_acquire);
+	r = rb->read_ptr.load (std::memory_order_acquire);
 
-	if (w > r) {
-		return ((r - w + rb->size) & rb->size_mask) - 1;
-	} else if (w < r) {
-		return (r - w) - 1;
-	} else {
-		return rb->size - 1;
+	return (r - w - 1) & rb->size_mask;
+}
+
+/* Consumer side: return the readable byte count at read pointer `r',
+   refreshing the cached copy of the write pointer only when the cached
+   value cannot satisfy a request of `cnt' bytes.  This keeps the
+   consumer from touching the producer's cache line on every call. */
+
+static size_t
+glass_ringbuffer_reader_space (glass_ringbuffer_t * rb, size_t r, size_t cnt)
+{
+	size_t free_cnt;
+
+	free_cnt = (rb->cached_write_ptr - r) & rb->size_mask;
+	if (free_cnt < cnt) {
+		rb->cached_write_ptr =
+			rb->write_ptr.load (std::memory_order_acquire);
+		free_cnt = (rb->cached_write_ptr - r) & rb->size_mask;
+	}
+
+	return free_cnt;
+}
+
+/* Producer side counterpart of glass_ringbuffer_reader_space(). */
+
+static size_t
+glass_ringbuffer_writer_space (glass_ringbuffer_t * rb, size_t w, size_t cnt)
+{
+	size_t free_cnt;
+
+	free_cnt = (rb->cached_read_ptr - w - 1) & rb->size_mask;
+	if (free_cnt < cnt) {
+		rb->cached_read_ptr =
+			rb->read_ptr.load (std::memory_order_acquire);
+		free_cnt = (rb->cached_read_ptr - w - 1) & rb->size_mask;
 	}
+
+	return free_cnt;
 }
 
 /* The copying data reader.  Copy at most `cnt' bytes from `rb' to
@@ -181,31 +373,36 @@ glass_ringbuffer_read (glass_ringbuffer_t * rb, char *dest, size_t cnt)
 	size_t cnt2;
 	size_t to_read;
 	size_t n1, n2;
+	size_t r;
+
+	r = rb->read_ptr.load (std::memory_order_relaxed);
 
-	if ((free_cnt = glass_ringbuffer_read_space (rb)) == 0) {
+	if ((free_cnt = glass_ringbuffer_reader_space (rb, r, cnt)) == 0) {
 		return 0;
 	}
 
 	to_read = cnt > free_cnt ? free_cnt : cnt;
 
-	cnt2 = rb->read_ptr + to_read;
+	cnt2 = r + to_read;
 
-	if (cnt2 > rb->size) {
-		n1 = rb->size - rb->read_ptr;
+	if ((cnt2 > rb->size) && (!rb->mirrored)) {
+		n1 = rb->size - r;
 		n2 = cnt2 & rb->size_mask;
 	} else {
 		n1 = to_read;
 		n2 = 0;
 	}
 
-	memcpy (dest, &(rb->buf[rb->read_ptr]), n1);
-	rb->read_ptr = (rb->read_ptr + n1) & rb->size_mask;
+	memcpy (dest, &(rb->buf[r]), n1);
 
 	if (n2) {
-		memcpy (dest + n1, &(rb->buf[rb->read_ptr]), n2);
-		rb->read_ptr = (rb->read_ptr + n2) & rb->size_mask;
+		memcpy (dest + n1, rb->buf, n2);
 	}
 
+	/* Publish the freed space only after the data has been copied out */
+	rb->read_ptr.store ((r + to_read) & rb->size_mask,
+			    std::memory_order_release);
+
 	return to_read;
 }
 
@@ -220,31 +417,30 @@ glass_ringbuffer_peek (glass_ringbuffer_t * rb, char *dest, size_t cnt)
 	size_t cnt2;
 	size_t to_read;
 	size_t n1, n2;
-	size_t tmp_read_ptr;
+	size_t r;
 
-	tmp_read_ptr = rb->read_ptr;
+	r = rb->read_ptr.load (std::memory_order_relaxed);
 
-	if ((free_cnt = glass_ringbuffer_read_space (rb)) == 0) {
+	if ((free_cnt = glass_ringbuffer_reader_space (rb, r, cnt)) == 0) {
 		return 0;
 	}
 
 	to_read = cnt > free_cnt ? free_cnt : cnt;
 
-	cnt2 = tmp_read_ptr + to_read;
+	cnt2 = r + to_read;
 
-	if (cnt2 > rb->size) {
-		n1 = rb->size - tmp_read_ptr;
+	if ((cnt2 > rb->size) && (!rb->mirrored)) {
+		n1 = rb->size - r;
 		n2 = cnt2 & rb->size_mask;
 	} else {
 		n1 = to_read;
 		n2 = 0;
 	}
 
-	memcpy (dest, &(rb->buf[tmp_read_ptr]), n1);
-	tmp_read_ptr = (tmp_read_ptr + n1) & rb->size_mask;
+	memcpy (dest, &(rb->buf[r]), n1);
 
 	if (n2) {
-		memcpy (dest + n1, &(rb->buf[tmp_read_ptr]), n2);
+		memcpy (dest + n1, rb->buf, n2);
 	}
 
 	return to_read;
@@ -260,31 +456,36 @@ glass_ringbuffer_write (glass_ringbuffer_t * rb, const char *src, size_t cnt)
 	size_t cnt2;
 	size_t to_write;
 	size_t n1, n2;
+	size_t w;
+
+	w = rb->write_ptr.load (std::memory_order_relaxed);
 
-	if ((free_cnt = glass_ringbuffer_write_space (rb)) == 0) {
+	if ((free_cnt = glass_ringbuffer_writer_space (rb, w, cnt)) == 0) {
 		return 0;
 	}
 
 	to_write = cnt > free_cnt ? free_cnt : cnt;
 
-	cnt2 = rb->write_ptr + to_write;
+	cnt2 = w + to_write;
 
-	if (cnt2 > rb->size) {
-		n1 = rb->size - rb->write_ptr;
+	if ((cnt2 > rb->size) && (!rb->mirrored)) {
+		n1 = rb->size - w;
 		n2 = cnt2 & rb->size_mask;
 	} else {
 		n1 = to_write;
 		n2 = 0;
 	}
 
-	memcpy (&(rb->buf[rb->write_ptr]), src, n1);
-	rb->write_ptr = (rb->write_ptr + n1) & rb->size_mask;
+	memcpy (&(rb->buf[w]), src, n1);
 
 	if (n2) {
-		memcpy (&(rb->buf[rb->write_ptr]), src + n1, n2);
-		rb->write_ptr = (rb->write_ptr + n2) & rb->size_mask;
+		memcpy (rb->buf, src + n1, n2);
 	}
 
+	/* Publish the new data only after it has been copied in */
+	rb->write_ptr.store ((w + to_write) & rb->size_mask,
+			     std::memory_order_release);
+
 	return to_write;
 }
 
@@ -293,8 +494,9 @@ glass_ringbuffer_write (glass_ringbuffer_t * rb, const char *src, size_t cnt)
 void
 glass_ringbuffer_read_advance (glass_ringbuffer_t * rb, size_t cnt)
 {
-	size_t tmp = (rb->read_ptr + cnt) & rb->size_mask;
-	rb->read_ptr = tmp;
+	size_t tmp = (rb->read_ptr.load (std::memory_order_relaxed) + cnt) &
+		rb->size_mask;
+	rb->read_ptr.store (tmp, std::memory_order_release);
 }
 
 /* Advance the write pointer `cnt' places. */
@@ -302,8 +504,9 @@ glass_ringbuffer_read_advance (glass_ringbuffer_t * rb, size_t cnt)
 void
 glass_ringbuffer_write_advance (glass_ringbuffer_t * rb, size_t cnt)
 {
-	size_t tmp = (rb->write_ptr + cnt) & rb->size_mask;
-	rb->write_ptr = tmp;
+	size_t tmp = (rb->write_ptr.load (std::memory_order_relaxed) + cnt) &
+		rb->size_mask;
+	rb->write_ptr.store (tmp, std::memory_order_release);
 }
 
 /* The non-copying data reader.  `vec' is an array of two places.  Set
@@ -319,18 +522,14 @@ glass_ringbuffer_get_read_vector (const glass_ringbuffer_t * rb,
 	size_t cnt2;
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	w = rb->write_ptr.load (std::memory_order_acquire);
+	r = rb->read_ptr.load (std::memory_order_relaxed);
 
-	if (w > r) {
-		free_cnt = w - r;
-	} else {
-		free_cnt = (w - r + rb->size) & rb->size_mask;
-	}
+	free_cnt = (w - r) & rb->size_mask;
 
 	cnt2 = r + free_cnt;
 
-	if (cnt2 > rb->size) {
+	if ((cnt2 > rb->size) && (!rb->mirrored)) {
 
 		/* Two part vector: the rest of the buffer after the current write
 		   ptr, plus some from the start of the buffer. */
@@ -342,7 +541,8 @@ glass_ringbuffer_get_read_vector (const glass_ringbuffer_t * rb,
 
 	} else {
 
-		/* Single part vector: just the rest of the buffer */
+		/* Single part vector: just the rest of the buffer, or all of
+		   it when the pages are mirrored */
 
 		vec[0].buf = &(rb->buf[r]);
 		vec[0].len = free_cnt;
@@ -363,20 +563,14 @@ glass_ringbuffer_get_write_vector (const glass_ringbuffer_t * rb,
 	size_t cnt2;
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	w = rb->write_ptr.load (std::memory_order_relaxed);
+	r = rb->read_ptr.load (std::memory_order_acquire);
 
-	if (w > r) {
-		free_cnt = ((r - w + rb->size) & rb->size_mask) - 1;
-	} else if (w < r) {
-		free_cnt = (r - w) - 1;
-	} else {
-		free_cnt = rb->size - 1;
-	}
+	free_cnt = (r - w - 1) & rb->size_mask;
 
 	cnt2 = w + free_cnt;
 
-	if (cnt2 > rb->size) {
+	if ((cnt2 > rb->size) && (!rb->mirrored)) {
 
 		/* Two part vector: the rest of the buffer after the current write
 		   ptr, plus some from the start of the buffer. */
@@ -393,33 +587,155 @@ glass_ringbuffer_get_write_vector (const glass_ringbuffer_t * rb,
 }
 
 
-Ringbuffer::Ringbuffer(size_t bytes,unsigned channels)
+Ringbuffer::Ringbuffer(size_t bytes,unsigned channels,size_t max_bytes,
+		       bool mirrored)
 {
   ring_channels=channels;
-  ring_ring=glass_ringbuffer_create(bytes);
+  if(max_bytes>bytes) {  // Growable rings can't be mirrored
+    ring_ring=glass_ringbuffer_create_growable(bytes,max_bytes);
+  }
+  else {
+    if(mirrored) {
+      ring_ring=glass_ringbuffer_create_mirrored(bytes);
+    }
+    else {
+      ring_ring=glass_ringbuffer_create(bytes);
+    }
+  }
   ring_reset=false;
   ring_finished=false;
+  ring_space_wanted=0;
+  ring_aborted=false;
+  pthread_mutex_init(&ring_space_mutex,NULL);
+  pthread_cond_init(&ring_space_cond,NULL);
+  ring_data_wanted=0;
+  pthread_mutex_init(&ring_data_mutex,NULL);
+  pthread_cond_init(&ring_data_cond,NULL);
+#ifdef WIN32
+  ring_space_fd=-1;
+#else
+  ring_space_fd=eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+#endif  // WIN32
 }
 
 
 Ringbuffer::~Ringbuffer()
 {
+  if(ring_space_fd>=0) {
+    close(ring_space_fd);
+  }
+  pthread_cond_destroy(&ring_space_cond);
+  pthread_mutex_destroy(&ring_space_mutex);
+  pthread_cond_destroy(&ring_data_cond);
+  pthread_mutex_destroy(&ring_data_mutex);
   glass_ringbuffer_free(ring_ring);
 }
 
 
 unsigned Ringbuffer::size() const
 {
-  return 0;
+  return (ring_ring->size-1)/(sizeof(float)*ring_channels);
+}
+
+
+unsigned Ringbuffer::maximumSize() const
+{
+  return (ring_ring->reserved-1)/(sizeof(float)*ring_channels);
+}
+
+
+bool Ringbuffer::isGrowable() const
+{
+  return ring_ring->reserved>ring_ring->size;
+}
+
+
+bool Ringbuffer::isMirrored() const
+{
+  return ring_ring->mirrored!=0;
+}
+
+
+bool Ringbuffer::growToFit(unsigned frames)
+{
+  //
+  // Producer side only
+  //
+  if(isGrowable()&&(writeSpace()<frames)) {
+    glass_ringbuffer_grow(ring_ring,frames*sizeof(float)*ring_channels);
+  }
+  return writeSpace()>=frames;
 }
 
 
 unsigned Ringbuffer::read(float *data,unsigned frames)
 {
+  unsigned ret;
+
   ring_reset=frames>readSpace();
-  return glass_ringbuffer_read(ring_ring,(char *)data,
-			      frames*sizeof(float)*ring_channels)/
+  ret=glass_ringbuffer_read(ring_ring,(char *)data,
+			    frames*sizeof(float)*ring_channels)/
     (sizeof(float)*ring_channels);
+  NotifySpace();
+
+  return ret;
+}
+
+
+float *Ringbuffer::peekContiguous(unsigned *frames)
+{
+  //
+  // Return a pointer to up to '*frames' of readable data that can be
+  // used in place, updating '*frames' with the number actually
+  // available. On a ring that is not mirrored this stops at the end of
+  // the buffer, and may be zero if a frame straddles the end.
+  //
+  glass_ringbuffer_data_t vec[2];
+  size_t frame_bytes=sizeof(float)*ring_channels;
+
+  ring_reset=*frames>readSpace();
+  glass_ringbuffer_get_read_vector(ring_ring,vec);
+  if((vec[0].len/frame_bytes)<*frames) {
+    *frames=vec[0].len/frame_bytes;
+  }
+
+  return (float *)vec[0].buf;
+}
+
+
+unsigned Ringbuffer::peekVector(glass_ringbuffer_data_t *vec,unsigned frames)
+{
+  //
+  // Point 'vec[0]' and 'vec[1]' at up to 'frames' of readable data as
+  // raw bytes, for callers (such as writev(2)) that don't care where a
+  // frame is split. Returns the number of frames covered.
+  //
+  size_t frame_bytes=sizeof(float)*ring_channels;
+  unsigned avail;
+  size_t bytes;
+
+  glass_ringbuffer_get_read_vector(ring_ring,vec);
+  avail=(vec[0].len+vec[1].len)/frame_bytes;
+  if((ring_reset=frames>avail)) {
+    frames=avail;
+  }
+  bytes=frames*frame_bytes;
+  if(vec[0].len>=bytes) {
+    vec[0].len=bytes;
+    vec[1].len=0;
+  }
+  else {
+    vec[1].len=bytes-vec[0].len;
+  }
+
+  return frames;
+}
+
+
+void Ringbuffer::commitRead(unsigned frames)
+{
+  glass_ringbuffer_read_advance(ring_ring,frames*sizeof(float)*ring_channels);
+  NotifySpace();
 }
 
 
@@ -431,9 +747,45 @@ unsigned Ringbuffer::readSpace() const
 
 unsigned Ringbuffer::write(float *data,unsigned frames)
 {
-  return glass_ringbuffer_write(ring_ring,(const char *)data,
-			      frames*sizeof(float)*ring_channels)/
+  //
+  // Never store a partial frame
+  //
+  unsigned ret;
+
+  if(frames>writeSpace()) {
+    frames=writeSpace();
+  }
+  ret=glass_ringbuffer_write(ring_ring,(const char *)data,
+			     frames*sizeof(float)*ring_channels)/
     (sizeof(float)*ring_channels);
+  NotifyData();
+
+  return ret;
+}
+
+
+float *Ringbuffer::reserveContiguous(unsigned *frames)
+{
+  //
+  // Write-side counterpart of peekContiguous()
+  //
+  glass_ringbuffer_data_t vec[2];
+  size_t frame_bytes=sizeof(float)*ring_channels;
+
+  glass_ringbuffer_get_write_vector(ring_ring,vec);
+  if((vec[0].len/frame_bytes)<*frames) {
+    *frames=vec[0].len/frame_bytes;
+  }
+
+  return (float *)vec[0].buf;
+}
+
+
+void Ringbuffer::commitWrite(unsigned frames)
+{
+  glass_ringbuffer_write_advance(ring_ring,
+				 frames*sizeof(float)*ring_channels);
+  NotifyData();
 }
 
 
@@ -454,18 +806,21 @@ unsigned Ringbuffer::dump(unsigned frames)
     ret=bytes/(ring_channels*sizeof(float));
   }
   glass_ringbuffer_read_advance(ring_ring,bytes);
+  NotifySpace();
 
   return ret;
 }
 
 
+bool Ringbuffer::mlock()
+{
+  return glass_ringbuffer_mlock(ring_ring)==0;
+}
+
+
 bool Ringbuffer::isReset()
 {
-  if(ring_reset) {
-    ring_reset=false;
-    return true;
-  }
-  return false;
+  return ring_reset.exchange(false);
 }
 
 
@@ -478,4 +833,161 @@ bool Ringbuffer::isFinished() const
 void Ringbuffer::setFinished()
 {
   ring_finished=true;
+  pthread_mutex_lock(&ring_data_mutex);
+  pthread_cond_broadcast(&ring_data_cond);
+  pthread_mutex_unlock(&ring_data_mutex);
+}
+
+
+bool Ringbuffer::waitWriteSpace(unsigned frames,int msecs)
+{
+  //
+  // Block the producer until the consumer has freed at least 'frames'
+  // of space, 'msecs' have elapsed or abortWait() is called.
+  //
+  struct timespec ts;
+  bool ret=false;
+
+  if(writeSpace()>=frames) {
+    return true;
+  }
+  clock_gettime(CLOCK_REALTIME,&ts);
+  ts.tv_sec+=msecs/1000;
+  ts.tv_nsec+=1000000*(msecs%1000);
+  if(ts.tv_nsec>=1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec-=1000000000;
+  }
+  pthread_mutex_lock(&ring_space_mutex);
+  ring_space_wanted=frames;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while((!(ret=(writeSpace()>=frames)))&&(!ring_aborted)) {
+    if(pthread_cond_timedwait(&ring_space_cond,&ring_space_mutex,&ts)==
+       ETIMEDOUT) {
+      ret=writeSpace()>=frames;
+      break;
+    }
+  }
+  ring_space_wanted=0;
+  pthread_mutex_unlock(&ring_space_mutex);
+
+  return ret;
+}
+
+
+bool Ringbuffer::waitReadSpace(unsigned frames,int msecs)
+{
+  //
+  // Block the consumer until the producer has written at least 'frames'
+  // of data, 'msecs' have elapsed or setFinished() is called.
+  //
+  struct timespec ts;
+  bool ret=false;
+
+  if(readSpace()>=frames) {
+    return true;
+  }
+  clock_gettime(CLOCK_REALTIME,&ts);
+  ts.tv_sec+=msecs/1000;
+  ts.tv_nsec+=1000000*(msecs%1000);
+  if(ts.tv_nsec>=1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec-=1000000000;
+  }
+  pthread_mutex_lock(&ring_data_mutex);
+  ring_data_wanted=frames;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while((!(ret=(readSpace()>=frames)))&&(!ring_finished)) {
+    if(pthread_cond_timedwait(&ring_data_cond,&ring_data_mutex,&ts)==
+       ETIMEDOUT) {
+      ret=readSpace()>=frames;
+      break;
+    }
+  }
+  ring_data_wanted=0;
+  pthread_mutex_unlock(&ring_data_mutex);
+
+  return ret;
+}
+
+
+void Ringbuffer::requestSpaceNotify(unsigned frames)
+{
+  //
+  // Arm a one-shot notification on spaceNotifyDescriptor(), to fire
+  // once at least 'frames' of space are available for writing.
+  //
+  ring_space_wanted=frames;
+  NotifySpace();
+}
+
+
+int Ringbuffer::spaceNotifyDescriptor() const
+{
+  return ring_space_fd;
+}
+
+
+void Ringbuffer::clearSpaceNotify()
+{
+#ifndef WIN32
+  uint64_t count;
+
+  if(ring_space_fd>=0) {
+    while(::read(ring_space_fd,&count,sizeof(count))>0);
+  }
+#endif  // WIN32
+}
+
+
+void Ringbuffer::abortWait()
+{
+  ring_aborted=true;
+  pthread_mutex_lock(&ring_space_mutex);
+  pthread_cond_broadcast(&ring_space_cond);
+  pthread_mutex_unlock(&ring_space_mutex);
+}
+
+
+void Ringbuffer::NotifySpace()
+{
+  unsigned wanted;
+
+  //
+  // Called after the read pointer moves. The fence pairs with the one in
+  // waitWriteSpace() so that either the producer sees the freed space or
+  // we see its request; a wakeup can never be lost between the two.
+  //
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(((wanted=ring_space_wanted)>0)&&(writeSpace()>=wanted)) {
+    ring_space_wanted=0;
+    pthread_mutex_lock(&ring_space_mutex);
+    pthread_cond_broadcast(&ring_space_cond);
+    pthread_mutex_unlock(&ring_space_mutex);
+#ifndef WIN32
+    uint64_t one=1;
+    if(ring_space_fd>=0) {
+      ssize_t n=::write(ring_space_fd,&one,sizeof(one));
+      (void)n;
+    }
+#endif  // WIN32
+  }
+}
+
+
+void Ringbuffer::NotifyData()
+{
+  unsigned wanted;
+
+  //
+  // Called after the write pointer moves; the read-side twin of
+  // NotifySpace()
+  //
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(((wanted=ring_data_wanted)>0)&&(readSpace()>=wanted)) {
+    ring_data_wanted=0;
+    pthread_mutex_lock(&ring_data_mutex);
+    pthread_cond_broadcast(&ring_data_cond);
+    pthread_mutex_unlock(&ring_data_mutex);
+  }
 }
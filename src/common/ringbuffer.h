@@ -27,8 +27,16 @@
 #ifndef RINGBUFFER_H
 #define RINGBUFFER_H
 
+#include <pthread.h>
 #include <sys/types.h>
 
+#include <atomic>
+
+//
+// Keep the producer and consumer indices on separate cache lines
+//
+#define GLASS_RINGBUFFER_CACHE_LINE 64
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -42,14 +50,28 @@ glass_ringbuffer_data_t ;
 
 typedef struct {
     char	*buf;
-    volatile size_t write_ptr;
-    volatile size_t read_ptr;
-    size_t	size;
-    size_t	size_mask;
+    std::atomic<size_t> size;
+    std::atomic<size_t> size_mask;
+    size_t	reserved;
     int	mlocked;
+    int	mirrored;
+    char	pad0[GLASS_RINGBUFFER_CACHE_LINE];
+
+    /* Producer side */
+    std::atomic<size_t> write_ptr;
+    size_t	cached_read_ptr;
+    char	pad1[GLASS_RINGBUFFER_CACHE_LINE];
+
+    /* Consumer side */
+    std::atomic<size_t> read_ptr;
+    size_t	cached_write_ptr;
+    char	pad2[GLASS_RINGBUFFER_CACHE_LINE];
 }
 glass_ringbuffer_t ;
 glass_ringbuffer_t *glass_ringbuffer_create(int sz);
+glass_ringbuffer_t *glass_ringbuffer_create_growable(int sz,int max_sz);
+glass_ringbuffer_t *glass_ringbuffer_create_mirrored(int sz);
+int glass_ringbuffer_grow(glass_ringbuffer_t *rb,size_t cnt);
 void glass_ringbuffer_free(glass_ringbuffer_t *rb);
 void glass_ringbuffer_get_read_vector(const glass_ringbuffer_t *rb,
                                      glass_ringbuffer_data_t *vec);
@@ -74,23 +96,50 @@ size_t glass_ringbuffer_write_space(const glass_ringbuffer_t *rb);
 class Ringbuffer
 {
  public:
-  Ringbuffer(size_t bytes,unsigned channels);
+  Ringbuffer(size_t bytes,unsigned channels,size_t max_bytes=0,
+	     bool mirrored=false);
   ~Ringbuffer();
   unsigned size() const;
+  unsigned maximumSize() const;
+  bool isGrowable() const;
+  bool growToFit(unsigned frames);
+  bool isMirrored() const;
   unsigned read(float *data,unsigned frames);
+  float *peekContiguous(unsigned *frames);
+  unsigned peekVector(glass_ringbuffer_data_t *vec,unsigned frames);
+  void commitRead(unsigned frames);
   unsigned readSpace() const;
   unsigned write(float *data,unsigned frames);
+  float *reserveContiguous(unsigned *frames);
+  void commitWrite(unsigned frames);
   unsigned writeSpace() const;
   unsigned dump(unsigned frames);
+  bool mlock();
   bool isReset();
   bool isFinished() const;
   void setFinished();
+  bool waitWriteSpace(unsigned frames,int msecs);
+  bool waitReadSpace(unsigned frames,int msecs);
+  void requestSpaceNotify(unsigned frames);
+  int spaceNotifyDescriptor() const;
+  void clearSpaceNotify();
+  void abortWait();
 
  private:
+  void NotifySpace();
+  void NotifyData();
   glass_ringbuffer_t *ring_ring;
   unsigned ring_channels;
-  bool ring_reset;
-  bool ring_finished;
+  std::atomic<bool> ring_reset;
+  std::atomic<bool> ring_finished;
+  std::atomic<unsigned> ring_space_wanted;
+  std::atomic<bool> ring_aborted;
+  pthread_mutex_t ring_space_mutex;
+  pthread_cond_t ring_space_cond;
+  int ring_space_fd;
+  std::atomic<unsigned> ring_data_wanted;
+  pthread_mutex_t ring_data_mutex;
+  pthread_cond_t ring_data_cond;
 };
 
 
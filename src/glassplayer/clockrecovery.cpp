@@ -0,0 +1,99 @@
+// clockrecovery.cpp
+//
+// Track the drift between stream and device clocks.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#include "audiodevice.h"
+#include "clockrecovery.h"
+
+ClockRecovery::ClockRecovery(unsigned samprate)
+{
+  cr_samprate=samprate;
+  reset(0);
+}
+
+
+void ClockRecovery::reset(unsigned setpoint_frames)
+{
+  cr_setpoint_frames=setpoint_frames;
+  cr_filtered_frames=setpoint_frames;
+  cr_integral=0.0;
+  cr_offset=0.0;
+}
+
+
+double ClockRecovery::update(unsigned fill_frames,unsigned elapsed_frames)
+{
+  double dt=(double)elapsed_frames/cr_samprate;
+  double err;
+
+  //
+  // Smooth out the sawtooth that the codec's bursty writes and the
+  // device's periodic reads put on the fill level
+  //
+  cr_filtered_frames+=(dt/(CLOCK_RECOVERY_FILTER_TIME+dt))*
+    ((double)fill_frames-cr_filtered_frames);
+
+  //
+  // PI controller on the fill error, measured in seconds of audio. The
+  // integral term converges on the actual clock drift; the proportional
+  // term walks the fill level back to the setpoint.
+  //
+  err=((double)cr_setpoint_frames-cr_filtered_frames)/cr_samprate;
+  cr_integral+=err*dt/
+    (CLOCK_RECOVERY_RESPONSE_TIME*CLOCK_RECOVERY_INTEGRAL_TIME);
+  if(cr_integral>PLL_CORRECTION_LIMIT) {
+    cr_integral=PLL_CORRECTION_LIMIT;
+  }
+  if(cr_integral<(-PLL_CORRECTION_LIMIT)) {
+    cr_integral=-PLL_CORRECTION_LIMIT;
+  }
+  cr_offset=err/CLOCK_RECOVERY_RESPONSE_TIME+cr_integral;
+  if(cr_offset>PLL_CORRECTION_LIMIT) {
+    cr_offset=PLL_CORRECTION_LIMIT;
+  }
+  if(cr_offset<(-PLL_CORRECTION_LIMIT)) {
+    cr_offset=-PLL_CORRECTION_LIMIT;
+  }
+
+  return cr_offset;
+}
+
+
+double ClockRecovery::offset() const
+{
+  return cr_offset;
+}
+
+
+double ClockRecovery::drift() const
+{
+  return cr_integral;
+}
+
+
+unsigned ClockRecovery::setpointFrames() const
+{
+  return cr_setpoint_frames;
+}
+
+
+unsigned ClockRecovery::filteredFrames() const
+{
+  return (unsigned)cr_filtered_frames;
+}
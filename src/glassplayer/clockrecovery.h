@@ -0,0 +1,52 @@
+// clockrecovery.h
+//
+// Track the drift between stream and device clocks.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#ifndef CLOCKRECOVERY_H
+#define CLOCKRECOVERY_H
+
+//
+// Time constants (seconds) for the fill-level filter, the proportional
+// response and the integral (drift tracking) response
+//
+#define CLOCK_RECOVERY_FILTER_TIME 2.0
+#define CLOCK_RECOVERY_RESPONSE_TIME 30.0
+#define CLOCK_RECOVERY_INTEGRAL_TIME 120.0
+
+class ClockRecovery
+{
+ public:
+  ClockRecovery(unsigned samprate);
+  void reset(unsigned setpoint_frames);
+  double update(unsigned fill_frames,unsigned elapsed_frames);
+  double offset() const;
+  double drift() const;
+  unsigned setpointFrames() const;
+  unsigned filteredFrames() const;
+
+ private:
+  double cr_samprate;
+  unsigned cr_setpoint_frames;
+  double cr_filtered_frames;
+  double cr_integral;
+  double cr_offset;
+};
+
+
+#endif  // CLOCKRECOVERY_H
@@ -99,7 +99,6 @@ void CodecFdk::process(const QByteArray &data,bool is_last)
   unsigned used=0;
   QByteArray buffer;
   int16_t pcm16[16384];
-  float pcm[16384];
   unsigned char *bitstream[1];
   unsigned bitstream_length[1];
 
@@ -121,9 +120,10 @@ void CodecFdk::process(const QByteArray &data,bool is_last)
 	  }
 	}
 	else {
-	  src_short_to_float_array(pcm16,pcm,
+	  src_short_to_float_array(pcm16,
+				   acquirePcmSpace(fdk_cinfo->frameSize),
 				   fdk_cinfo->frameSize*fdk_cinfo->numChannels);
-	  writePcm(pcm,fdk_cinfo->frameSize,is_last);
+	  commitPcm(fdk_cinfo->frameSize,is_last);
 	}
       }
       if(err==AAC_DEC_TRANSPORT_SYNC_ERROR) {
@@ -30,6 +30,7 @@
 
 #include "codec_mpeg1.h"
 #include "logging.h"
+#include "pcmkernels.h"
 
 CodecMpeg1::CodecMpeg1(unsigned bitrate,QObject *parent)
   : Codec(Codec::TypeMpeg1,bitrate,parent)
@@ -62,7 +63,6 @@ QString CodecMpeg1::defaultExtension() const
 void CodecMpeg1::process(const QByteArray &data,bool is_last)
 {
 #ifdef HAVE_LIBMAD
-  float pcm[32768*4];
   int frame_offset=0;
   int err_count=0;
 
@@ -72,12 +72,7 @@ void CodecMpeg1::process(const QByteArray &data,bool is_last)
   do {
     while(mad_frame_decode(&mpeg1_mad_frame,&mpeg1_mad_stream)==0) {  
       mad_synth_frame(&mpeg1_mad_synth,&mpeg1_mad_frame);
-      for(int i=0;i<mpeg1_mad_synth.pcm.length;i++) {
-	for(int j=0;j<mpeg1_mad_synth.pcm.channels;j++) {
-	  pcm[frame_offset+i*mpeg1_mad_synth.pcm.channels+j]=
-	    (float)mad_f_todouble(mpeg1_mad_synth.pcm.samples[j][i]);
-	}
-      }
+      WriteFrame();
       frame_offset+=(mpeg1_mad_synth.pcm.length*mpeg1_mad_synth.pcm.channels);
     }
     if(MAD_RECOVERABLE(mpeg1_mad_stream.error)!=0) {
@@ -98,9 +93,10 @@ void CodecMpeg1::process(const QByteArray &data,bool is_last)
 	}
 	setFramed(channels,mpeg1_mad_frame.header.samplerate,
 		  mpeg1_mad_frame.header.bitrate/1000);
-      }
-      else {
-	writePcm(pcm,frame_offset/channels(),is_last);
+	if(!mpeg1_pending.empty()) {
+	  writePcm(mpeg1_pending.data(),mpeg1_pending.size()/channels,false);
+	  mpeg1_pending.clear();
+	}
       }
     }
     mpeg1_mpeg=
@@ -116,12 +112,7 @@ void CodecMpeg1::process(const QByteArray &data,bool is_last)
     do {
       while(mad_frame_decode(&mpeg1_mad_frame,&mpeg1_mad_stream)==0) {  
 	mad_synth_frame(&mpeg1_mad_synth,&mpeg1_mad_frame);
-	for(int i=0;i<mpeg1_mad_synth.pcm.length;i++) {
-	  for(int j=0;j<mpeg1_mad_synth.pcm.channels;j++) {
-	    pcm[frame_offset+i*mpeg1_mad_synth.pcm.channels+j]=
-	      (float)mad_f_todouble(mpeg1_mad_synth.pcm.samples[j][i]);
-	  }
-	}
+	WriteFrame();
 	frame_offset+=(mpeg1_mad_synth.pcm.length*mpeg1_mad_synth.pcm.channels);
       }
       if(MAD_RECOVERABLE(mpeg1_mad_stream.error)!=0) {
@@ -131,7 +122,9 @@ void CodecMpeg1::process(const QByteArray &data,bool is_last)
 	}
       }
     } while(mpeg1_mad_stream.error!=MAD_ERROR_BUFLEN);
-    writePcm(pcm,frame_offset/channels(),is_last);
+    if(isFramed()) {
+      commitPcm(0,true);
+    }
   }
 #endif  // HAVE_LIBMAD
 }
@@ -202,6 +195,35 @@ void CodecMpeg1::loadStats(QStringList *hdrs,QStringList *values,bool is_first)
 }
 
 
+void CodecMpeg1::WriteFrame()
+{
+#ifdef HAVE_LIBMAD
+  //
+  // Until the first complete read has told us the format there is no
+  // ring to write to, so hold the audio decoded so far and let
+  // process() write it out right after setFramed()
+  //
+  const int32_t *planes[2]=
+    {(const int32_t *)mpeg1_mad_synth.pcm.samples[0],
+     (const int32_t *)mpeg1_mad_synth.pcm.samples[1]};
+  unsigned frames=mpeg1_mad_synth.pcm.length;
+  unsigned chans=mpeg1_mad_synth.pcm.channels;
+  size_t len=mpeg1_pending.size();
+
+  if(isFramed()) {
+    PcmInterleaveFixed(acquirePcmSpace(frames),planes,chans,frames,
+		       MAD_F_FRACBITS);
+    commitPcm(frames,false);
+  }
+  else {
+    mpeg1_pending.resize(len+frames*chans);
+    PcmInterleaveFixed(mpeg1_pending.data()+len,planes,chans,frames,
+		       MAD_F_FRACBITS);
+  }
+#endif  // HAVE_LIBMAD
+}
+
+
 void CodecMpeg1::Reset()
 {
   FreeLibmad();
@@ -21,6 +21,8 @@
 #ifndef CODEC_MPEG1_H
 #define CODEC_MPEG1_H
 
+#include <vector>
+
 #ifdef HAVE_LIBMAD
 #include <mad.h>
 #endif  // HAVE_LIBMAD
@@ -41,6 +43,7 @@ class CodecMpeg1 : public Codec
   void loadStats(QStringList *hdrs,QStringList *values,bool is_first);
 
  private:
+  void WriteFrame();
   void Reset();
   bool LoadLibmad();
   void FreeLibmad();
@@ -65,6 +68,7 @@ class CodecMpeg1 : public Codec
   struct mad_frame mpeg1_mad_frame;
   struct mad_synth mpeg1_mad_synth;
   struct mad_header mpeg1_mad_header;
+  std::vector<float> mpeg1_pending;
 
 #endif  // HAVE_LIBMAD
 };
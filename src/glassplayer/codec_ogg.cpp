@@ -66,7 +66,6 @@ void CodecOgg::process(const QByteArray &data,bool is_last)
   char *os_buffer;
   float **pcm;
   int frames;
-  float ipcm[11520];
   unsigned chans=0;
   unsigned samprate=0;
 
@@ -162,8 +161,8 @@ void CodecOgg::process(const QByteArray &data,bool is_last)
 	  vorbis_synthesis_blockin(&vd,&vb);
 	  while((frames=vorbis_synthesis_pcmout(&vd,&pcm))>0) {
 	    int bout=(frames<4096?frames:4096);
-	    Codec::interleave(ipcm,pcm,vi.channels,bout);
-	    writePcm(ipcm,bout,false);
+	    Codec::interleave(acquirePcmSpace(bout),pcm,vi.channels,bout);
+	    commitPcm(bout,false);
 	    vorbis_synthesis_read(&vd,bout);
 	  }
 	}
@@ -184,9 +183,9 @@ void CodecOgg::process(const QByteArray &data,bool is_last)
     case 21:   // OPUS: Decode Loop
       ogg_stream_pagein(&ogg_os,&ogg_og);
       while(ogg_stream_packetout(&ogg_os,&ogg_op)) {
-	if((frames=opus_decode_float(ogg_opus_decoder,ogg_op.packet,ogg_op.bytes,ipcm,5760,0))>0) {
-	  writePcm(ipcm,frames,false);
-	}
+	frames=opus_decode_float(ogg_opus_decoder,ogg_op.packet,ogg_op.bytes,
+				 acquirePcmSpace(5760),5760,0);
+	commitPcm(frames>0?frames:0,false);
       }
       break;
     }
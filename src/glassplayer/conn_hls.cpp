@@ -255,7 +255,7 @@ void Hls::indexProcessStartData()
     else {
       if(*playlist!=*hls_index_playlist) {
 	*hls_index_playlist=*playlist;
-	if(isConnected()||hls_index_playlist->segmentQuantity()>=3) {
+	if(isConnected()||PrebufferReady()) {
 	  hls_media_timer->start(0);
 	}
 	else {
@@ -410,29 +410,51 @@ void Hls::mediaProcessStartData()
 }
 
 
-QByteArray Hls::ReadHeaders(QByteArray &data)
+bool Hls::PrebufferReady()
 {
-  QString line;
-  unsigned used=0;
+  //
+  // Without a prebuffer setting, wait for three segments and start from
+  // the oldest. Otherwise, start as soon as the newest segments cover
+  // the prebuffer, skipping any older ones.
+  //
+  if(prebufferMsecs()==0) {
+    return hls_index_playlist->segmentQuantity()>=3;
+  }
+  double secs=0.0;
+  for(int i=hls_index_playlist->segmentQuantity()-1;i>=0;i--) {
+    secs+=hls_index_playlist->segmentDuration(i);
+    if((1000.0*secs)>=(double)prebufferMsecs()) {
+      if(i>0) {
+	hls_last_media_segment=hls_index_playlist->segmentUrl(i-1);
+      }
+      return true;
+    }
+  }
+  return false;
+}
 
-  for(int i=0;i<data.size();i++) {
-    switch(0xFF&data.constData()[i]) {
-    case 13:
-      break;
 
-    case 10:
-      if(line.isEmpty()) {
-	return data.right(data.length()-used);
-      }
-      ProcessHeader(line);
-      line="";
+QByteArray Hls::ReadHeaders(QByteArray &data)
+{
+  HeaderParser parser;
+  const char *p=data.constData();
+  int len=data.length();
+  int n;
+
+  while(len>0) {
+    switch(parser.next(p,len,&n)) {
+    case HeaderParser::HeaderLine:
+      ProcessHeader(QString::fromUtf8(parser.line(),parser.lineLength()));
       break;
 
-    default:
-      line+=data.constData()[i];
+    case HeaderParser::HeaderEnd:
+      return data.mid(p+n-data.constData());
+
+    case HeaderParser::NeedMore:
       break;
     }
-    used++;
+    p+=n;
+    len-=n;
   }
   return QByteArray();
 }
@@ -28,6 +28,7 @@
 #include <QTimer>
 
 #include "connector.h"
+#include "headerparser.h"
 #include "id3parser.h"
 #include "m3uplaylist.h"
 #include "meteraverage.h"
@@ -54,6 +55,7 @@ class Hls : public Connector
   void mediaProcessStartData();
 
  private:
+  bool PrebufferReady();
   QByteArray ReadHeaders(QByteArray &data);
   void ProcessHeader(const QString &str);
   void StopProcess(QProcess *proc);
@@ -0,0 +1,473 @@
+// conn_httpfile.cpp
+//
+// Server connector for static files fetched over HTTP.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#include <QRegExp>
+#include <QStringList>
+
+#include "conn_httpfile.h"
+#include "logging.h"
+
+HttpFile::HttpFile(const QString &mimetype,QObject *parent)
+  : Connector(mimetype,parent)
+{
+  http_socket=NULL;
+  http_adopted=false;
+  http_header_active=false;
+  http_result_code=0;
+  http_response_length=-1;
+  http_range_start=-1;
+  http_content_length=-1;
+  http_position=0;
+  http_skip=0;
+  http_finished=false;
+  http_retries=0;
+  http_resumes=0;
+
+  http_retry_timer=new QTimer(this);
+  http_retry_timer->setSingleShot(true);
+  connect(http_retry_timer,SIGNAL(timeout()),this,SLOT(retryData()));
+
+  http_resume_timer=new QTimer(this);
+  http_resume_timer->setSingleShot(true);
+  connect(http_resume_timer,SIGNAL(timeout()),this,SLOT(readyReadData()));
+}
+
+
+HttpFile::~HttpFile()
+{
+  if(http_socket!=NULL) {
+    delete http_socket;
+  }
+}
+
+
+Connector::ServerType HttpFile::serverType() const
+{
+  return Connector::HttpFileServer;
+}
+
+
+void HttpFile::reset()
+{
+  if(http_socket!=NULL) {
+    http_socket->disconnect();
+  }
+  http_resume_timer->stop();
+  http_retry_timer->start(HTTPFILE_RETRY_INTERVAL);
+}
+
+
+bool HttpFile::adoptConnection(QTcpSocket *sock,const QByteArray &data)
+{
+  if(http_socket!=NULL) {
+    delete http_socket;
+  }
+  http_socket=sock;
+  http_socket->setParent(this);
+  http_socket->setReadBufferSize(WindowSize());
+  connect(http_socket,SIGNAL(readyRead()),this,SLOT(readyReadData()));
+  connect(http_socket,SIGNAL(error(QAbstractSocket::SocketError)),
+	  this,SLOT(errorData(QAbstractSocket::SocketError)));
+  http_adopted_data=data;
+  http_adopted=true;
+
+  return true;
+}
+
+
+void HttpFile::connectToHostConnector()
+{
+  if(http_adopted) {
+    http_adopted=false;
+    InitResponse();
+    http_buffer=http_adopted_data;
+    http_adopted_data.clear();
+    QTimer::singleShot(0,this,SLOT(readyReadData()));
+    return;
+  }
+  InitSocket();
+  if(serverUrl().scheme().toLower()=="https") {
+    ((QSslSocket *)http_socket)->
+      connectToHostEncrypted(serverUrl().host(),serverUrl().port(443));
+  }
+  else {
+    http_socket->connectToHost(serverUrl().host(),serverUrl().port(80));
+  }
+}
+
+
+void HttpFile::disconnectFromHostConnector()
+{
+}
+
+
+void HttpFile::connectedData()
+{
+  InitResponse();
+  SendHeader("GET "+serverMountpoint()+" HTTP/1.1");
+  SendHeader("Host: "+serverUrl().host()+":"+
+	     QString().sprintf("%u",serverUrl().port()));
+  SendHeader("Accept: */*");
+  SendHeader("User-Agent: glassplayer/"+QString(VERSION));
+  SendHeader("Connection: close");
+  if((!serverUsername().isEmpty())||(!serverPassword().isEmpty())) {
+    SendHeader("Authorization: basic "+
+	       Connector::base64Encode(serverUsername()+":"+
+				       serverPassword()));
+  }
+  if(http_position>0) {
+    SendHeader(QString().sprintf("Range: bytes=%lld-",http_position));
+  }
+  SendHeader("");
+}
+
+
+void HttpFile::readyReadData()
+{
+  //
+  // Take at most one window per pass. Anything more is left in the
+  // socket, whose buffer is also capped at the window, so the server
+  // is held off by TCP flow control; the next pass is made from the
+  // event loop once the codec has taken this one.
+  //
+  ReadWindow();
+  if((!http_finished)&&(http_socket!=NULL)&&
+     (http_socket->bytesAvailable()>0)) {
+    http_resume_timer->start(0);
+  }
+}
+
+
+void HttpFile::errorData(QAbstractSocket::SocketError err)
+{
+  //
+  // The socket can still be holding the last of the data
+  //
+  http_resume_timer->stop();
+  while((!http_finished)&&(http_socket->bytesAvailable()>0)) {
+    ReadWindow();
+  }
+  if(http_finished) {
+    return;
+  }
+  switch(err) {
+  case QAbstractSocket::HostNotFoundError:
+  case QAbstractSocket::SslHandshakeFailedError:
+    Log(LOG_ERR,Connector::socketErrorText(err));
+    exit(GLASS_EXIT_NETWORK_ERROR);
+
+  case QAbstractSocket::RemoteHostClosedError:
+    if((!http_header_active)&&(http_content_length<0)) {
+      Finish();  // No length given, so the close marks the end
+      return;
+    }
+    Retry(tr("connection closed before end of file"));
+    break;
+
+  default:
+    Retry(Connector::socketErrorText(err));
+    break;
+  }
+}
+
+
+void HttpFile::retryData()
+{
+  if(http_position>0) {
+    http_resumes++;
+  }
+  connectToServer();
+}
+
+
+void HttpFile::loadStats(QStringList *hdrs,QStringList *values,bool is_first)
+{
+  if(is_first) {
+    hdrs->push_back("Connector|Type");
+    values->push_back("HTTP File");
+
+    hdrs->push_back("Connector|Content Type");
+    values->push_back(contentType());
+
+    hdrs->push_back("Connector|Read Window");
+    values->push_back(QString().sprintf("%u",WindowSize()));
+  }
+
+  if(http_content_length>=0) {
+    hdrs->push_back("Connector|Content Length");
+    values->push_back(QString().sprintf("%lld",http_content_length));
+  }
+
+  hdrs->push_back("Connector|Bytes Received");
+  values->push_back(QString().sprintf("%lld",http_position));
+
+  hdrs->push_back("Connector|Resumes");
+  values->push_back(QString().sprintf("%u",http_resumes));
+}
+
+
+void HttpFile::InitResponse()
+{
+  http_header_active=true;
+  http_headers.reset();
+  http_result_code=0;
+  http_response_length=-1;
+  http_range_start=-1;
+  http_skip=0;
+  http_buffer.resize(0);
+}
+
+
+bool HttpFile::ProcessHeaders()
+{
+  //
+  // Feed the buffer through the header parser, returning true once the
+  // blank line that ends the headers has been seen, with the start of
+  // the body left in the buffer. A partial line is kept by the parser.
+  //
+  const char *p=http_buffer.constData();
+  int len=http_buffer.length();
+  int n;
+
+  while(len>0) {
+    switch(http_headers.next(p,len,&n)) {
+    case HeaderParser::HeaderLine:
+      ProcessHeader(QString::fromUtf8(http_headers.line(),
+				      http_headers.lineLength()));
+      break;
+
+    case HeaderParser::HeaderEnd:
+      http_header_active=false;
+      http_buffer.remove(0,p+n-http_buffer.constData());
+      return true;
+
+    case HeaderParser::NeedMore:
+      break;
+    }
+    p+=n;
+    len-=n;
+  }
+  http_buffer.resize(0);
+
+  return false;
+}
+
+
+void HttpFile::ProcessHeader(const QString &str)
+{
+  QStringList f0;
+
+  if(dumpHeaders()) {
+    fprintf(stderr,"==> %s\n",(const char *)str.toUtf8());
+  }
+  if(http_result_code==0) {
+    f0=str.split(" ",QString::SkipEmptyParts);
+    if(f0.size()<2) {
+      Log(LOG_ERR,"malformed response from server ["+str+"]");
+      exit(GLASS_EXIT_SERVER_ERROR);
+    }
+    http_result_code=f0[1].toInt();
+  }
+  else {
+    int colon=str.indexOf(":");
+    if(colon>0) {
+      QString hdr=str.left(colon).trimmed().toLower();
+      QString value=str.mid(colon+1).trimmed();
+      if(hdr=="content-length") {
+	http_response_length=value.toLongLong();
+      }
+      if(hdr=="content-range") {  // bytes <first>-<last>/<total>
+	f0=value.split(QRegExp("[ \\-/]"),QString::SkipEmptyParts);
+	if((f0.size()==4)&&(f0.at(0).toLower()=="bytes")) {
+	  http_range_start=f0.at(1).toLongLong();
+	  if(f0.at(3)!="*") {
+	    http_content_length=f0.at(3).toLongLong();
+	  }
+	}
+      }
+    }
+  }
+}
+
+
+void HttpFile::ReadWindow()
+{
+  int len=http_buffer.length();
+  qint64 avail=(qint64)WindowSize()-len;
+  qint64 n;
+
+  if(avail>http_socket->bytesAvailable()) {
+    avail=http_socket->bytesAvailable();
+  }
+  if(avail>0) {
+    http_buffer.resize(len+avail);
+    if((n=http_socket->read(http_buffer.data()+len,avail))<0) {
+      n=0;
+    }
+    http_buffer.resize(len+n);
+  }
+  if(http_header_active) {
+    if(!ProcessHeaders()) {
+      return;
+    }
+    StartBody();
+  }
+  ProcessBody();
+}
+
+
+void HttpFile::StartBody()
+{
+  switch(http_result_code) {
+  case 200:   // OK
+  case 203:   // Non-Authoritative Information
+    //
+    // The whole file again, so skip whatever has already been played
+    //
+    http_skip=http_position;
+    if(http_response_length>=0) {
+      http_content_length=http_response_length;
+    }
+    break;
+
+  case 206:   // Partial Content
+    if(http_range_start!=http_position) {
+      Log(LOG_ERR,tr("server returned the wrong byte range"));
+      exit(GLASS_EXIT_SERVER_ERROR);
+    }
+    break;
+
+  default:
+    Log(LOG_ERR,tr("server returned error")+
+	QString().sprintf(" [%d]",http_result_code));
+    exit(GLASS_EXIT_HTTP_ERROR);
+  }
+  http_retries=0;
+  if(!isConnected()) {
+    setConnected(true);
+  }
+}
+
+
+void HttpFile::ProcessBody()
+{
+  const char *p=http_buffer.constData();
+  qint64 len=http_buffer.length();
+  qint64 n;
+  bool is_last=false;
+
+  if(http_skip>0) {
+    n=len<http_skip?len:http_skip;
+    p+=n;
+    len-=n;
+    http_skip-=n;
+  }
+  if((http_content_length>=0)&&((http_position+len)>http_content_length)) {
+    len=http_content_length-http_position;
+  }
+  if(len>0) {
+    http_position+=len;
+    if((http_content_length>=0)&&(http_position>=http_content_length)) {
+      is_last=true;
+      http_finished=true;
+      http_socket->disconnect();
+    }
+    if((p==http_buffer.constData())&&(len==http_buffer.length())) {
+      emit dataReceived(http_buffer,is_last);
+    }
+    else {
+      emit dataReceived(QByteArray::fromRawData(p,len),is_last);
+    }
+  }
+  http_buffer.resize(0);
+}
+
+
+void HttpFile::Retry(const QString &reason)
+{
+  //
+  // Ask for the rest of the file, starting where we left off. A server
+  // that ignores the Range header sends the whole file again, and
+  // StartBody() skips the part that has already been played.
+  //
+  http_socket->disconnect();
+  http_resume_timer->stop();
+  if(++http_retries>HTTPFILE_MAX_RETRIES) {
+    if(http_position==0) {
+      Log(LOG_ERR,reason);
+      exit(GLASS_EXIT_NETWORK_ERROR);
+    }
+    Log(LOG_WARNING,reason+", "+tr("giving up"));
+    Finish();
+    return;
+  }
+  Log(LOG_WARNING,reason+", "+tr("attempting to resume")+
+      QString().sprintf(" [byte %lld]",http_position));
+  http_retry_timer->start(HTTPFILE_RETRY_INTERVAL);
+}
+
+
+void HttpFile::Finish()
+{
+  if(!http_finished) {
+    http_finished=true;
+    emit dataReceived(QByteArray(),true);
+  }
+}
+
+
+void HttpFile::SendHeader(const QString &str)
+{
+  if(dumpHeaders()) {
+    fprintf(stderr,"<== %s\n",(const char *)str.toUtf8());
+  }
+  http_socket->write((str+"\r\n").toUtf8(),str.length()+2);
+}
+
+
+void HttpFile::InitSocket()
+{
+  if(http_socket!=NULL) {
+    delete http_socket;
+  }
+  if(serverUrl().scheme().toLower()=="https") {
+    if(!QSslSocket::supportsSsl()) {
+      Log(LOG_ERR,tr("TLS support is not available"));
+      exit(GLASS_EXIT_NETWORK_ERROR);
+    }
+    QSslSocket *sock=new QSslSocket(this);
+    connect(sock,SIGNAL(encrypted()),this,SLOT(connectedData()));
+    http_socket=sock;
+  }
+  else {
+    http_socket=new QTcpSocket(this);
+    connect(http_socket,SIGNAL(connected()),this,SLOT(connectedData()));
+  }
+  http_socket->setReadBufferSize(WindowSize());
+  connect(http_socket,SIGNAL(readyRead()),this,SLOT(readyReadData()));
+  connect(http_socket,SIGNAL(error(QAbstractSocket::SocketError)),
+	  this,SLOT(errorData(QAbstractSocket::SocketError)));
+}
+
+
+unsigned HttpFile::WindowSize() const
+{
+  return readWindowSize()>0?readWindowSize():HTTPFILE_DEFAULT_READ_WINDOW;
+}
@@ -0,0 +1,89 @@
+// conn_httpfile.h
+//
+// Server connector for static files fetched over HTTP.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#ifndef CONN_HTTPFILE_H
+#define CONN_HTTPFILE_H
+
+#include <QByteArray>
+#include <QSslSocket>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "connector.h"
+#include "headerparser.h"
+
+#define HTTPFILE_DEFAULT_READ_WINDOW 262144
+#define HTTPFILE_RETRY_INTERVAL 2000
+#define HTTPFILE_MAX_RETRIES 5
+
+class HttpFile : public Connector
+{
+  Q_OBJECT;
+ public:
+  HttpFile(const QString &mimetype,QObject *parent=0);
+  ~HttpFile();
+  Connector::ServerType serverType() const;
+  void reset();
+  bool adoptConnection(QTcpSocket *sock,const QByteArray &data);
+
+ protected:
+  void connectToHostConnector();
+  void disconnectFromHostConnector();
+  void loadStats(QStringList *hdrs,QStringList *values,bool is_first);
+
+ private slots:
+  void connectedData();
+  void readyReadData();
+  void errorData(QAbstractSocket::SocketError err);
+  void retryData();
+
+ private:
+  void InitResponse();
+  void ReadWindow();
+  bool ProcessHeaders();
+  void ProcessHeader(const QString &str);
+  void StartBody();
+  void ProcessBody();
+  void Retry(const QString &reason);
+  void Finish();
+  void SendHeader(const QString &str);
+  void InitSocket();
+  unsigned WindowSize() const;
+  QTcpSocket *http_socket;
+  bool http_adopted;
+  QByteArray http_adopted_data;
+  QByteArray http_buffer;
+  bool http_header_active;
+  HeaderParser http_headers;
+  int http_result_code;
+  qint64 http_response_length;
+  qint64 http_range_start;
+  qint64 http_content_length;
+  qint64 http_position;
+  qint64 http_skip;
+  bool http_finished;
+  int http_retries;
+  unsigned http_resumes;
+  QTimer *http_retry_timer;
+  QTimer *http_resume_timer;
+};
+
+
+#endif  // CONN_HTTPFILE_H
@@ -18,6 +18,9 @@
 //   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 //
 
+#include <string.h>
+#include <time.h>
+
 #include <QByteArray>
 #include <QStringList>
 
@@ -27,15 +30,27 @@
 XCast::XCast(const QString &mimetype,QObject *parent)
   : Connector(mimetype,parent)
 {
-  xcast_header="";
+  xcast_buffer.reserve(XCAST_READ_BUFFER_SIZE);
+  xcast_min_chunk=XCAST_DEFAULT_MIN_CHUNK;
   xcast_header_active=false;
   xcast_result_code=0;
-  xcast_metadata_istate=0;
+  xcast_keep_alive=false;
+  xcast_content_length=-1;
+  xcast_body_skip=-1;
+  xcast_redirects=0;
+  xcast_chunked=false;
+  xcast_chunk_state=XCast::ChunkSize;
+  xcast_chunk_remaining=0;
+  xcast_chunk_extension=false;
+  xcast_chunk_line=0;
   xcast_metadata_interval=0;
-  xcast_metadata_counter=0;
+  xcast_icy.reset(0);
+  xcast_byte_counter=0;
+  xcast_chunks=0;
+  memset(&xcast_connect_time,0,sizeof(xcast_connect_time));
 
   xcast_socket=NULL;
-  InitSocket();
+  xcast_adopted=false;
 
   //
   // Watchdog Timer
@@ -44,12 +59,21 @@ XCast::XCast(const QString &mimetype,QObject *parent)
   xcast_watchdog_retry_timer->setSingleShot(true);
   connect(xcast_watchdog_retry_timer,SIGNAL(timeout()),
 	  this,SLOT(watchdogRetryData()));
+
+  //
+  // Flush Timer
+  //
+  xcast_flush_timer=new QTimer(this);
+  xcast_flush_timer->setSingleShot(true);
+  connect(xcast_flush_timer,SIGNAL(timeout()),this,SLOT(flushData()));
 }
 
 
 XCast::~XCast()
 {
-  delete xcast_socket;
+  if(xcast_socket!=NULL) {
+    delete xcast_socket;
+  }
 }
 
 
@@ -61,15 +85,63 @@ Connector::ServerType XCast::serverType() const
 
 void XCast::reset()
 {
-  xcast_socket->disconnect();
+  FlushBuffer();
+  Reconnect();
+}
+
+
+void XCast::Reconnect()
+{
+  xcast_flush_timer->stop();
+  if(xcast_socket!=NULL) {
+    xcast_socket->disconnect();
+  }
   setConnected(false);
   xcast_watchdog_retry_timer->start(XCAST_WATCHDOG_RETRY_INTERVAL);
 }
 
 
+bool XCast::adoptConnection(QTcpSocket *sock,const QByteArray &data)
+{
+  //
+  // Take over a connection that has already sent a request, along with
+  // whatever of the response has been read from it so far
+  //
+  if(xcast_socket!=NULL) {
+    delete xcast_socket;
+  }
+  xcast_socket=sock;
+  xcast_socket->setParent(this);
+  connect(xcast_socket,SIGNAL(readyRead()),this,SLOT(readyReadData()));
+  connect(xcast_socket,SIGNAL(error(QAbstractSocket::SocketError)),
+	  this,SLOT(errorData(QAbstractSocket::SocketError)));
+  xcast_adopted_data=data;
+  xcast_adopted=true;
+
+  return true;
+}
+
+
 void XCast::connectToHostConnector()
 {
-  xcast_socket->connectToHost(serverUrl().host(),serverUrl().port(80));
+  if(xcast_adopted) {
+    xcast_adopted=false;
+    StartConnection();
+    InitResponse();
+    xcast_buffer=xcast_adopted_data;
+    xcast_buffer.reserve(XCAST_READ_BUFFER_SIZE);
+    xcast_adopted_data.clear();
+    QTimer::singleShot(0,this,SLOT(readyReadData()));
+    return;
+  }
+  InitSocket();
+  if(serverUrl().scheme().toLower()=="https") {
+    ((QSslSocket *)xcast_socket)->
+      connectToHostEncrypted(serverUrl().host(),serverUrl().port(443));
+  }
+  else {
+    xcast_socket->connectToHost(serverUrl().host(),serverUrl().port(80));
+  }
 }
 
 
@@ -79,15 +151,49 @@ void XCast::disconnectFromHostConnector()
 
 
 void XCast::connectedData()
+{
+  StartConnection();
+  SendRequest();
+}
+
+
+void XCast::StartConnection()
+{
+  xcast_byte_counter=0;
+  xcast_chunks=0;
+  clock_gettime(CLOCK_MONOTONIC,&xcast_connect_time);
+  if(receiveBufferSize()>0) {
+    xcast_socket->
+      setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption,
+		      receiveBufferSize());
+  }
+}
+
+
+void XCast::InitResponse()
 {
   xcast_header_active=true;
+  xcast_headers.reset();
   xcast_result_code=0;
+  xcast_keep_alive=false;
+  xcast_content_length=-1;
+  xcast_body_skip=-1;
+  xcast_location="";
+  xcast_chunked=false;
+  xcast_chunk_state=XCast::ChunkSize;
+  xcast_chunk_remaining=0;
+  xcast_chunk_extension=false;
+  xcast_chunk_line=0;
   xcast_metadata_interval=0;
-  xcast_metadata_istate=0;
-  xcast_metadata_string="";
-  xcast_metadata_counter=0;
-  xcast_byte_counter=0;
+  xcast_icy.reset(0);
+  xcast_buffer.resize(0);
   xcast_is_shoutcast=false;
+}
+
+
+void XCast::SendRequest()
+{
+  InitResponse();
   if(postData().isEmpty()) {
     SendHeader("GET "+serverMountpoint()+" HTTP/1.1");
   }
@@ -95,12 +201,11 @@ void XCast::connectedData()
     SendHeader("POST "+serverMountpoint()+" HTTP/1.1");
   }
   SendHeader("Host: "+serverUrl().host()+":"+
-	     QString().sprintf("%u",serverUrl().port(80)));
+	     QString().sprintf("%u",serverUrl().port()));
   SendHeader(QString().sprintf("icy-metadata: %d",streamMetadataEnabled()));
   SendHeader("Accept: */*");
   SendHeader("User-Agent: glassplayer/"+QString(VERSION));
   SendHeader("Cache-control: no-cache");
-  SendHeader("Connection: close");
   if((!serverUsername().isEmpty())||(!serverPassword().isEmpty())) {
     SendHeader("Authorization: basic "+
 	       Connector::base64Encode(serverUsername()+":"+serverPassword()));
@@ -118,48 +223,182 @@ void XCast::connectedData()
 
 void XCast::readyReadData()
 {
-  QByteArray data;
-
-  while(xcast_socket->bytesAvailable()>0) {
-    data=xcast_socket->read(1024);
-    if(xcast_header_active) {   // Get headers
-      for(int i=0;i<data.length();i++) {
-	switch(0xFF&data.data()[i]) {
-	case 13:
-	  if(!xcast_header.isEmpty()) {
-	    ProcessHeader(xcast_header);
-	  }
-	  break;
-
-	case 10:
-	  if(xcast_header.isEmpty()) {
-	    xcast_header_active=false;
-	    if((xcast_result_code>=200)&&(xcast_result_code<300)) {
-	      setConnected(true);
-	      data=data.right(data.length()-i-1);
-	      ProcessFrames(data);
-	    }
-	    else {
-	      reset();
-	    }
-	    return;
-	  }
-	  xcast_header="";
-	  break;
+  qint64 avail;
+  qint64 n;
+  int len;
 
-	default:
-	  xcast_header+=data.data()[i];
-	  break;
-	}
+  //
+  // Take everything the socket has in one go, appending to whatever was
+  // held back last time
+  //
+  while((avail=xcast_socket->bytesAvailable())>0) {
+    len=xcast_buffer.length();
+    xcast_buffer.resize(len+avail);
+    if((n=xcast_socket->read(xcast_buffer.data()+len,avail))<0) {
+      n=0;
+    }
+    xcast_buffer.resize(len+n);
+    if(n==0) {
+      break;
+    }
+  }
+  if(xcast_body_skip>=0) {
+    SkipBody();
+    return;
+  }
+  if(xcast_header_active) {
+    if(!ProcessHeaders()) {
+      return;
+    }
+    if((xcast_result_code>=300)&&(xcast_result_code<400)) {
+      if(!xcast_location.isEmpty()) {
+	Redirect();
+	return;
       }
+      Log(LOG_ERR,tr("server returned")+
+	  QString().sprintf(" %d, ",xcast_result_code)+
+	  tr("but redirected URI is empty."));
     }
-    else {
-      ProcessFrames(data);
+    if((xcast_result_code<200)||(xcast_result_code>=300)) {
+      Reconnect();
+      return;
+    }
+    xcast_redirects=0;
+    setConnected(true);
+    xcast_icy.reset(xcast_metadata_interval);
+
+    //
+    // About one codec frame's worth, if we know the bitrate
+    //
+    xcast_min_chunk=minimumChunkSize();
+    if(xcast_min_chunk==0) {
+      xcast_min_chunk=XCAST_DEFAULT_MIN_CHUNK;
+      if(audioBitrate()>0) {
+	xcast_min_chunk=audioBitrate()*XCAST_AUTO_CHUNK_MSECS/8;
+      }
+    }
+  }
+
+  //
+  // Hold small reads back until there is enough to be worth a trip
+  // through the codec, but not for longer than the flush interval
+  //
+  if(xcast_buffer.length()>=xcast_min_chunk) {
+    FlushBuffer();
+  }
+  else {
+    if((!xcast_buffer.isEmpty())&&(!xcast_flush_timer->isActive())) {
+      xcast_flush_timer->start(XCAST_FLUSH_INTERVAL);
     }
   }
 }
 
 
+void XCast::FlushBuffer()
+{
+  xcast_flush_timer->stop();
+  if(xcast_header_active||(xcast_body_skip>=0)||xcast_buffer.isEmpty()) {
+    return;
+  }
+  if(xcast_chunked) {
+    ProcessChunks(xcast_buffer);
+  }
+  else {
+    ProcessFrames(xcast_buffer);
+  }
+  xcast_buffer.resize(0);
+}
+
+
+bool XCast::ProcessHeaders()
+{
+  //
+  // Feed the buffer through the header parser, returning true once the
+  // blank line that ends the headers has been seen, with the start of
+  // the body left in the buffer. A partial line is kept by the parser.
+  //
+  const char *p=xcast_buffer.constData();
+  int len=xcast_buffer.length();
+  int n;
+
+  while(len>0) {
+    switch(xcast_headers.next(p,len,&n)) {
+    case HeaderParser::HeaderLine:
+      ProcessHeader(QString::fromUtf8(xcast_headers.line(),
+				      xcast_headers.lineLength()));
+      break;
+
+    case HeaderParser::HeaderEnd:
+      xcast_header_active=false;
+      xcast_buffer.remove(0,p+n-xcast_buffer.constData());
+      return true;
+
+    case HeaderParser::NeedMore:
+      break;
+    }
+    p+=n;
+    len-=n;
+  }
+  xcast_buffer.resize(0);
+
+  return false;
+}
+
+
+void XCast::Redirect()
+{
+  QUrl url=serverUrl().resolved(QUrl(xcast_location));
+  bool reuse;
+
+  if(++xcast_redirects>XCAST_MAX_REDIRECTS) {
+    Log(LOG_ERR,tr("too many redirects"));
+    exit(GLASS_EXIT_HTTP_ERROR);
+  }
+  if(url.path().isEmpty()) {
+    url.setPath("/");
+  }
+  if(global_log_verbose) {
+    Log(LOG_INFO,tr("redirecting to")+" "+url.toString());
+  }
+
+  //
+  // Stay on this connection if the server is keeping it open, the end of
+  // the redirect body can be found and the new location is on the same
+  // origin; otherwise start over with a new one.
+  //
+  reuse=xcast_keep_alive&&(!xcast_chunked)&&(xcast_content_length>=0)&&
+    (url.scheme().toLower()==serverUrl().scheme().toLower())&&
+    (url.host().toLower()==serverUrl().host().toLower())&&
+    (url.port(url.scheme().toLower()=="https"?443:80)==serverUrl().port());
+  setServerUrl(url);
+  if(reuse) {
+    xcast_body_skip=xcast_content_length;
+    SkipBody();
+  }
+  else {
+    xcast_socket->disconnect();
+    xcast_watchdog_retry_timer->start(0);
+  }
+}
+
+
+void XCast::SkipBody()
+{
+  //
+  // Discard the body of a redirect, then ask again on the same connection
+  //
+  int n=xcast_buffer.length();
+
+  if(n>xcast_body_skip) {
+    n=xcast_body_skip;
+  }
+  xcast_buffer.remove(0,n);
+  if((xcast_body_skip-=n)==0) {
+    SendRequest();
+  }
+}
+
+
 void XCast::errorData(QAbstractSocket::SocketError err)
 {
   switch(err) {
@@ -167,7 +406,13 @@ void XCast::errorData(QAbstractSocket::SocketError err)
     Log(LOG_ERR,"glassplayer: host not found\n");
     exit(GLASS_EXIT_HTTP_ERROR);
 
+  case QAbstractSocket::SslHandshakeFailedError:
+    Log(LOG_ERR,Connector::socketErrorText(err)+": "+
+	xcast_socket->errorString());
+    exit(GLASS_EXIT_NETWORK_ERROR);
+
   default:
+    FlushBuffer();
     setConnected(false);
     xcast_watchdog_retry_timer->start(XCAST_WATCHDOG_RETRY_INTERVAL);
     Log(LOG_WARNING,tr("server connection lost")+
@@ -195,36 +440,203 @@ void XCast::loadStats(QStringList *hdrs,QStringList *values,bool is_first)
 
     hdrs->push_back("Connector|Content Type");
     values->push_back(xcast_content_type);
+
+    hdrs->push_back("Connector|Transport");
+    if(serverUrl().scheme().toLower()=="https") {
+      values->push_back("TLS");
+    }
+    else {
+      values->push_back("TCP");
+    }
+
+    hdrs->push_back("Connector|Transfer Encoding");
+    if(xcast_chunked) {
+      values->push_back("chunked");
+    }
+    else {
+      values->push_back("identity");
+    }
+
+    hdrs->push_back("Connector|Minimum Chunk Size");
+    values->push_back(QString().sprintf("%d",xcast_min_chunk));
+  }
+
+  if(xcast_chunks>0) {
+    struct timespec now;
+    double secs;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    secs=(double)(now.tv_sec-xcast_connect_time.tv_sec)+
+      (double)(now.tv_nsec-xcast_connect_time.tv_nsec)/1e9;
+
+    hdrs->push_back("Connector|Average Chunk Size");
+    values->push_back(QString().sprintf("%lu",
+					xcast_byte_counter/xcast_chunks));
+
+    if(secs>0.0) {
+      hdrs->push_back("Connector|Dispatch Rate");
+      values->push_back(QString().sprintf("%.1lf",(double)xcast_chunks/secs));
+    }
   }
 }
 
 
 void XCast::watchdogRetryData()
 {
-  InitSocket();
   connectToServer();
 }
 
 
-void XCast::ProcessFrames(QByteArray &data)
+void XCast::flushData()
+{
+  FlushBuffer();
+}
+
+
+void XCast::ProcessChunks(const QByteArray &data)
 {
-  int md_start=0;
-  int md_len=0;
-
-  if(xcast_metadata_interval>0) {
-    if(xcast_metadata_counter+data.length()>xcast_metadata_interval) {
-      md_start=xcast_metadata_interval-xcast_metadata_counter;
-      md_len=0xFF&data[md_start]*16;
-      ProcessMetadata(data.mid(md_start+1,md_len));
-      xcast_metadata_counter=data.size()-(md_start+md_len+1);
-      data.remove(md_start,md_len+1);
+  //
+  // Strip 'Transfer-Encoding: chunked' framing. Each chunk is a line
+  // giving its length in hex, that many bytes of body and a CRLF; a zero
+  // length chunk and any trailer lines end the body. Like the ICY
+  // demultiplexer, this picks up where the last read left off, and body
+  // spans go on as views of the read buffer.
+  //
+  const char *p=data.constData();
+  const char *end=p+data.length();
+  qint64 n;
+  int d;
+
+  while(p<end) {
+    switch(xcast_chunk_state) {
+    case XCast::ChunkSize:
+      if(*p=='\n') {
+	xcast_chunk_extension=false;
+	if(xcast_chunk_remaining==0) {
+	  xcast_chunk_line=0;
+	  xcast_chunk_state=XCast::ChunkTrailer;
+	}
+	else {
+	  xcast_chunk_state=XCast::ChunkData;
+	}
+      }
+      else {
+	if(!xcast_chunk_extension) {
+	  d=-1;
+	  if((*p>='0')&&(*p<='9')) {
+	    d=*p-'0';
+	  }
+	  if((*p>='a')&&(*p<='f')) {
+	    d=*p-'a'+10;
+	  }
+	  if((*p>='A')&&(*p<='F')) {
+	    d=*p-'A'+10;
+	  }
+	  if(d>=0) {
+	    if(xcast_chunk_remaining>=(1ll<<32)) {
+	      Log(LOG_WARNING,tr("malformed chunk length from server"));
+	      Reconnect();
+	      return;
+	    }
+	    xcast_chunk_remaining=16*xcast_chunk_remaining+d;
+	  }
+	  else {
+	    if(*p!='\r') {  // Chunk extensions, ignored
+	      xcast_chunk_extension=true;
+	    }
+	  }
+	}
+      }
+      p++;
+      break;
+
+    case XCast::ChunkData:
+      n=end-p;
+      if(n>xcast_chunk_remaining) {
+	n=xcast_chunk_remaining;
+      }
+      ProcessFrames(QByteArray::fromRawData(p,n));
+      p+=n;
+      if((xcast_chunk_remaining-=n)==0) {
+	xcast_chunk_state=XCast::ChunkDataEnd;
+      }
+      break;
+
+    case XCast::ChunkDataEnd:
+      if(*p=='\n') {
+	xcast_chunk_state=XCast::ChunkSize;
+      }
+      p++;
+      break;
+
+    case XCast::ChunkTrailer:
+      if(*p=='\n') {
+	if(xcast_chunk_line==0) {
+	  Log(LOG_WARNING,tr("stream ended")+", "+tr("attempting reconnect"));
+	  Reconnect();
+	  return;
+	}
+	xcast_chunk_line=0;
+      }
+      else {
+	if(*p!='\r') {
+	  xcast_chunk_line++;
+	}
+      }
+      p++;
+      break;
     }
-    else {
-      xcast_metadata_counter+=data.length();
+  }
+}
+
+
+void XCast::ProcessFrames(const QByteArray &data)
+{
+  //
+  // Split the ICY stream into audio and metadata, passing the audio on
+  // as views of the read buffer
+  //
+  const char *p=data.constData();
+  int len=data.length();
+  int n;
+
+  while(len>0) {
+    switch(xcast_icy.next(p,len,&n)) {
+    case IcyDemux::AudioSpan:
+      EmitAudio(data,p-data.constData(),n);
+      break;
+
+    case IcyDemux::MetadataBlock:
+      ProcessMetadata(QByteArray::fromRawData(xcast_icy.metadata(),
+					      xcast_icy.metadataLength()));
+      break;
+
+    case IcyDemux::NoSpan:
+      break;
     }
+    p+=n;
+    len-=n;
+  }
+}
+
+
+void XCast::EmitAudio(const QByteArray &data,int offset,int len)
+{
+  //
+  // Pass audio on without copying it; a span of a larger read goes out
+  // as a view of the read buffer
+  //
+  if(len<=0) {
+    return;
+  }
+  xcast_byte_counter+=len;
+  xcast_chunks++;
+  if((offset==0)&&(len==data.length())) {
+    emit dataReceived(data,false);
+  }
+  else {
+    emit dataReceived(QByteArray::fromRawData(data.constData()+offset,len),
+		      false);
   }
-  xcast_byte_counter+=data.length();
-  emit dataReceived(data,false);
 }
 
 
@@ -251,17 +663,18 @@ void XCast::ProcessHeader(const QString &str)
       exit(GLASS_EXIT_SERVER_ERROR);
     }
     xcast_is_shoutcast=f0[0]=="ICY";
+    xcast_keep_alive=f0[0]=="HTTP/1.1";
     xcast_result_code=f0[1].toInt();
-    if((xcast_result_code<200)||(xcast_result_code>=300)) {
+    if((xcast_result_code<200)||(xcast_result_code>=400)) {
       f0.erase(f0.begin());
       Log(LOG_ERR,"server returned error ["+f0.join(" ")+"]");
     }
   }
   else {
-    f0=str.split(":");
-    if(f0.size()==2) {
-      QString hdr=f0[0].trimmed().toLower();
-      QString value=f0[1].trimmed();
+    int colon=str.indexOf(":");
+    if(colon>0) {
+      QString hdr=str.left(colon).trimmed().toLower();
+      QString value=str.mid(colon+1).trimmed();
       if(hdr=="content-type") {
 	xcast_content_type=value;
 	for(int i=0;i<Codec::TypeLast;i++) {
@@ -273,6 +686,23 @@ void XCast::ProcessHeader(const QString &str)
       if(hdr=="server") {
 	xcast_server=value;
       }
+      if(hdr=="connection") {
+	if(value.toLower()=="close") {
+	  xcast_keep_alive=false;
+	}
+	if(value.toLower()=="keep-alive") {
+	  xcast_keep_alive=true;
+	}
+      }
+      if(hdr=="content-length") {
+	xcast_content_length=value.toLongLong();
+      }
+      if(hdr=="location") {
+	xcast_location=value;
+      }
+      if(hdr=="transfer-encoding") {
+	xcast_chunked=value.toLower().contains("chunked");
+      }
       if(hdr=="icy-br") {
 	setAudioBitrate(value.toInt());
       }
@@ -314,8 +744,19 @@ void XCast::InitSocket()
   if(xcast_socket!=NULL) {
     delete xcast_socket;
   }
-  xcast_socket=new QTcpSocket(this);
-  connect(xcast_socket,SIGNAL(connected()),this,SLOT(connectedData()));
+  if(serverUrl().scheme().toLower()=="https") {
+    if(!QSslSocket::supportsSsl()) {
+      Log(LOG_ERR,tr("TLS support is not available"));
+      exit(GLASS_EXIT_NETWORK_ERROR);
+    }
+    QSslSocket *sock=new QSslSocket(this);
+    connect(sock,SIGNAL(encrypted()),this,SLOT(connectedData()));
+    xcast_socket=sock;
+  }
+  else {
+    xcast_socket=new QTcpSocket(this);
+    connect(xcast_socket,SIGNAL(connected()),this,SLOT(connectedData()));
+  }
   connect(xcast_socket,SIGNAL(readyRead()),this,SLOT(readyReadData()));
   connect(xcast_socket,SIGNAL(error(QAbstractSocket::SocketError)),
 	  this,SLOT(errorData(QAbstractSocket::SocketError)));
@@ -21,23 +21,35 @@
 #ifndef CONN_XCAST_H
 #define CONN_XCAST_H
 
+#include <time.h>
+
 #include <QByteArray>
+#include <QSslSocket>
 #include <QTcpSocket>
 #include <QTimer>
 
 #include "connector.h"
+#include "headerparser.h"
+#include "icydemux.h"
 #include "metaevent.h"
 
 #define XCAST_WATCHDOG_RETRY_INTERVAL 5000
+#define XCAST_READ_BUFFER_SIZE 65536
+#define XCAST_AUTO_CHUNK_MSECS 26
+#define XCAST_DEFAULT_MIN_CHUNK 1024
+#define XCAST_FLUSH_INTERVAL 100
+#define XCAST_MAX_REDIRECTS 10
 
 class XCast : public Connector
 {
   Q_OBJECT;
  public:
+  enum ChunkState {ChunkSize=0,ChunkData=1,ChunkDataEnd=2,ChunkTrailer=3};
   XCast(const QString &mimetype,QObject *parent=0);
   ~XCast();
   Connector::ServerType serverType() const;
   void reset();
+  bool adoptConnection(QTcpSocket *sock,const QByteArray &data);
 
  protected:
   void connectToHostConnector();
@@ -49,24 +61,49 @@ class XCast : public Connector
   void readyReadData();
   void errorData(QAbstractSocket::SocketError err);
   void watchdogRetryData();
+  void flushData();
 
  private:
-  void ProcessFrames(QByteArray &data);
+  void StartConnection();
+  void InitResponse();
+  void SendRequest();
+  bool ProcessHeaders();
+  void Redirect();
+  void SkipBody();
+  void FlushBuffer();
+  void Reconnect();
+  void ProcessChunks(const QByteArray &data);
+  void ProcessFrames(const QByteArray &data);
+  void EmitAudio(const QByteArray &data,int offset,int len);
   void SendHeader(const QString &str);
   void ProcessHeader(const QString &str);
   void ProcessMetadata(const QByteArray &mdata);
   void InitSocket();
-  QByteArray xcast_header;
+  QByteArray xcast_buffer;
+  int xcast_min_chunk;
   bool xcast_header_active;
+  HeaderParser xcast_headers;
   QTcpSocket *xcast_socket;
+  bool xcast_adopted;
+  QByteArray xcast_adopted_data;
   int xcast_result_code;
+  bool xcast_keep_alive;
+  qint64 xcast_content_length;
+  qint64 xcast_body_skip;
+  QString xcast_location;
+  int xcast_redirects;
+  bool xcast_chunked;
+  ChunkState xcast_chunk_state;
+  qint64 xcast_chunk_remaining;
+  bool xcast_chunk_extension;
+  int xcast_chunk_line;
   int xcast_metadata_interval;
-  int xcast_metadata_istate;
-  QString xcast_metadata_backstore;
-  QString xcast_metadata_string;
-  int xcast_metadata_counter;
+  IcyDemux xcast_icy;
   QTimer *xcast_watchdog_retry_timer;
+  QTimer *xcast_flush_timer;
   uint64_t xcast_byte_counter;
+  uint64_t xcast_chunks;
+  struct timespec xcast_connect_time;
   QString xcast_server;
   QString xcast_content_type;
   bool xcast_is_shoutcast;
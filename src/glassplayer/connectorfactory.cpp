@@ -20,6 +20,7 @@
 
 #include "conn_file.h"
 #include "conn_hls.h"
+#include "conn_httpfile.h"
 #include "conn_siggen.h"
 #include "conn_xcast.h"
 #include "connectorfactory.h"
@@ -46,6 +47,10 @@ Connector *ConnectorFactory(Connector::ServerType type,const QString &mimetype,
     conn=new SigGen(mimetype,parent);
     break;
 
+  case Connector::HttpFileServer:
+    conn=new HttpFile(mimetype,parent);
+    break;
+
   case Connector::LastServer:
     break;
   }
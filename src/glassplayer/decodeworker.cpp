@@ -0,0 +1,271 @@
+// decodeworker.cpp
+//
+// Run a codec on a dedicated decode thread.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#include <errno.h>
+#include <string.h>
+
+#include <QMetaType>
+
+#include "decodeworker.h"
+#include "logging.h"
+
+void *DecodeWorkerCallback(void *ptr)
+{
+  DecodeWorker *worker=(DecodeWorker *)ptr;
+  unsigned slot;
+
+  while(1==1) {
+    while(sem_wait(&worker->decode_data_sem)!=0) {
+      if(errno!=EINTR) {
+	return NULL;
+      }
+    }
+    if(worker->decode_stopping) {
+      return NULL;
+    }
+
+    //
+    // Dispatch the next queued entry to the codec. Metadata entries travel
+    // through the same queue as the bitstream so that the codec sees them
+    // in exactly the order in which the connector generated them.
+    //
+    slot=worker->decode_read_ptr%DECODE_QUEUE_SIZE;
+    if(worker->decode_meta_events[slot]!=NULL) {
+      worker->decode_codec->
+	processMetadata(worker->decode_meta_bytes[slot],
+			worker->decode_meta_events[slot]);
+      delete worker->decode_meta_events[slot];
+      worker->decode_meta_events[slot]=NULL;
+    }
+    else {
+      worker->decode_codec->processBitstream(worker->decode_data[slot],
+					     worker->decode_is_last[slot]);
+      worker->decode_data[slot].clear();
+    }
+    worker->decode_read_ptr++;
+    sem_post(&worker->decode_space_sem);
+  }
+
+  return NULL;
+}
+
+
+DecodeWorker::DecodeWorker(Codec *codec,QObject *parent)
+  : QObject(parent)
+{
+  decode_codec=codec;
+  decode_codec->setThreaded(true);
+  decode_write_ptr=0;
+  decode_read_ptr=0;
+  decode_running=false;
+  decode_stopping=false;
+  decode_queue_peak=0;
+  for(unsigned i=0;i<DECODE_QUEUE_SIZE;i++) {
+    decode_is_last[i]=false;
+    decode_meta_bytes[i]=0;
+    decode_meta_events[i]=NULL;
+  }
+  sem_init(&decode_data_sem,0,0);
+  sem_init(&decode_space_sem,0,DECODE_QUEUE_SIZE);
+  pthread_mutex_init(&decode_meta_mutex,NULL);
+
+  //
+  // Signals crossing from the decode thread to the main loop travel
+  // as queued events, so their argument types must be registered.
+  //
+  qRegisterMetaType<uint64_t>("uint64_t");
+  qRegisterMetaType<Ringbuffer *>("Ringbuffer *");
+  qRegisterMetaType<MetaEvent *>("MetaEvent *");
+
+  //
+  // The codec deletes its MetaEvent as soon as the signal returns, so
+  // grab a copy while still on the decode thread.
+  //
+  connect(decode_codec,SIGNAL(metadataReceived(uint64_t,MetaEvent *)),
+	  this,SLOT(codecMetadataData(uint64_t,MetaEvent *)),
+	  Qt::DirectConnection);
+}
+
+
+DecodeWorker::~DecodeWorker()
+{
+  stop();
+  for(unsigned i=0;i<DECODE_QUEUE_SIZE;i++) {
+    if(decode_meta_events[i]!=NULL) {
+      delete decode_meta_events[i];
+    }
+  }
+  while(decode_meta_ready.size()>0) {
+    delete decode_meta_ready.front();
+    decode_meta_ready.pop();
+  }
+  pthread_mutex_destroy(&decode_meta_mutex);
+  sem_destroy(&decode_space_sem);
+  sem_destroy(&decode_data_sem);
+}
+
+
+Codec *DecodeWorker::codec() const
+{
+  return decode_codec;
+}
+
+
+bool DecodeWorker::start(QString *err)
+{
+  pthread_attr_t pthread_attr;
+  int perr;
+
+  decode_stopping=false;
+  pthread_attr_init(&pthread_attr);
+  if((perr=pthread_create(&decode_pthread,&pthread_attr,DecodeWorkerCallback,
+			  this))!=0) {
+    *err=tr("unable to start decode thread")+" ["+strerror(perr)+"]";
+    pthread_attr_destroy(&pthread_attr);
+    return false;
+  }
+  pthread_attr_destroy(&pthread_attr);
+  decode_running=true;
+  if(global_log_verbose) {
+    Log(LOG_INFO,"decoding on a dedicated thread");
+  }
+
+  return true;
+}
+
+
+void DecodeWorker::stop()
+{
+  if(decode_running) {
+    decode_stopping=true;
+    decode_codec->abortWrites();
+    sem_post(&decode_data_sem);
+    pthread_join(decode_pthread,NULL);
+    decode_running=false;
+  }
+}
+
+
+void DecodeWorker::getStats(QStringList *hdrs,QStringList *values,
+			    bool is_first)
+{
+  int depth=0;
+
+  sem_getvalue(&decode_data_sem,&depth);
+  if(depth<0) {
+    depth=0;
+  }
+  hdrs->push_back("Codec|Decode Queue Depth");
+  values->push_back(QString().sprintf("%d",depth));
+
+  hdrs->push_back("Codec|Decode Queue Peak");
+  values->push_back(QString().sprintf("%u",decode_queue_peak));
+}
+
+
+void DecodeWorker::processBitstream(const QByteArray &data,bool is_last)
+{
+  PushEntry(data,is_last,0,NULL);
+}
+
+
+void DecodeWorker::processMetadata(uint64_t bytes,MetaEvent *e)
+{
+  PushEntry(QByteArray(),false,bytes,new MetaEvent(*e));
+}
+
+
+void DecodeWorker::codecMetadataData(uint64_t frames,MetaEvent *e)
+{
+  //
+  // Called on the decode thread
+  //
+  pthread_mutex_lock(&decode_meta_mutex);
+  decode_meta_frames.push(frames);
+  decode_meta_ready.push(new MetaEvent(*e));
+  pthread_mutex_unlock(&decode_meta_mutex);
+  QMetaObject::invokeMethod(this,"metadataReadyData",Qt::QueuedConnection);
+}
+
+
+void DecodeWorker::metadataReadyData()
+{
+  uint64_t frames;
+  MetaEvent *e=NULL;
+
+  pthread_mutex_lock(&decode_meta_mutex);
+  while(decode_meta_ready.size()>0) {
+    frames=decode_meta_frames.front();
+    e=decode_meta_ready.front();
+    decode_meta_frames.pop();
+    decode_meta_ready.pop();
+    pthread_mutex_unlock(&decode_meta_mutex);
+    emit metadataReceived(frames,e);
+    delete e;
+    pthread_mutex_lock(&decode_meta_mutex);
+  }
+  pthread_mutex_unlock(&decode_meta_mutex);
+}
+
+
+void DecodeWorker::PushEntry(const QByteArray &data,bool is_last,
+			     uint64_t bytes,MetaEvent *e)
+{
+  unsigned slot;
+  int depth=0;
+
+  if(!decode_running) {
+    if(e!=NULL) {
+      delete e;
+    }
+    return;
+  }
+
+  //
+  // Block the producer while the queue is full; this gives the same
+  // back-pressure toward the connector as decoding in-line would.
+  //
+  while(sem_wait(&decode_space_sem)!=0) {
+    if(errno!=EINTR) {
+      if(e!=NULL) {
+	delete e;
+      }
+      return;
+    }
+  }
+  slot=decode_write_ptr%DECODE_QUEUE_SIZE;
+
+  //
+  // The connector may hand us a QByteArray::fromRawData() view of its
+  // read buffer, or one whose storage it goes on to reuse, so always
+  // take a copy of our own before it crosses to the decode thread
+  //
+  decode_data[slot]=QByteArray(data.constData(),data.length());
+  decode_is_last[slot]=is_last;
+  decode_meta_bytes[slot]=bytes;
+  decode_meta_events[slot]=e;
+  decode_write_ptr++;
+  sem_post(&decode_data_sem);
+
+  sem_getvalue(&decode_data_sem,&depth);
+  if(depth>(int)decode_queue_peak) {
+    decode_queue_peak=depth;
+  }
+}
@@ -0,0 +1,84 @@
+// decodeworker.h
+//
+// Run a codec on a dedicated decode thread.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#ifndef DECODEWORKER_H
+#define DECODEWORKER_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+
+#include <queue>
+
+#include <QByteArray>
+#include <QObject>
+#include <QStringList>
+
+#include "codec.h"
+#include "metaevent.h"
+
+#define DECODE_QUEUE_SIZE 256
+
+class DecodeWorker : public QObject
+{
+  Q_OBJECT;
+ public:
+  DecodeWorker(Codec *codec,QObject *parent=0);
+  ~DecodeWorker();
+  Codec *codec() const;
+  bool start(QString *err);
+  void stop();
+  void getStats(QStringList *hdrs,QStringList *values,bool is_first);
+
+ public slots:
+  void processBitstream(const QByteArray &data,bool is_last);
+  void processMetadata(uint64_t bytes,MetaEvent *e);
+
+ signals:
+  void metadataReceived(uint64_t frames,MetaEvent *e);
+
+ private slots:
+  void codecMetadataData(uint64_t frames,MetaEvent *e);
+  void metadataReadyData();
+
+ private:
+  void PushEntry(const QByteArray &data,bool is_last,uint64_t bytes,
+		 MetaEvent *e);
+  Codec *decode_codec;
+  QByteArray decode_data[DECODE_QUEUE_SIZE];
+  bool decode_is_last[DECODE_QUEUE_SIZE];
+  uint64_t decode_meta_bytes[DECODE_QUEUE_SIZE];
+  MetaEvent *decode_meta_events[DECODE_QUEUE_SIZE];
+  unsigned decode_write_ptr;
+  unsigned decode_read_ptr;
+  sem_t decode_data_sem;
+  sem_t decode_space_sem;
+  pthread_t decode_pthread;
+  bool decode_running;
+  volatile bool decode_stopping;
+  unsigned decode_queue_peak;
+  pthread_mutex_t decode_meta_mutex;
+  std::queue<uint64_t> decode_meta_frames;
+  std::queue<MetaEvent *> decode_meta_ready;
+  friend void *DecodeWorkerCallback(void *ptr);
+};
+
+
+#endif  // DECODEWORKER_H
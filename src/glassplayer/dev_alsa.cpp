@@ -18,6 +18,10 @@
 //   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 //
 
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+
 #include <samplerate.h>
 
 #include "dev_alsa.h"
@@ -26,204 +30,7 @@
 void *AlsaCallback(void *ptr)
 {
 #ifdef ALSA
-  static DevAlsa *dev=NULL;
-  static float pcm_s1[ALSA_MAX_CARD_BUFFER];
-  static float *pcm_s2;
-  static float *pcm_s3;
-  static int16_t pcm16[ALSA_MAX_CARD_BUFFER];
-  static int32_t pcm32[ALSA_MAX_CARD_BUFFER];
-  static int n;
-  static SRC_STATE *src=NULL;
-  static SRC_DATA data;
-  static int err;
-  static unsigned ring_frames=0;
-  static unsigned count=0;
-  static bool show_xrun=false;
-  static double pll_setpoint_ratio;
-  static float lvls[MAX_AUDIO_CHANNELS];
-  static unsigned i;
-
-  dev=(DevAlsa *)ptr;
-  src=NULL;
-  pll_setpoint_ratio=1.0;
-  dev->alsa_pll_setpoint_frames=0;
-  dev->alsa_pll_offset=0.0;
-  ring_frames=0;
-  count=0;
-  show_xrun=false;
-  dev->alsa_play_position=0;
-
-  //
-  // Initialize sample rate converter
-  //
-  pcm_s2=new float[262144];
-  memset(&data,0,sizeof(data));
-  data.data_in=pcm_s1;
-  data.data_out=pcm_s2;
-  data.output_frames=262144/dev->alsa_channels;
-  pll_setpoint_ratio=
-    (double)dev->alsa_samplerate/(double)dev->codec()->samplerate();
-  data.src_ratio=pll_setpoint_ratio;
-  if((src=src_new(SRC_LINEAR,dev->codec()->channels(),&err))==NULL) {
-    fprintf(stderr,"SRC initialization error [%s]\n",src_strerror(err));
-    exit(GLASS_EXIT_SRC_ERROR);
-  }
-
-  //
-  // Initialize channel mixdown buffer
-  //
-  if(dev->codec()->channels()==dev->alsa_channels) {
-    pcm_s3=pcm_s2;
-  }
-  else {
-    pcm_s3=new float[32768];
-  }
-
-  //
-  // Wait for PCM buffer to fill
-  //
-  while((!dev->alsa_stopping)&&(!dev->codec()->ring()->isFinished())&&
-	(dev->codec()->ring()->readSpace()<2*dev->codec()->samplerate())) {
-    usleep(36);
-  }
-
-  //
-  // All the ringbuffer to stabilize
-  //
-  while(count<PLL_SETTLE_INTERVAL) {  // Allow ringbuffer to stabilize
-    if((ring_frames=dev->codec()->ring()->readSpace())>dev->alsa_pll_setpoint_frames) {
-      dev->alsa_pll_setpoint_frames=ring_frames;
-    }
-    dev->alsa_pll_setpoint_frames=ring_frames;
-    count++;
-  }
-
-  //
-  // Apply the pregap
-  //
-  unsigned pregap=dev->pregap();
-  switch(dev->alsa_format) {
-  case AudioDevice::S16_LE:
-    memset(pcm16,0,ALSA_MAX_CARD_BUFFER*sizeof(int16_t));
-    for(i=0;i<pregap;i++) {
-      snd_pcm_writei(dev->alsa_pcm,pcm16,dev->alsa_samplerate/1000);
-    }
-    break;
-
-  case AudioDevice::S32_LE:
-    memset(pcm32,0,ALSA_MAX_CARD_BUFFER*sizeof(int32_t));
-    for(i=0;i<pregap;i++) {
-      snd_pcm_writei(dev->alsa_pcm,pcm32,dev->alsa_samplerate/1000);
-    }
-    break;
-
-  case AudioDevice::FLOAT:
-    break;
-
-  case AudioDevice::LastFormat:
-    break;
-  }
-
-
-  while((!dev->alsa_stopping)&&(dev->codec()->ring()->readSpace()>0)) {
-    ring_frames=dev->codec()->ring()->readSpace();
-    if(ring_frames>dev->alsa_pll_setpoint_frames) {
-      if(dev->alsa_pll_offset>(-PLL_CORRECTION_LIMIT)) {
-	dev->alsa_pll_offset-=PLL_CORRECTION;
-      }
-    }
-    else {
-      if(dev->alsa_pll_offset<(PLL_CORRECTION_LIMIT)) {
-	dev->alsa_pll_offset+=PLL_CORRECTION;
-      }
-    }
-    data.src_ratio=pll_setpoint_ratio+dev->alsa_pll_offset;
-    src_set_ratio(src,data.src_ratio);
-    if(snd_pcm_state(dev->alsa_pcm)!=SND_PCM_STATE_RUNNING) {
-      if(show_xrun) {
-	fprintf(stderr,"*** XRUN ***\n");
-	snd_pcm_drop(dev->alsa_pcm);
-	snd_pcm_prepare(dev->alsa_pcm);
-	show_xrun=false;
-      }
-    }
-    else {
-      show_xrun=!dev->codec()->ring()->isFinished();
-    }
-    if((n=dev->codec()->ring()->
-	read(pcm_s1,dev->alsa_buffer_size/(dev->alsa_period_quantity*2)))>0) {
-      if(src!=NULL) {
-	data.input_frames=n;
-	dev->alsa_play_position+=n;
-	if((err=src_process(src,&data))<0) {
-	  fprintf(stderr,"SRC processing error [%s]\n",src_strerror(err));
-	  exit(GLASS_EXIT_SRC_ERROR);
-	}
-	n=data.output_frames_gen;
-      }
-      if(dev->codec()->channels()!=dev->alsa_channels) {
-	dev->remixChannels(pcm_s3,dev->alsa_channels,
-			   pcm_s2,dev->codec()->channels(),n);
-      }
-      switch(dev->alsa_format) {
-      case AudioDevice::S16_LE:
-	memset(pcm16,0,ALSA_MAX_CARD_BUFFER*sizeof(int16_t));
-	dev->convertFromFloat(pcm16,pcm_s3,n,dev->alsa_channels);
-
-	//
-	// Work around an ALSA bug that appends garbage to the end of
-	// the final PCM block
-	//
-	if(dev->codec()->ring()->readSpace()==0) {
-	  n=dev->alsa_buffer_size;
-	}
-
-	snd_pcm_writei(dev->alsa_pcm,pcm16,n);
-	break;
-
-      case AudioDevice::S32_LE:
-	memset(pcm32,0,ALSA_MAX_CARD_BUFFER*sizeof(int32_t));
-	dev->convertFromFloat(pcm32,pcm_s3,n,dev->alsa_channels);
-
-	//
-	// Work around an ALSA bug that appends garbage to the end of
-	// the final PCM block
-	//
-	if(dev->codec()->ring()->readSpace()==0) {
-	  n=dev->alsa_buffer_size;
-	}
-
-	snd_pcm_writei(dev->alsa_pcm,pcm32,n);
-	break;
-
-      case AudioDevice::FLOAT:
-	snd_pcm_writei(dev->alsa_pcm,pcm_s3,n);
-	break;
-
-      case AudioDevice::LastFormat:
-	break;
-      }
-      dev->peakLevels(lvls,pcm_s3,n,dev->codec()->channels());
-      for(i=0;i<dev->codec()->channels();i++) {
-	dev->alsa_meter_avg[i]->addValue(lvls[i]);
-      }
-      dev->setMeterLevels(lvls);
-    }
-  }
-
-  //
-  // Shutdown
-  //
-  snd_pcm_drain(dev->alsa_pcm);
-  snd_pcm_close(dev->alsa_pcm);
-  if((pcm_s3!=pcm_s2)&&(pcm_s3!=pcm_s1)) {
-    delete pcm_s3;
-  }
-  pcm_s3=NULL;
-  if(pcm_s2!=pcm_s1) {
-    delete pcm_s2;
-  }
-  pcm_s2=NULL;
+  ((DevAlsa *)ptr)->Play();
 #endif  // ALSA
   return NULL;
 }
@@ -234,12 +41,24 @@ DevAlsa::DevAlsa(unsigned pregap,Codec *codec,QObject *parent)
 {
 #ifdef ALSA
   alsa_device=ALSA_DEFAULT_DEVICE;
-  alsa_pcm_buffer=NULL;
+  alsa_realtime=false;
+  alsa_realtime_priority=ALSA_DEFAULT_REALTIME_PRIORITY;
+  alsa_realtime_cpu=-1;
+  alsa_realtime_active=false;
+  alsa_mmap=false;
+  alsa_requested_format=AudioDevice::LastFormat;
+  alsa_pcm_s1=NULL;
+  alsa_pcm_s2=NULL;
+  alsa_pcm_s3=NULL;
+  alsa_pcm_out=NULL;
+  alsa_src=NULL;
+  alsa_clock=NULL;
+  alsa_running=false;
   alsa_stopping=false;
+  alsa_xruns=0;
+  alsa_xruns_logged=0;
+  alsa_xrun_log_time=0;
 
-  for(int i=0;i<MAX_AUDIO_CHANNELS;i++) {
-    alsa_meter_avg[i]=new MeterAverage(8);
-  }
   alsa_meter_timer=new QTimer(this);
   connect(alsa_meter_timer,SIGNAL(timeout()),this,SLOT(meterData()));
 
@@ -254,12 +73,18 @@ DevAlsa::~DevAlsa()
 {
 #ifdef ALSA
   stop();
-  for(int i=0;i<MAX_AUDIO_CHANNELS;i++) {
-    delete alsa_meter_avg[i];
-  }
   delete alsa_meter_timer;
-  if(alsa_pcm_buffer!=NULL) {
-    delete alsa_pcm_buffer;
+  if(alsa_pcm_s3!=alsa_pcm_s2) {
+    delete[] alsa_pcm_s3;
+  }
+  delete[] alsa_pcm_s2;
+  delete[] alsa_pcm_s1;
+  delete[] alsa_pcm_out;
+  if(alsa_src!=NULL) {
+    delete alsa_src;
+  }
+  if(alsa_clock!=NULL) {
+    delete alsa_clock;
   }
   delete alsa_play_position_timer;
 #endif  // ALSA
@@ -276,6 +101,43 @@ bool DevAlsa::processOptions(QString *err,const QStringList &keys,
       alsa_device=values[i];
       processed=true;
     }
+    if(keys[i]=="--alsa-format") {
+      if(values[i].toLower()!="auto") {
+	alsa_requested_format=AudioDevice::format(values[i]);
+	if(alsa_requested_format==AudioDevice::LastFormat) {
+	  *err=tr("invalid --alsa-format value");
+	  return false;
+	}
+      }
+      processed=true;
+    }
+    if(keys[i]=="--alsa-mmap") {
+      alsa_mmap=true;
+      processed=true;
+    }
+    if(keys[i]=="--realtime") {
+      alsa_realtime=true;
+      if(!values[i].isEmpty()) {
+	bool ok=false;
+	alsa_realtime_priority=values[i].toInt(&ok);
+	if((!ok)||
+	   (alsa_realtime_priority<sched_get_priority_min(SCHED_FIFO))||
+	   (alsa_realtime_priority>sched_get_priority_max(SCHED_FIFO))) {
+	  *err=tr("invalid argument to --realtime");
+	  return false;
+	}
+      }
+      processed=true;
+    }
+    if(keys[i]=="--realtime-cpu") {
+      bool ok=false;
+      alsa_realtime_cpu=values[i].toInt(&ok);
+      if((!ok)||(alsa_realtime_cpu<0)||(alsa_realtime_cpu>=CPU_SETSIZE)) {
+	*err=tr("invalid argument to --realtime-cpu");
+	return false;
+      }
+      processed=true;
+    }
     if(!processed) {
       *err=tr("unrecognized option")+" "+keys[i]+"\"";
       return false;
@@ -295,6 +157,7 @@ bool DevAlsa::start(QString *err)
   snd_pcm_sw_params_t *swparams;
   int dir;
   int aerr;
+  int srcerr;
   pthread_attr_t pthread_attr;
 
   if(snd_pcm_open(&alsa_pcm,alsa_device.toUtf8(),
@@ -308,35 +171,66 @@ bool DevAlsa::start(QString *err)
   //
   // Access Type
   //
-  if(snd_pcm_hw_params_test_access(alsa_pcm,hwparams,
-				   SND_PCM_ACCESS_RW_INTERLEAVED)<0) {
-    *err=tr("interleaved access not supported");
-    return false;
+  if(alsa_mmap) {
+    if(snd_pcm_hw_params_test_access(alsa_pcm,hwparams,
+				     SND_PCM_ACCESS_MMAP_INTERLEAVED)<0) {
+      Log(LOG_WARNING,"mmap access not supported by \""+alsa_device+
+	  "\", falling back to read/write access");
+      alsa_mmap=false;
+    }
+  }
+  if(alsa_mmap) {
+    snd_pcm_hw_params_set_access(alsa_pcm,hwparams,
+				 SND_PCM_ACCESS_MMAP_INTERLEAVED);
+  }
+  else {
+    if(snd_pcm_hw_params_test_access(alsa_pcm,hwparams,
+				     SND_PCM_ACCESS_RW_INTERLEAVED)<0) {
+      *err=tr("interleaved access not supported");
+      return false;
+    }
+    snd_pcm_hw_params_set_access(alsa_pcm,hwparams,
+				 SND_PCM_ACCESS_RW_INTERLEAVED);
   }
-  snd_pcm_hw_params_set_access(alsa_pcm,hwparams,SND_PCM_ACCESS_RW_INTERLEAVED);
 
   //
   // Sample Format
   //
-  if(snd_pcm_hw_params_set_format(alsa_pcm,hwparams,
-				  SND_PCM_FORMAT_S32_LE)==0) {
-    alsa_format=AudioDevice::S32_LE;
-    if(global_log_verbose) {
-      Log(LOG_INFO,"using ALSA S32_LE sample format");
+  // Take the first format in this list that the device accepts, so that
+  // a card (or server) with a native float or 24 bit path gets it
+  // directly instead of having plug convert it from 16 or 32 bits.
+  //
+  static const AudioDevice::Format alsa_formats[]=
+    {AudioDevice::FLOAT,AudioDevice::S24_LE,AudioDevice::S24_3LE,
+     AudioDevice::S32_LE,AudioDevice::S16_LE};
+  alsa_format=AudioDevice::LastFormat;
+  for(unsigned i=0;i<(sizeof(alsa_formats)/sizeof(alsa_formats[0]));i++) {
+    if((alsa_requested_format!=AudioDevice::LastFormat)&&
+       (alsa_formats[i]!=alsa_requested_format)) {
+      continue;
+    }
+    if((snd_pcm_hw_params_test_format(alsa_pcm,hwparams,
+				      AlsaFormat(alsa_formats[i]))==0)&&
+       (snd_pcm_hw_params_set_format(alsa_pcm,hwparams,
+				     AlsaFormat(alsa_formats[i]))==0)) {
+      alsa_format=alsa_formats[i];
+      break;
     }
   }
-  else {
-    if(snd_pcm_hw_params_set_format(alsa_pcm,hwparams,
-				    SND_PCM_FORMAT_S16_LE)==0) {
-      alsa_format=AudioDevice::S16_LE;
-      if(global_log_verbose) {
-	Log(LOG_INFO,"using ALSA S16_LE sample format");
-      }
+  if(alsa_format==AudioDevice::LastFormat) {
+    if(alsa_requested_format!=AudioDevice::LastFormat) {
+      *err=tr("sample format")+" "+
+	AudioDevice::formatString(alsa_requested_format)+" "+
+	tr("not supported by")+" \""+alsa_device+"\"";
     }
     else {
       *err=tr("incompatible sample format");
-      return false;
     }
+    return false;
+  }
+  if(global_log_verbose) {
+    Log(LOG_INFO,"using ALSA "+AudioDevice::formatString(alsa_format)+
+	" sample format");
   }
 
   //
@@ -397,7 +291,37 @@ bool DevAlsa::start(QString *err)
     *err=tr("ALSA device error 1")+": "+snd_strerror(aerr);
     return false;
   }
-  alsa_pcm_buffer=new float[alsa_buffer_size*alsa_channels];
+  alsa_clock=new ClockRecovery(codec()->samplerate());
+
+  //
+  // Working Buffers
+  //
+  alsa_pcm_s1=new float[ALSA_MAX_CARD_BUFFER];
+  alsa_pcm_s2=new float[ALSA_SRC_BUFFER_SIZE];
+  if(codec()->channels()==alsa_channels) {
+    alsa_pcm_s3=alsa_pcm_s2;
+  }
+  else {
+    alsa_pcm_s3=new float[ALSA_MIX_BUFFER_SIZE];
+  }
+  if(!alsa_mmap) {
+    alsa_pcm_out=new char[ALSA_OUTPUT_BUFFER_SIZE];
+  }
+
+  //
+  // Sample Rate Converter (only needed if the card can't run at the
+  // stream rate)
+  //
+  if(alsa_samplerate!=codec()->samplerate()) {
+    alsa_src=new Resampler(srcQuality(),codec()->channels(),
+			   (double)alsa_samplerate/
+			   (double)codec()->samplerate(),
+			   alsa_buffer_size/(alsa_period_quantity*2),&srcerr);
+    if(srcerr!=0) {
+      fprintf(stderr,"SRC initialization error [%s]\n",src_strerror(srcerr));
+      exit(GLASS_EXIT_SRC_ERROR);
+    }
+  }
 
   //
   // Set Wake-up Timing
@@ -413,14 +337,60 @@ bool DevAlsa::start(QString *err)
   //
   // Start the Callback
   //
+  if(alsa_realtime) {
+    if(!codec()->ring()->mlock()) {
+      Log(LOG_WARNING,
+	  QString("unable to lock PCM ringbuffer in memory")+
+	  " ["+strerror(errno)+"]");
+    }
+  }
   pthread_attr_init(&pthread_attr);
+  alsa_realtime_active=alsa_realtime;
+  if(alsa_realtime) {
+    struct sched_param sp;
+    memset(&sp,0,sizeof(sp));
+    sp.sched_priority=alsa_realtime_priority;
+    pthread_attr_setinheritsched(&pthread_attr,PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&pthread_attr,SCHED_FIFO);
+    pthread_attr_setschedparam(&pthread_attr,&sp);
+  }
+  if((aerr=pthread_create(&alsa_pthread,&pthread_attr,AlsaCallback,
+			  this))!=0) {
+    if(!alsa_realtime) {
+      *err=tr("unable to start ALSA thread")+": "+strerror(aerr);
+      pthread_attr_destroy(&pthread_attr);
+      return false;
+    }
 
-//  if(use_realtime) {
-//    pthread_attr_setschedpolicy(&pthread_attr,SCHED_FIFO);
-
-  pthread_create(&alsa_pthread,&pthread_attr,AlsaCallback,this);
-
-  //  alsa_meter_timer->start(AUDIO_METER_INTERVAL);
+    //
+    // Most likely no CAP_SYS_NICE or RLIMIT_RTPRIO, so carry on with
+    // normal scheduling
+    //
+    Log(LOG_WARNING,
+	QString().sprintf("unable to use realtime priority %d",
+			  alsa_realtime_priority)+" ["+strerror(aerr)+"]");
+    alsa_realtime_active=false;
+    pthread_attr_destroy(&pthread_attr);
+    pthread_attr_init(&pthread_attr);
+    if((aerr=pthread_create(&alsa_pthread,&pthread_attr,AlsaCallback,
+			    this))!=0) {
+      *err=tr("unable to start ALSA thread")+": "+strerror(aerr);
+      pthread_attr_destroy(&pthread_attr);
+      return false;
+    }
+  }
+  pthread_attr_destroy(&pthread_attr);
+  alsa_running=true;
+  if(alsa_realtime_cpu>=0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(alsa_realtime_cpu,&cpus);
+    if((aerr=pthread_setaffinity_np(alsa_pthread,sizeof(cpus),&cpus))!=0) {
+      Log(LOG_WARNING,
+	  QString().sprintf("unable to pin ALSA thread to CPU %d",
+			    alsa_realtime_cpu)+" ["+strerror(aerr)+"]");
+    }
+  }
 
   alsa_play_position_timer->start(50);
   alsa_meter_timer->start(AUDIO_METER_INTERVAL);
@@ -435,8 +405,11 @@ bool DevAlsa::start(QString *err)
 void DevAlsa::stop()
 {
 #ifdef ALSA
-  alsa_stopping=true;
-  pthread_join(alsa_pthread,NULL);
+  if(alsa_running) {
+    alsa_stopping=true;
+    pthread_join(alsa_pthread,NULL);
+    alsa_running=false;
+  }
 #endif  // ALSA
 }
 
@@ -453,11 +426,26 @@ void DevAlsa::meterData()
 {
 #ifdef ALSA
   float lvls[MAX_AUDIO_CHANNELS];
+  unsigned xruns=alsa_xruns;
+  time_t now;
 
-  for(unsigned i=0;i<codec()->channels();i++) {
-    lvls[i]=alsa_meter_avg[i]->average();
+  if(collectMeterLevels(lvls)) {
+    setMeterLevels(lvls);
+  }
+
+  //
+  // Xruns are only counted on the playback thread, and logged from here
+  // now and then
+  //
+  if(xruns!=alsa_xruns_logged) {
+    now=time(NULL);
+    if((now-alsa_xrun_log_time)>=ALSA_XRUN_LOG_INTERVAL) {
+      Log(LOG_WARNING,QString().sprintf("%u ALSA xrun(s)",
+					xruns-alsa_xruns_logged));
+      alsa_xruns_logged=xruns;
+      alsa_xrun_log_time=now;
+    }
   }
-  setMeterLevels(lvls);
 #endif  // ALSA
 }
 
@@ -483,12 +471,367 @@ void DevAlsa::loadStats(QStringList *hdrs,QStringList *values,bool is_first)
 
     hdrs->push_back("Device|Period Quantity");
     values->push_back(QString().sprintf("%u",alsa_period_quantity));
+
+    hdrs->push_back("Device|Sample Format");
+    values->push_back(AudioDevice::formatString(alsa_format));
+
+    hdrs->push_back("Device|Access");
+    if(alsa_mmap) {
+      values->push_back("MMAP_INTERLEAVED");
+    }
+    else {
+      values->push_back("RW_INTERLEAVED");
+    }
+
+    hdrs->push_back("Device|Realtime Priority");
+    if(alsa_realtime_active) {
+      values->push_back(QString().sprintf("%d",alsa_realtime_priority));
+    }
+    else {
+      values->push_back("none");
+    }
   }
 
-  hdrs->push_back("Device|PLL Offset");
-  values->push_back(QString().sprintf("%8.6lf",alsa_pll_offset));
+  hdrs->push_back("Device|XRuns");
+  values->push_back(QString().sprintf("%u",alsa_xruns.load()));
+
+  if(alsa_clock!=NULL) {
+    hdrs->push_back("Device|PLL Offset");
+    values->push_back(QString().sprintf("%8.6lf",alsa_clock->offset()));
+
+    hdrs->push_back("Device|PLL Drift");
+    values->push_back(QString().sprintf("%8.6lf",alsa_clock->drift()));
 
-  hdrs->push_back("Device|PLL Setpoint Frames");
-  values->push_back(QString().sprintf("%u",alsa_pll_setpoint_frames));
+    hdrs->push_back("Device|PLL Setpoint Frames");
+    values->push_back(QString().sprintf("%u",alsa_clock->setpointFrames()));
+
+    hdrs->push_back("Device|PLL Filtered Frames");
+    values->push_back(QString().sprintf("%u",alsa_clock->filteredFrames()));
+  }
 #endif  // ALSA
 }
+
+
+#ifdef ALSA
+void DevAlsa::Play()
+{
+  Ringbuffer *ring=codec()->ring();
+  unsigned period=alsa_buffer_size/(alsa_period_quantity*2);
+  unsigned prebuffer=prebufferFrames();
+  double pll_setpoint_ratio=
+    (double)alsa_samplerate/(double)codec()->samplerate();
+  SRC_DATA data;
+  float *pcm_in;
+  float *pcm_out;
+  float *pcm_play;
+  unsigned frames;
+  unsigned pending;
+  bool in_place;
+  bool show_xrun=false;
+  int n;
+  int err;
+
+  alsa_play_position=0;
+  alsa_drift=0.0;
+  memset(&data,0,sizeof(data));
+  data.data_out=alsa_pcm_s2;
+  data.output_frames=ALSA_SRC_BUFFER_SIZE/codec()->channels();
+  data.src_ratio=pll_setpoint_ratio;
+
+  //
+  // Touch every page of the working buffers now so that the first
+  // periods don't stall on page faults
+  //
+  if(alsa_realtime) {
+    memset(alsa_pcm_s1,0,ALSA_MAX_CARD_BUFFER*sizeof(float));
+    memset(alsa_pcm_s2,0,ALSA_SRC_BUFFER_SIZE*sizeof(float));
+    if(alsa_pcm_s3!=alsa_pcm_s2) {
+      memset(alsa_pcm_s3,0,ALSA_MIX_BUFFER_SIZE*sizeof(float));
+    }
+    if(alsa_pcm_out!=NULL) {
+      memset(alsa_pcm_out,0,ALSA_OUTPUT_BUFFER_SIZE);
+    }
+  }
+
+  //
+  // Wait for PCM buffer to fill
+  //
+  while((!alsa_stopping)&&(!ring->isFinished())&&
+	(ring->readSpace()<prebuffer)) {
+    ring->waitReadSpace(prebuffer,ALSA_WAIT_INTERVAL);
+  }
+  alsa_clock->reset(ring->readSpace());
+
+  //
+  // Apply the pregap
+  //
+  WritePcm(NULL,pregap()*alsa_samplerate/1000);
+
+  while(!alsa_stopping) {
+    //
+    // Sleep until a period's worth of audio is ready. An empty ring only
+    // ends playback once the codec has finished; otherwise it's an
+    // underrun and we wait for the stream to catch up.
+    //
+    if((ring->readSpace()<period)&&(!ring->isFinished())) {
+      ring->waitReadSpace(period,ALSA_WAIT_INTERVAL);
+    }
+    if(ring->readSpace()==0) {
+      if(ring->isFinished()) {
+	break;
+      }
+
+      //
+      // Underrun, so refill to the (possibly raised) prebuffer level
+      // before resuming
+      //
+      prebufferUnderrun();
+      prebuffer=prebufferFrames();
+      while((!alsa_stopping)&&(!ring->isFinished())&&
+	    (ring->readSpace()<prebuffer)) {
+	ring->waitReadSpace(prebuffer,ALSA_WAIT_INTERVAL);
+      }
+      alsa_clock->reset(ring->readSpace());
+      continue;
+    }
+    data.src_ratio=pll_setpoint_ratio+
+      alsa_clock->update(ring->readSpace(),period);
+    if(alsa_src!=NULL) {
+      alsa_src->setRatio(data.src_ratio);
+    }
+    if(snd_pcm_state(alsa_pcm)!=SND_PCM_STATE_RUNNING) {
+      if(show_xrun) {
+	alsa_xruns++;
+	snd_pcm_drop(alsa_pcm);
+	snd_pcm_prepare(alsa_pcm);
+	show_xrun=false;
+      }
+    }
+    else {
+      show_xrun=!ring->isFinished();
+    }
+
+    //
+    // Feed the SRC straight from the ringbuffer where the data is
+    // contiguous, falling back to a copy only when it is not
+    //
+    frames=period;
+    pcm_in=ring->peekContiguous(&frames);
+    if((in_place=(frames>0))) {
+      n=frames;
+    }
+    else {
+      pcm_in=alsa_pcm_s1;
+      n=ring->read(alsa_pcm_s1,period);
+    }
+    if(n>0) {
+      pending=0;
+      if(alsa_src!=NULL) {
+	data.data_in=pcm_in;
+	data.input_frames=n;
+	alsa_play_position+=n;
+	if((err=alsa_src->process(&data))<0) {
+	  fprintf(stderr,"SRC processing error [%s]\n",src_strerror(err));
+	  exit(GLASS_EXIT_SRC_ERROR);
+	}
+	if(in_place) {
+	  ring->commitRead(n);
+	}
+	n=data.output_frames_gen;
+	pcm_out=alsa_pcm_s2;
+      }
+      else {
+	//
+	// Rates match, so play straight from the ringbuffer and absorb
+	// clock drift by occasionally repeating or skipping one frame
+	//
+	pcm_out=pcm_in;
+	if(in_place) {
+	  pending=n;
+	  alsa_drift+=n*alsa_clock->offset();
+	  if(n>1) {
+	    if(alsa_drift>=1.0) {    // Play the last frame again next time
+	      pending--;
+	      alsa_drift-=1.0;
+	    }
+	    if(alsa_drift<=-1.0) {   // Skip the last frame
+	      n--;
+	      alsa_drift+=1.0;
+	    }
+	  }
+	  alsa_play_position+=pending;
+	}
+	else {
+	  alsa_play_position+=n;
+	}
+      }
+      meterPcm(pcm_out,n,codec()->channels());
+      pcm_play=pcm_out;
+      if(codec()->channels()!=alsa_channels) {
+	remixChannels(alsa_pcm_s3,alsa_channels,pcm_out,codec()->channels(),
+		      n);
+	pcm_play=alsa_pcm_s3;
+      }
+      WritePcm(pcm_play,n);
+
+      //
+      // Work around an ALSA bug that appends garbage to the end of
+      // the final PCM block
+      //
+      if(ring->isFinished()&&(ring->readSpace()==pending)&&
+	 ((snd_pcm_uframes_t)n<alsa_buffer_size)) {
+	WritePcm(NULL,alsa_buffer_size-n);
+      }
+      if(pending>0) {
+	ring->commitRead(pending);
+      }
+      firstSampleOutput();
+    }
+  }
+
+  //
+  // Shutdown
+  //
+  snd_pcm_drain(alsa_pcm);
+  snd_pcm_close(alsa_pcm);
+}
+
+
+void DevAlsa::WritePcm(const float *pcm,unsigned frames)
+{
+  //
+  // Convert 'frames' of interleaved float PCM (or silence, if 'pcm' is
+  // NULL) to the device format and queue it for playback
+  //
+  const snd_pcm_channel_area_t *areas;
+  snd_pcm_uframes_t offset;
+  snd_pcm_uframes_t count;
+  snd_pcm_sframes_t avail;
+  unsigned chunk;
+  snd_pcm_sframes_t written;
+  char *out;
+  int err;
+
+  if(!alsa_mmap) {
+    while(frames>0) {
+      chunk=snd_pcm_bytes_to_frames(alsa_pcm,ALSA_OUTPUT_BUFFER_SIZE);
+      if(chunk>frames) {
+	chunk=frames;
+      }
+      ConvertPcm(alsa_pcm_out,pcm,chunk);
+      out=alsa_pcm_out;
+      while((chunk>0)&&(!alsa_stopping)) {
+	if((written=snd_pcm_writei(alsa_pcm,out,chunk))<0) {
+	  if(!Recover(written)) {
+	    return;
+	  }
+	  continue;
+	}
+	out+=snd_pcm_frames_to_bytes(alsa_pcm,written);
+	if(pcm!=NULL) {
+	  pcm+=written*alsa_channels;
+	}
+	chunk-=written;
+	frames-=written;
+      }
+      if(alsa_stopping) {
+	return;
+      }
+    }
+    return;
+  }
+
+  //
+  // Convert straight into the hardware buffer
+  //
+  while((frames>0)&&(!alsa_stopping)) {
+    if((avail=snd_pcm_avail_update(alsa_pcm))<0) {
+      if(!Recover(avail)) {
+	return;
+      }
+      continue;
+    }
+    if(avail==0) {
+      snd_pcm_wait(alsa_pcm,ALSA_WAIT_INTERVAL);
+      continue;
+    }
+    count=frames;
+    if((err=snd_pcm_mmap_begin(alsa_pcm,&areas,&offset,&count))<0) {
+      if(!Recover(err)) {
+	return;
+      }
+      continue;
+    }
+    ConvertPcm((char *)areas[0].addr+
+	       (areas[0].first+offset*areas[0].step)/8,pcm,count);
+    if((avail=snd_pcm_mmap_commit(alsa_pcm,offset,count))<0) {
+      if(!Recover(avail)) {
+	return;
+      }
+      continue;
+    }
+    if(snd_pcm_state(alsa_pcm)==SND_PCM_STATE_PREPARED) {
+      snd_pcm_start(alsa_pcm);
+    }
+    if(pcm!=NULL) {
+      pcm+=count*alsa_channels;
+    }
+    frames-=count;
+  }
+}
+
+
+bool DevAlsa::Recover(int err)
+{
+  //
+  // Recover from an xrun (-EPIPE) or suspend (-ESTRPIPE), counting xruns
+  //
+  if(err==-EPIPE) {
+    alsa_xruns++;
+  }
+  return snd_pcm_recover(alsa_pcm,err,1)>=0;
+}
+
+
+void DevAlsa::ConvertPcm(void *dst,const float *pcm,unsigned frames)
+{
+  if(pcm==NULL) {
+    memset(dst,0,snd_pcm_frames_to_bytes(alsa_pcm,frames));
+    return;
+  }
+  convertFromFloat(dst,alsa_format,pcm,frames,alsa_channels);
+}
+
+
+snd_pcm_format_t DevAlsa::AlsaFormat(AudioDevice::Format fmt)
+{
+  snd_pcm_format_t ret=SND_PCM_FORMAT_UNKNOWN;
+
+  switch(fmt) {
+  case AudioDevice::FLOAT:
+    ret=SND_PCM_FORMAT_FLOAT_LE;
+    break;
+
+  case AudioDevice::S16_LE:
+    ret=SND_PCM_FORMAT_S16_LE;
+    break;
+
+  case AudioDevice::S32_LE:
+    ret=SND_PCM_FORMAT_S32_LE;
+    break;
+
+  case AudioDevice::S24_LE:
+    ret=SND_PCM_FORMAT_S24_LE;
+    break;
+
+  case AudioDevice::S24_3LE:
+    ret=SND_PCM_FORMAT_S24_3LE;
+    break;
+
+  case AudioDevice::LastFormat:
+    break;
+  }
+
+  return ret;
+}
+#endif  // ALSA
@@ -24,16 +24,26 @@
 #ifdef ALSA
 #include <alsa/asoundlib.h>
 #include <pthread.h>
+#include <time.h>
+
+#include <atomic>
 #endif  // ALSA
 
 #include <QTimer>
 
 #include "audiodevice.h"
-#include "meteraverage.h"
+#include "clockrecovery.h"
+#include "resampler.h"
 
 #define ALSA_MAX_CARD_BUFFER 131072
 #define ALSA_DEFAULT_DEVICE "hw:0"
 #define ALSA_PERIOD_QUANTITY 4
+#define ALSA_DEFAULT_REALTIME_PRIORITY 50
+#define ALSA_SRC_BUFFER_SIZE 262144
+#define ALSA_MIX_BUFFER_SIZE 32768
+#define ALSA_OUTPUT_BUFFER_SIZE (ALSA_MAX_CARD_BUFFER*sizeof(int32_t))
+#define ALSA_WAIT_INTERVAL 100
+#define ALSA_XRUN_LOG_INTERVAL 10
 
 class DevAlsa : public AudioDevice
 {
@@ -56,21 +66,39 @@ class DevAlsa : public AudioDevice
  private:
 #ifdef ALSA
   QString alsa_device;
+  bool alsa_realtime;
+  int alsa_realtime_priority;
+  int alsa_realtime_cpu;
+  bool alsa_realtime_active;
   snd_pcm_t *alsa_pcm;
+  AudioDevice::Format alsa_requested_format;
   AudioDevice::Format alsa_format;
   unsigned alsa_samplerate;
   unsigned alsa_channels;
   unsigned alsa_period_quantity;
   snd_pcm_uframes_t alsa_buffer_size; 
-  float *alsa_pcm_buffer;
+  float *alsa_pcm_s1;
+  float *alsa_pcm_s2;
+  float *alsa_pcm_s3;
+  char *alsa_pcm_out;
+  bool alsa_mmap;
+  Resampler *alsa_src;
+  double alsa_drift;
   pthread_t alsa_pthread;
-  bool alsa_stopping;
-  MeterAverage *alsa_meter_avg[MAX_AUDIO_CHANNELS];
+  bool alsa_running;
+  std::atomic<bool> alsa_stopping;
+  std::atomic<unsigned> alsa_xruns;
+  unsigned alsa_xruns_logged;
+  time_t alsa_xrun_log_time;
   QTimer *alsa_meter_timer;
   QTimer *alsa_play_position_timer;
+  void Play();
+  void WritePcm(const float *pcm,unsigned frames);
+  bool Recover(int err);
+  void ConvertPcm(void *dst,const float *pcm,unsigned frames);
+  static snd_pcm_format_t AlsaFormat(AudioDevice::Format fmt);
   friend void *AlsaCallback(void *ptr);
-  double alsa_pll_offset;
-  unsigned alsa_pll_setpoint_frames;
+  ClockRecovery *alsa_clock;
   uint64_t alsa_play_position;
 #endif  // ALSA
 };
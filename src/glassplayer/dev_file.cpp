@@ -18,17 +18,50 @@
 //   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 //
 
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "dev_file.h"
+#include "logging.h"
+
+void *FileCallback(void *ptr)
+{
+  ((DevFile *)ptr)->Write();
+  return NULL;
+}
+
 
 DevFile::DevFile(unsigned pregap,Codec *codec,QObject *parent)
   : AudioDevice(pregap,codec,parent)
 {
   file_format=AudioDevice::S16_LE;
+  file_type=SF_FORMAT_WAV;
   file_file_name="";
+  file_sndfile=NULL;
+  file_fd=-1;
+  memset(&file_sfinfo,0,sizeof(file_sfinfo));
+  file_segment_secs=0;
+  file_segment_frames=0;
+  file_segment_remaining=0;
+  file_segment_time=0;
+  file_segment_failed=false;
+  file_segments=0;
+  file_failed_segments=0;
+  file_batch_msecs=FILE_DEFAULT_BATCH_MSECS;
+  file_batch_frames=0;
+  file_preallocate_secs=0;
+  file_running=false;
+  file_stopping=false;
   file_frames_processed=0;
+  file_write_usecs=0;
+  file_max_write_usecs=0;
+  file_write_error=0;
 }
 
 
@@ -41,28 +74,62 @@ DevFile::~DevFile()
 bool DevFile::processOptions(QString *err,const QStringList &keys,
 			     const QStringList &values)
 {
+  bool ok=false;
+
   for(int i=0;i<keys.size();i++) {
     bool processed=false;
     if(keys[i]=="--file-format") {
-      if(values[i].toLower()=="float") {
-	file_format=AudioDevice::FLOAT;
+      file_format=AudioDevice::format(values[i]);
+      if(file_format==AudioDevice::LastFormat) {
+	*err=tr("invalid --file-format value");
+	return false;
+      }
+      processed=true;
+    }
+    if(keys[i]=="--file-name") {
+      file_file_name=values[i];
+      processed=true;
+    }
+    if(keys[i]=="--file-type") {
+      if(values[i].toLower()=="wav") {
+	file_type=SF_FORMAT_WAV;
 	processed=true;
       }
-      if(values[i].toLower()=="s16_le") {
-	file_format=AudioDevice::S16_LE;
+      if(values[i].toLower()=="rf64") {
+	file_type=SF_FORMAT_RF64;
 	processed=true;
       }
-      if(values[i].toLower()=="s32_le") {
-	file_format=AudioDevice::S32_LE;
+      if(values[i].toLower()=="w64") {
+	file_type=SF_FORMAT_W64;
 	processed=true;
       }
       if(!processed) {
-	*err=tr("invalid --file-format value");
+	*err=tr("invalid --file-type value");
 	return false;
       }
     }
-    if(keys[i]=="--file-name") {
-      file_file_name=values[i];
+    if(keys[i]=="--file-segment-seconds") {
+      file_segment_secs=values[i].toUInt(&ok);
+      if(!ok) {
+	*err=tr("invalid --file-segment-seconds value");
+	return false;
+      }
+      processed=true;
+    }
+    if(keys[i]=="--file-batch-ms") {
+      file_batch_msecs=values[i].toUInt(&ok);
+      if((!ok)||(file_batch_msecs==0)) {
+	*err=tr("invalid --file-batch-ms value");
+	return false;
+      }
+      processed=true;
+    }
+    if(keys[i]=="--file-preallocate") {
+      file_preallocate_secs=values[i].toUInt(&ok);
+      if(!ok) {
+	*err=tr("invalid --file-preallocate value");
+	return false;
+      }
       processed=true;
     }
     if(!processed) {
@@ -85,7 +152,8 @@ bool DevFile::processOptions(QString *err,const QStringList &keys,
 
 bool DevFile::start(QString *err)
 {
-  SF_INFO sf;
+  Ringbuffer *ring=codec()->ring();
+  QString filename=file_file_name;
 
   file_frames_processed=0;
 
@@ -94,30 +162,88 @@ bool DevFile::start(QString *err)
     return false;
   }
 
-  memset(&sf,0,sizeof(sf));
-  sf.samplerate=codec()->samplerate();
-  sf.channels=codec()->channels();
+  memset(&file_sfinfo,0,sizeof(file_sfinfo));
+  file_sfinfo.samplerate=codec()->samplerate();
+  file_sfinfo.channels=codec()->channels();
   switch(file_format) {
   case AudioDevice::FLOAT:
-    sf.format=SF_FORMAT_WAV|SF_FORMAT_FLOAT;
+    file_sfinfo.format=file_type|SF_FORMAT_FLOAT;
     break;
 
   case AudioDevice::S16_LE:
-    sf.format=SF_FORMAT_WAV|SF_FORMAT_PCM_16;
+    file_sfinfo.format=file_type|SF_FORMAT_PCM_16;
     break;
 
   case AudioDevice::S32_LE:
-    sf.format=SF_FORMAT_WAV|SF_FORMAT_PCM_32;
+    file_sfinfo.format=file_type|SF_FORMAT_PCM_32;
+    break;
+
+  case AudioDevice::S24_LE:
+  case AudioDevice::S24_3LE:
+    file_sfinfo.format=file_type|SF_FORMAT_PCM_24;
     break;
 
   case AudioDevice::LastFormat:
     *err=tr("Internal Error");
     return false;
   }
-  if((file_sndfile=sf_open(file_file_name.toUtf8(),SFM_WRITE,&sf))==NULL) {
-    *err=sf_strerror(file_sndfile);
+
+  //
+  // Segmented recording. The first segment runs to the next multiple of
+  // --file-segment-seconds on the local clock, so that (for example)
+  // hourly segments start on the hour; after that each one is exactly
+  // that many frames long.
+  //
+  if(file_segment_secs>0) {
+    struct timespec now;
+    struct tm tm;
+    clock_gettime(CLOCK_REALTIME,&now);
+    localtime_r(&now.tv_sec,&tm);
+    file_segment_frames=(uint64_t)file_segment_secs*codec()->samplerate();
+    file_segment_time=now.tv_sec+file_segment_secs-
+      (now.tv_sec+tm.tm_gmtoff)%file_segment_secs;
+    file_segment_remaining=
+      ((double)(file_segment_time-now.tv_sec)-(double)now.tv_nsec/1e9)*
+      (double)codec()->samplerate();
+    if(file_segment_remaining==0) {
+      file_segment_remaining=file_segment_frames;
+    }
+    file_segment_failed=false;
+    filename=SegmentName(now.tv_sec);
+    if(filename==SegmentName(file_segment_time)) {
+      Log(LOG_WARNING,"--file-name \""+file_file_name+
+	  "\" does not change between segments, "+
+	  "each will overwrite the last");
+    }
+  }
+  if((file_sndfile=OpenFile(filename,err))==NULL) {
     return false;
   }
+  file_segments=1;
+
+  //
+  // Batch size, rounded up to a whole multiple of FILE_BATCH_ALIGN frames
+  // but small enough that the codec can keep writing while a batch is in
+  // flight
+  //
+  file_batch_frames=(uint64_t)file_batch_msecs*codec()->samplerate()/1000;
+  file_batch_frames=FILE_BATCH_ALIGN*
+    ((file_batch_frames+FILE_BATCH_ALIGN-1)/FILE_BATCH_ALIGN);
+  if(file_batch_frames<FILE_BATCH_ALIGN) {
+    file_batch_frames=FILE_BATCH_ALIGN;
+  }
+  if(file_batch_frames>(ring->size()/2)) {
+    file_batch_frames=ring->size()/2;
+  }
+  file_pcm.resize(file_batch_frames*codec()->channels());
+
+  file_stopping=false;
+  if(pthread_create(&file_pthread,NULL,FileCallback,this)!=0) {
+    *err=tr("unable to start file writer thread");
+    CloseFile();
+    return false;
+  }
+  file_running=true;
 
   return true;
 }
@@ -125,23 +251,90 @@ bool DevFile::start(QString *err)
 
 void DevFile::stop()
 {
-  sf_close(file_sndfile);
+  //
+  // The writer drains whatever is left in the ringbuffer before exiting
+  //
+  if(file_running) {
+    file_stopping=true;
+    pthread_join(file_pthread,NULL);
+    file_running=false;
+  }
+  CloseFile();
 }
 
 
-void DevFile::synchronousWrite(unsigned frames,bool is_last)
+SNDFILE *DevFile::OpenFile(const QString &filename,QString *err)
 {
-  float pcm[frames*codec()->channels()];
-  int n;
+  SNDFILE *sndfile=NULL;
+  SF_INFO sf=file_sfinfo;
+  int fd;
 
-  n=codec()->ring()->read(pcm,frames);
-  sf_writef_float(file_sndfile,pcm,n);
-  if(is_last) {
+  if((fd=open(filename.toUtf8(),O_WRONLY|O_CREAT|O_TRUNC,0666))<0) {
+    *err=tr("unable to open")+" \""+filename+"\" ["+strerror(errno)+"]";
+    return NULL;
+  }
+
+  //
+  // Reserve the space up front so that a long recording doesn't end up
+  // fragmented (or fail part way through on a full volume). The file
+  // size is left alone, so a short recording stays short.
+  //
+  if(file_preallocate_secs>0) {
+    off_t len=(off_t)file_preallocate_secs*codec()->samplerate()*
+      codec()->channels()*formatSize(file_format);
+    if(fallocate(fd,FALLOC_FL_KEEP_SIZE,0,len)!=0) {
+      Log(LOG_WARNING,"unable to preallocate \""+filename+"\" ["+
+	  strerror(errno)+"]");
+    }
+  }
+  //
+  // The descriptor stays ours, so that it gets closed whether or not
+  // libsndfile manages to open it
+  //
+  if((sndfile=sf_open_fd(fd,SFM_WRITE,&sf,SF_FALSE))==NULL) {
+    *err=tr("unable to open")+" \""+filename+"\" ["+sf_strerror(NULL)+"]";
+    close(fd);
+    return NULL;
+  }
+  file_fd=fd;
+
+  return sndfile;
+}
+
+
+void DevFile::CloseFile()
+{
+  if(file_sndfile!=NULL) {
     sf_close(file_sndfile);
-    exit(0);
+    file_sndfile=NULL;
+  }
+  if(file_fd>=0) {
+    close(file_fd);
+    file_fd=-1;
   }
-  file_frames_processed+=n;
+}
+
+
+QString DevFile::SegmentName(time_t t) const
+{
+  char name[1024];
+  struct tm tm;
+
+  localtime_r(&t,&tm);
+  if(strftime(name,sizeof(name),file_file_name.toUtf8(),&tm)==0) {
+    return file_file_name;
+  }
+  return QString::fromUtf8(name);
+}
+
+
+void DevFile::synchronousWrite(unsigned frames,bool is_last)
+{
   updatePlayPosition(file_frames_processed);
+  if(is_last) {
+    stop();
+    exit(0);
+  }
 }
 
 
@@ -150,5 +343,134 @@ void DevFile::loadStats(QStringList *hdrs,QStringList *values,bool is_first)
   if(is_first) {
     hdrs->push_back("Device|Type");
     values->push_back("FILE");
+
+    hdrs->push_back("Device|Sample Format");
+    values->push_back(AudioDevice::formatString(file_format));
+
+    hdrs->push_back("Device|Batch Frames");
+    values->push_back(QString().sprintf("%u",file_batch_frames));
+
+    if(file_segment_secs>0) {
+      hdrs->push_back("Device|Segment Frames");
+      values->push_back(QString().sprintf("%lu",file_segment_frames));
+    }
+  }
+  if(file_segment_secs>0) {
+    hdrs->push_back("Device|Segments");
+    values->push_back(QString().sprintf("%u",file_segments.load()));
+
+    hdrs->push_back("Device|Failed Segments");
+    values->push_back(QString().sprintf("%u",file_failed_segments.load()));
+  }
+  hdrs->push_back("Device|Frames Written");
+  values->push_back(QString().sprintf("%lu",file_frames_processed.load()));
+
+  hdrs->push_back("Device|Backlog Frames");
+  values->push_back(QString().sprintf("%u",codec()->ring()->readSpace()));
+
+  hdrs->push_back("Device|Write Latency");
+  values->push_back(QString().sprintf("%8.3lf",
+				      (double)file_write_usecs/1000.0));
+
+  hdrs->push_back("Device|Max Write Latency");
+  values->push_back(QString().sprintf("%8.3lf",
+				      (double)file_max_write_usecs/1000.0));
+}
+
+
+void DevFile::Write()
+{
+  Ringbuffer *ring=codec()->ring();
+  struct timespec then;
+  struct timespec now;
+  unsigned frames;
+  unsigned n;
+  float *pcm;
+  bool in_place;
+  uint64_t usecs;
+  QString err;
+
+  while(true) {
+    //
+    // Sleep until a full batch is ready, or until the stream ends and
+    // whatever is left needs to go out
+    //
+    if((ring->readSpace()<file_batch_frames)&&
+       (!file_stopping)&&(!ring->isFinished())) {
+      ring->waitReadSpace(file_batch_frames,FILE_WAIT_INTERVAL);
+      continue;
+    }
+    if((frames=ring->readSpace())==0) {
+      if(file_stopping||ring->isFinished()) {
+	break;
+      }
+      continue;
+    }
+    if(frames>file_batch_frames) {
+      frames=file_batch_frames;
+    }
+    if((file_segment_frames>0)&&(frames>file_segment_remaining)) {
+      frames=file_segment_remaining;
+    }
+
+    //
+    // Segments are opened on their first write, so that one isn't left
+    // empty at the end of the stream
+    //
+    if((file_sndfile==NULL)&&(!file_segment_failed)) {
+      if((file_sndfile=OpenFile(SegmentName(file_segment_time-
+					    file_segment_secs),&err))==NULL) {
+	//
+	// Once per segment; its audio is discarded until the next one
+	//
+	Log(LOG_ERR,err+", "+tr("skipping segment"));
+	file_segment_failed=true;
+	file_failed_segments++;
+      }
+      else {
+	file_segments++;
+      }
+    }
+
+    //
+    // Write straight from the ringbuffer where the data is contiguous,
+    // falling back to a copy only when it is not
+    //
+    n=frames;
+    pcm=ring->peekContiguous(&n);
+    if(!(in_place=(n>0))) {
+      pcm=file_pcm.data();
+      n=ring->read(pcm,frames);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&then);
+    if((file_sndfile!=NULL)&&
+       (sf_writef_float(file_sndfile,pcm,n)!=(sf_count_t)n)&&
+       (file_write_error==0)) {
+      file_write_error=sf_error(file_sndfile);
+      fprintf(stderr,"error writing \"%s\" [%s]\n",
+	      (const char *)file_file_name.toUtf8(),
+	      sf_strerror(file_sndfile));
+    }
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    if(in_place) {
+      ring->commitRead(n);
+    }
+    usecs=(now.tv_sec-then.tv_sec)*1000000+
+      (now.tv_nsec-then.tv_nsec)/1000;
+    file_write_usecs=usecs;
+    if(usecs>file_max_write_usecs) {
+      file_max_write_usecs=usecs;
+    }
+    file_frames_processed+=n;
+
+    //
+    // Segment boundary
+    //
+    if((file_segment_frames>0)&&((file_segment_remaining-=n)==0)) {
+      CloseFile();
+      file_segment_remaining=file_segment_frames;
+      file_segment_time+=file_segment_secs;
+      file_segment_failed=false;
+    }
   }
 }
@@ -21,10 +21,20 @@
 #ifndef DEV_FILE_H
 #define DEV_FILE_H
 
+#include <pthread.h>
+#include <time.h>
+
+#include <atomic>
+#include <vector>
+
 #include <sndfile.h>
 
 #include "audiodevice.h"
 
+#define FILE_DEFAULT_BATCH_MSECS 1000
+#define FILE_BATCH_ALIGN 4096
+#define FILE_WAIT_INTERVAL 100
+
 class DevFile : public AudioDevice
 {
   Q_OBJECT;
@@ -43,10 +53,35 @@ class DevFile : public AudioDevice
    void loadStats(QStringList *hdrs,QStringList *values,bool is_first);
 
  private:
+  void Write();
+  SNDFILE *OpenFile(const QString &filename,QString *err);
+  void CloseFile();
+  QString SegmentName(time_t t) const;
+  friend void *FileCallback(void *ptr);
   AudioDevice::Format file_format;
+  int file_type;
   QString file_file_name;
   SNDFILE *file_sndfile;
-  uint64_t file_frames_processed;
+  int file_fd;
+  SF_INFO file_sfinfo;
+  unsigned file_segment_secs;
+  uint64_t file_segment_frames;
+  uint64_t file_segment_remaining;
+  time_t file_segment_time;
+  bool file_segment_failed;
+  std::atomic<unsigned> file_segments;
+  std::atomic<unsigned> file_failed_segments;
+  unsigned file_batch_msecs;
+  unsigned file_batch_frames;
+  unsigned file_preallocate_secs;
+  std::vector<float> file_pcm;
+  pthread_t file_pthread;
+  bool file_running;
+  std::atomic<bool> file_stopping;
+  std::atomic<uint64_t> file_frames_processed;
+  std::atomic<uint64_t> file_write_usecs;
+  std::atomic<uint64_t> file_max_write_usecs;
+  std::atomic<int> file_write_error;
 };
 
 
@@ -20,21 +20,25 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "dev_jack.h"
 #include "logging.h"
+#include "pcmkernels.h"
 
 //
-// JACK Callback
+// JACK Callbacks
 //
 #ifdef JACK
-jack_default_audio_sample_t *jack_cb_buffers[MAX_AUDIO_CHANNELS];
-float jack_cb_interleave_buffer[MAX_AUDIO_CHANNELS*RINGBUFFER_SIZE];
-
 int JackBufferSizeChanged(jack_nframes_t frames,void *arg)
 {
-  static DevJack *dev=(DevJack *)arg;
-  dev->jack_buffer_size=frames;
+  //
+  // JACK never runs this concurrently with JackProcess(), so the
+  // buffers can be swapped out from under it here
+  //
+  DevJack *dev=(DevJack *)arg;
+
+  dev->AllocateBuffers(frames);
 
   return 0;
 }
@@ -43,116 +47,133 @@ int JackBufferSizeChanged(jack_nframes_t frames,void *arg)
 int JackProcess(jack_nframes_t nframes, void *arg)
 {
   DevJack *dev=(DevJack *)arg;
-  static unsigned i;
-  static jack_nframes_t j;
-  static float pcm_s1[MAX_AUDIO_CHANNELS*RINGBUFFER_SIZE];
-  static float pcm_s2[MAX_AUDIO_CHANNELS*RINGBUFFER_SIZE];
-  static unsigned ring_frames;
-  static unsigned n;
-  static int err;
-  static unsigned pcm_start=0;
-  static int pcm_offset=0;
-  static float lvls[MAX_AUDIO_CHANNELS];
+  Ringbuffer *ring=dev->codec()->ring();
+  unsigned chans=dev->codec()->channels();
+  float *ports[MAX_AUDIO_CHANNELS];
+  float *pcm_in;
+  float *pcm_out;
+  unsigned frames;
+  unsigned want;
+  bool in_place;
+  int err;
+
+  //
+  // Get Buffers
+  //
+  for(unsigned i=0;i<chans;i++) {
+    ports[i]=(float *)jack_port_get_buffer(dev->jack_jack_ports[i],nframes);
+  }
 
   //
   // Wait for PCM Buffer to Fill
   //
   if(!dev->jack_started) {
-    if(dev->codec()->ring()->readSpace()<2*dev->codec()->samplerate()) {
+    if(ring->readSpace()<dev->prebufferFrames()) {
+      for(unsigned i=0;i<chans;i++) {
+	memset(ports[i],0,nframes*sizeof(float));
+      }
       return 0;
     }
-    dev->jack_pll_setpoint_frames=2*dev->codec()->samplerate();
+    dev->jack_clock->reset(ring->readSpace());
+    dev->jack_fifo_start=0;
+    dev->jack_fifo_frames=0;
     dev->jack_started=true;
   }
 
   //
   // Update PLL
   //
-  ring_frames=dev->codec()->ring()->readSpace();
-  if(ring_frames>dev->jack_pll_setpoint_frames) {
-    if(dev->jack_pll_offset>(-PLL_CORRECTION_LIMIT)) {
-      dev->jack_pll_offset-=PLL_CORRECTION;
-    }
-  }
-  else {
-    if(dev->jack_pll_offset<(PLL_CORRECTION_LIMIT)) {
-      dev->jack_pll_offset+=PLL_CORRECTION;
-    }
-  }
-  dev->jack_data.src_ratio=dev->jack_pll_setpoint_ratio+dev->jack_pll_offset;
-  src_set_ratio(dev->jack_src,dev->jack_data.src_ratio);
+  dev->jack_data.src_ratio=dev->jack_pll_setpoint_ratio+dev->jack_clock->
+    update(ring->readSpace(),nframes/dev->jack_pll_setpoint_ratio);
+  dev->jack_src->setRatio(dev->jack_data.src_ratio);
 
   //
-  // Get Buffers
+  // Top up the output FIFO. Whatever the SRC produced beyond the last
+  // period is still at the head of it, so only the difference is read
+  // from the codec.
   //
-  for(i=0;i<dev->codec()->channels();i++) {
-    jack_cb_buffers[i]=(jack_default_audio_sample_t *)
-      jack_port_get_buffer(dev->jack_jack_ports[i],nframes);
-  }
+  while(dev->jack_fifo_frames<nframes) {
+    want=(nframes-dev->jack_fifo_frames)/dev->jack_data.src_ratio+1;
+    if(want>dev->jack_in_frames) {
+      want=dev->jack_in_frames;
+    }
+    if(ring->readSpace()<want) {
+      //
+      // At end of stream, drain whatever is left; the rest of the
+      // period gets padded with silence below
+      //
+      if((!ring->isFinished())||((want=ring->readSpace())==0)) {
+	break;
+      }
+    }
+    if((dev->jack_fifo_start+dev->jack_fifo_frames+want*
+	dev->jack_data.src_ratio+JACK_FIFO_SLACK)>dev->jack_fifo_size) {
+      memmove(dev->jack_fifo,dev->jack_fifo+dev->jack_fifo_start*chans,
+	      dev->jack_fifo_frames*chans*sizeof(float));
+      dev->jack_fifo_start=0;
+    }
 
-  //
-  // Read Codec Output
-  //
-  n=nframes/dev->jack_data.src_ratio+pcm_offset;
-  if(dev->codec()->ring()->readSpace()>=n) {
-    n=dev->codec()->ring()->read(pcm_s1,n);
     //
-    // SRC
+    // Feed the SRC straight from the ringbuffer where the data is
+    // contiguous, falling back to a copy only when it is not
     //
-    dev->jack_data.data_in=pcm_s1;
-    dev->jack_data.input_frames=n;
-    dev->jack_data.data_out=pcm_s2+pcm_start*dev->codec()->channels();
+    frames=want;
+    pcm_in=ring->peekContiguous(&frames);
+    if(!(in_place=(frames>0))) {
+      pcm_in=dev->jack_pcm_in;
+      frames=ring->read(dev->jack_pcm_in,want);
+    }
+    dev->jack_data.data_in=pcm_in;
+    dev->jack_data.input_frames=frames;
+    dev->jack_data.data_out=dev->jack_fifo+
+      (dev->jack_fifo_start+dev->jack_fifo_frames)*chans;
     dev->jack_data.output_frames=
-      MAX_AUDIO_CHANNELS*RINGBUFFER_SIZE/dev->codec()->channels()-pcm_start;
-    dev->jack_play_position+=n;
-    if((err=src_process(dev->jack_src,&dev->jack_data))<0) {
+      dev->jack_fifo_size-dev->jack_fifo_start-dev->jack_fifo_frames;
+    if((err=dev->jack_src->process(&dev->jack_data))<0) {
       fprintf(stderr,"SRC processing error [%s]\n",src_strerror(err));
       exit(GLASS_EXIT_SRC_ERROR);
     }
-    n=dev->jack_data.output_frames_gen+pcm_start;
-
-    //
-    // De-interleave Channels and Write to Jack Buffers
-    //
-    for(i=0;i<dev->codec()->channels();i++) {
-      if(jack_cb_buffers[i]!=NULL) {
-	for(j=0;j<nframes;j++) {
-	  jack_cb_buffers[i][j]=pcm_s2[dev->codec()->channels()*j+i];
-	}
-      }
+    if(in_place) {
+      ring->commitRead(dev->jack_data.input_frames_used);
     }
-
-    //
-    // Update Meters
-    //
-    dev->peakLevels(lvls,pcm_s2,nframes,dev->codec()->channels());
-    for(i=0;i<dev->codec()->channels();i++) {
-      dev->jack_meter_avg[i]->addValue(lvls[i]);
+    dev->jack_play_position+=dev->jack_data.input_frames_used;
+    dev->jack_fifo_frames+=dev->jack_data.output_frames_gen;
+    if(dev->jack_data.input_frames_used==0) {
+      break;
     }
-    dev->setMeterLevels(lvls);
+  }
+
+  //
+  // De-interleave Channels and Write to Jack Buffers
+  //
+  frames=dev->jack_fifo_frames;
+  if(frames>nframes) {
+    frames=nframes;
+  }
+  pcm_out=dev->jack_fifo+dev->jack_fifo_start*chans;
+  PcmDeinterleave(ports,pcm_out,chans,frames);
+  dev->meterPcm(pcm_out,frames,chans);
+  dev->jack_fifo_start+=frames;
+  dev->jack_fifo_frames-=frames;
+  if(dev->jack_fifo_frames==0) {
+    dev->jack_fifo_start=0;
+  }
 
+  if(frames<nframes) {
     //
-    // Move left-overs to start of buffer
+    // Underrun, so pad with silence and go back to prebuffering
     //
-    if(n>nframes) {
-      pcm_start=n-nframes;
-      for(i=0;i<pcm_start;i++) {
-	for(j=0;j<dev->codec()->channels();j++) {
-	  pcm_s2[dev->codec()->channels()*i+j]=
-	    pcm_s2[(nframes+i)*dev->codec()->channels()+j];
-	}
-      }
-    }
-    else {
-      pcm_start=0;
+    for(unsigned i=0;i<chans;i++) {
+      memset(ports[i]+frames,0,(nframes-frames)*sizeof(float));
     }
-    if(pcm_start<2) {
-      pcm_offset=1;
-    }
-    else {
-      pcm_offset=0;
+    if(!ring->isFinished()) {
+      dev->prebufferUnderrun();
+      dev->jack_started=false;
     }
   }
+  else {
+    dev->firstSampleOutput();
+  }
 
   return 0;
 }
@@ -165,6 +186,15 @@ DevJack::DevJack(unsigned pregap,Codec *codec,QObject *parent)
 #ifdef JACK
   jack_jack_client=NULL;
   jack_src=NULL;
+  jack_clock=NULL;
+  jack_pcm_in=NULL;
+  jack_fifo=NULL;
+  jack_in_frames=0;
+  jack_fifo_size=0;
+  jack_fifo_start=0;
+  jack_fifo_frames=0;
+  jack_buffer_size=0;
+  jack_pll_setpoint_ratio=1.0;
   jack_server_name="";
   jack_client_name=DEFAULT_JACK_CLIENT_NAME;
   jack_started=false;
@@ -172,9 +202,6 @@ DevJack::DevJack(unsigned pregap,Codec *codec,QObject *parent)
   //
   // Metering
   //
-  for(int i=0;i<MAX_AUDIO_CHANNELS;i++) {
-    jack_meter_avg[i]=new MeterAverage(8);
-  }
   jack_meter_timer=new QTimer(this);
   connect(jack_meter_timer,SIGNAL(timeout()),this,SLOT(meterData()));
 
@@ -194,13 +221,14 @@ DevJack::~DevJack()
   }
   delete jack_play_position_timer;
   delete jack_meter_timer;
-  for(int i=0;i<MAX_AUDIO_CHANNELS;i++) {
-    delete jack_meter_avg[i];
-  }
   if(jack_src!=NULL) {
-    src_delete(jack_src);
+    delete jack_src;
   }
-  
+  if(jack_clock!=NULL) {
+    delete jack_clock;
+  }
+  delete[] jack_fifo;
+  delete[] jack_pcm_in;
 #endif  // JACK
 }
 
@@ -298,13 +326,6 @@ bool DevJack::start(QString *err)
   jack_set_buffer_size_callback(jack_jack_client,JackBufferSizeChanged,this);
   jack_set_process_callback(jack_jack_client,JackProcess,this);
 
-  //
-  // Join the Graph
-  //
-  if(jack_activate(jack_jack_client)) {
-    *err=tr("unable to join JACK graph");
-    return false;
-  }
   jack_jack_sample_rate=jack_get_sample_rate(jack_jack_client);
 
   //
@@ -315,9 +336,11 @@ bool DevJack::start(QString *err)
     jack_jack_ports[i]=
       jack_port_register(jack_jack_client,name.toUtf8(),JACK_DEFAULT_AUDIO_TYPE,
 			 JackPortIsOutput|JackPortIsTerminal,0);
+    if(jack_jack_ports[i]==NULL) {
+      *err=tr("unable to register JACK port")+" \""+name+"\"";
+      return false;
+    }
   }
-  Log(LOG_INFO,QString().sprintf("connected to JACK graph at %u samples/sec.",
-				 jack_jack_sample_rate));
 
   //  jack_meter_timer->start(AUDIO_METER_INTERVAL);
 
@@ -328,13 +351,28 @@ bool DevJack::start(QString *err)
     (double)jack_jack_sample_rate/(double)codec()->samplerate();
   memset(&jack_data,0,sizeof(jack_data));
   jack_data.src_ratio=jack_pll_setpoint_ratio;
-  if((jack_src=src_new(SRC_LINEAR,codec()->channels(),&srcerr))==NULL) {
+  jack_src=new Resampler(srcQuality(),codec()->channels(),
+			 jack_pll_setpoint_ratio,0,&srcerr);
+  if(srcerr!=0) {
     fprintf(stderr,"SRC initialization error [%s]\n",src_strerror(srcerr));
     exit(GLASS_EXIT_SRC_ERROR);
   }
   jack_play_position=0;
-  jack_pll_setpoint_frames=0;
-  jack_pll_offset=0.0;
+  jack_clock=new ClockRecovery(codec()->samplerate());
+  AllocateBuffers(jack_get_buffer_size(jack_jack_client));
+
+  //
+  // Join the Graph
+  //
+  // Everything JackProcess() touches must be in place before this, as
+  // a short prebuffer can have it producing audio on the first cycle.
+  //
+  if(jack_activate(jack_jack_client)) {
+    *err=tr("unable to join JACK graph");
+    return false;
+  }
+  Log(LOG_INFO,QString().sprintf("connected to JACK graph at %u samples/sec.",
+				 jack_jack_sample_rate));
 
   jack_play_position_timer->start(50);
   jack_meter_timer->start(AUDIO_METER_INTERVAL);
@@ -365,15 +403,56 @@ void DevJack::loadStats(QStringList *hdrs,QStringList *values,bool is_first)
   hdrs->push_back("Device|Frames Played");
   values->push_back(QString().sprintf("%lu",jack_play_position));
 
-  hdrs->push_back("Device|PLL Offset");
-  values->push_back(QString().sprintf("%8.6lf",jack_pll_offset));
+  if(jack_clock!=NULL) {
+    hdrs->push_back("Device|PLL Offset");
+    values->push_back(QString().sprintf("%8.6lf",jack_clock->offset()));
 
-  hdrs->push_back("Device|PLL Setpoint Frames");
-  values->push_back(QString().sprintf("%u",jack_pll_setpoint_frames));
+    hdrs->push_back("Device|PLL Drift");
+    values->push_back(QString().sprintf("%8.6lf",jack_clock->drift()));
+
+    hdrs->push_back("Device|PLL Setpoint Frames");
+    values->push_back(QString().sprintf("%u",jack_clock->setpointFrames()));
+
+    hdrs->push_back("Device|PLL Filtered Frames");
+    values->push_back(QString().sprintf("%u",jack_clock->filteredFrames()));
+  }
 #endif  // JACK
 }
 
 
+#ifdef JACK
+void DevJack::AllocateBuffers(jack_nframes_t frames)
+{
+  //
+  // Size for one period at the largest ratio the clock recovery can ask
+  // for, so the process callback never has to allocate
+  //
+  unsigned in_frames=(double)frames*(1.0+PLL_CORRECTION_LIMIT)/
+    jack_pll_setpoint_ratio+JACK_FIFO_SLACK;
+  unsigned fifo_size=2*(frames+JACK_FIFO_SLACK);
+
+  jack_buffer_size=frames;
+  if(in_frames>jack_in_frames) {
+    delete[] jack_pcm_in;
+    jack_pcm_in=new float[in_frames*codec()->channels()];
+    jack_in_frames=in_frames;
+    jack_src->reserve(in_frames);
+  }
+  if(fifo_size>jack_fifo_size) {
+    float *fifo=new float[fifo_size*codec()->channels()];
+    if(jack_fifo!=NULL) {
+      memcpy(fifo,jack_fifo+jack_fifo_start*codec()->channels(),
+	     jack_fifo_frames*codec()->channels()*sizeof(float));
+    }
+    delete[] jack_fifo;
+    jack_fifo=fifo;
+    jack_fifo_size=fifo_size;
+    jack_fifo_start=0;
+  }
+}
+#endif  // JACK
+
+
 void DevJack::playPositionData()
 {
 #ifdef JACK
@@ -387,9 +466,8 @@ void DevJack::meterData()
 #ifdef JACK
   float lvls[MAX_AUDIO_CHANNELS];
 
-  for(unsigned i=0;i<codec()->channels();i++) {
-    lvls[i]=jack_meter_avg[i]->average();
+  if(collectMeterLevels(lvls)) {
+    setMeterLevels(lvls);
   }
-  setMeterLevels(lvls);
 #endif  // JACK
 }
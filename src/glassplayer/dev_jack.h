@@ -30,10 +30,16 @@
 #include <QTimer>
 
 #include "audiodevice.h"
-#include "meteraverage.h"
+#include "clockrecovery.h"
+#include "resampler.h"
 
 #define DEFAULT_JACK_CLIENT_NAME "glassplayer"
 
+//
+// Extra frames of headroom in the per-period SRC buffers
+//
+#define JACK_FIFO_SLACK 16
+
 class DevJack : public AudioDevice
 {
   Q_OBJECT;
@@ -58,15 +64,20 @@ class DevJack : public AudioDevice
   jack_nframes_t jack_jack_sample_rate;
   jack_nframes_t jack_buffer_size;
   jack_port_t *jack_jack_ports[MAX_AUDIO_CHANNELS];
-  MeterAverage *jack_meter_avg[MAX_AUDIO_CHANNELS];
   QTimer *jack_meter_timer;
   friend int JackBufferSizeChanged(jack_nframes_t frames, void *arg);
   friend int JackProcess(jack_nframes_t nframes, void *arg);
-  SRC_STATE *jack_src;
+  void AllocateBuffers(jack_nframes_t frames);
+  float *jack_pcm_in;
+  unsigned jack_in_frames;
+  float *jack_fifo;
+  unsigned jack_fifo_size;
+  unsigned jack_fifo_start;
+  unsigned jack_fifo_frames;
+  Resampler *jack_src;
   SRC_DATA jack_data;
-  double jack_pll_offset;
+  ClockRecovery *jack_clock;
   double jack_pll_setpoint_ratio;
-  unsigned jack_pll_setpoint_frames;
   uint64_t jack_play_position;
   QTimer *jack_play_position_timer;
   bool jack_started;
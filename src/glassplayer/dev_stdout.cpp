@@ -18,20 +18,62 @@
 //   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 //
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "dev_stdout.h"
+#include "logging.h"
+
+//
+// Drop the first 'n' bytes from an iovec array
+//
+static void AdvanceIovec(struct iovec **iov,int *iovcnt,size_t n)
+{
+  while((*iovcnt>0)&&(n>=(*iov)->iov_len)) {
+    n-=(*iov)->iov_len;
+    (*iov)++;
+    (*iovcnt)--;
+  }
+  if(*iovcnt>0) {
+    (*iov)->iov_base=(char *)(*iov)->iov_base+n;
+    (*iov)->iov_len-=n;
+  }
+}
+
 
 DevStdout::DevStdout(unsigned pregap,Codec *codec,QObject *parent)
   : AudioDevice(pregap,codec,parent)
 {
   stdout_format=AudioDevice::S16_LE;
+  stdout_nonblocking=false;
+  stdout_fifo_msecs=STDOUT_DEFAULT_FIFO_MSECS;
+  stdout_fifo=NULL;
+  stdout_fifo_size=0;
+  stdout_frame_bytes=1;
+  stdout_bytes_accepted=0;
+  stdout_notifier=NULL;
+  stdout_flags=-1;
+  stdout_bytes_written=0;
+  stdout_bytes_dropped=0;
+  stdout_bytes_dropped_logged=0;
+  stdout_drop_log_time=0;
 }
 
 
 DevStdout::~DevStdout()
 {
+  if(stdout_notifier!=NULL) {
+    delete stdout_notifier;
+  }
+  if(stdout_flags>=0) {
+    fcntl(1,F_SETFL,stdout_flags);
+  }
+  if(stdout_fifo!=NULL) {
+    glass_ringbuffer_free(stdout_fifo);
+  }
 }
 
 
@@ -41,22 +83,24 @@ bool DevStdout::processOptions(QString *err,const QStringList &keys,
   for(int i=0;i<keys.size();i++) {
     bool processed=false;
     if(keys[i]=="--stdout-format") {
-      if(values[i].toLower()=="float") {
-	stdout_format=AudioDevice::FLOAT;
-	processed=true;
-      }
-      if(values[i].toLower()=="s16_le") {
-	stdout_format=AudioDevice::S16_LE;
-	processed=true;
-      }
-      if(values[i].toLower()=="s32_le") {
-	stdout_format=AudioDevice::S32_LE;
-	processed=true;
-      }
-      if(!processed) {
+      stdout_format=AudioDevice::format(values[i]);
+      if(stdout_format==AudioDevice::LastFormat) {
 	*err=tr("invalid --stdout-format value");
 	return false;
       }
+      processed=true;
+    }
+    if(keys[i]=="--stdout-nonblocking") {
+      stdout_nonblocking=true;
+      if(!values[i].isEmpty()) {
+	bool ok=false;
+	stdout_fifo_msecs=values[i].toUInt(&ok);
+	if((!ok)||(stdout_fifo_msecs==0)) {
+	  *err=tr("invalid argument to --stdout-nonblocking");
+	  return false;
+	}
+      }
+      processed=true;
     }
     if(!processed) {
       *err=tr("unrecognized option")+" "+keys[i]+"\"";
@@ -69,48 +113,90 @@ bool DevStdout::processOptions(QString *err,const QStringList &keys,
 
 bool DevStdout::start(QString *err)
 {
+  stdout_frame_bytes=codec()->channels()*formatSize(stdout_format);
+  if(stdout_nonblocking) {
+    if((stdout_flags=fcntl(1,F_GETFL))<0) {
+      *err=tr("unable to get standard output flags")+" ["+
+	strerror(errno)+"]";
+      return false;
+    }
+    if(fcntl(1,F_SETFL,stdout_flags|O_NONBLOCK)<0) {
+      *err=tr("unable to make standard output non-blocking")+" ["+
+	strerror(errno)+"]";
+      stdout_flags=-1;
+      return false;
+    }
+    //
+    // A whole number of frames, so that dropping a block never leaves a
+    // partial frame in the stream
+    //
+    stdout_fifo_size=stdout_frame_bytes*
+      ((uint64_t)stdout_fifo_msecs*codec()->samplerate()/1000);
+    if(stdout_fifo_size<stdout_frame_bytes) {
+      stdout_fifo_size=stdout_frame_bytes;
+    }
+    stdout_fifo=glass_ringbuffer_create(stdout_fifo_size+1);
+    stdout_notifier=new QSocketNotifier(1,QSocketNotifier::Write,this);
+    stdout_notifier->setEnabled(false);
+    connect(stdout_notifier,SIGNAL(activated(int)),
+	    this,SLOT(writeReadyData(int)));
+  }
   return true;
 }
 
 
 void DevStdout::synchronousWrite(unsigned frames,bool is_last)
 {
-  float pcm[frames*codec()->channels()];
-  int16_t *pcm16;
-  int32_t *pcm32;
-  ssize_t blocksize=0;
-  ssize_t n=0;
-  
-  codec()->ring()->read(pcm,frames);
-  switch(stdout_format) {
-  case AudioDevice::FLOAT:
-    blocksize=frames*codec()->channels()*sizeof(float);
-    n=write(1,pcm,blocksize);
-    break;
-
-  case AudioDevice::S16_LE:
-    pcm16=new int16_t[frames*codec()->channels()];
-    convertFromFloat(pcm16,pcm,frames,codec()->channels());
-    blocksize=frames*codec()->channels()*sizeof(int16_t);
-    n=write(1,pcm16,blocksize);
-    delete pcm16;
-    break;
-
-  case AudioDevice::S32_LE:
-    pcm32=new int32_t[frames*codec()->channels()];
-    convertFromFloat(pcm32,pcm,frames,codec()->channels());
-    blocksize=frames*codec()->channels()*sizeof(int32_t);
-    n=write(1,pcm32,blocksize);
-    delete pcm32;
-    break;
-
-  case AudioDevice::LastFormat:
-    break;
-  }
-  if(n!=blocksize) {
-    fprintf(stderr,"xrun: lost %ld bytes\n",blocksize-n);
+  Ringbuffer *ring=codec()->ring();
+  unsigned chans=codec()->channels();
+  glass_ringbuffer_data_t vec[2];
+  struct iovec iov[2];
+  float *pcm;
+  unsigned n;
+  bool in_place;
+
+  if(stdout_format==AudioDevice::FLOAT) {
+    //
+    // Nothing to convert, so hand the ringbuffer's own memory to the
+    // kernel
+    //
+    n=ring->peekVector(vec,frames);
+    for(int i=0;i<2;i++) {
+      iov[i].iov_base=vec[i].buf;
+      iov[i].iov_len=vec[i].len;
+    }
+    Output(iov,vec[1].len>0?2:1);
+    ring->commitRead(n);
+  }
+  else {
+    size_t frame_bytes=chans*formatSize(stdout_format);
+    if(stdout_buffer.size()<(frames*frame_bytes)) {
+      stdout_buffer.resize(frames*frame_bytes);
+    }
+    while(frames>0) {
+      n=frames;
+      pcm=ring->peekContiguous(&n);
+      if(!(in_place=(n>0))) {
+	if(stdout_pcm.size()<(frames*chans)) {
+	  stdout_pcm.resize(frames*chans);
+	}
+	pcm=stdout_pcm.data();
+	if((n=ring->read(pcm,frames))==0) {
+	  break;
+	}
+      }
+      convertFromFloat(stdout_buffer.data(),stdout_format,pcm,n,chans);
+      if(in_place) {
+	ring->commitRead(n);
+      }
+      iov[0].iov_base=stdout_buffer.data();
+      iov[0].iov_len=n*frame_bytes;
+      Output(iov,1);
+      frames-=n;
+    }
   }
   if(is_last) {
+    Flush();
     exit(0);
   }
 }
@@ -121,5 +207,158 @@ void DevStdout::loadStats(QStringList *hdrs,QStringList *values,bool is_first)
   if(is_first) {
     hdrs->push_back("Device|Type");
     values->push_back("STDOUT");
+
+    hdrs->push_back("Device|Sample Format");
+    values->push_back(AudioDevice::formatString(stdout_format));
+  }
+  hdrs->push_back("Device|Bytes Written");
+  values->push_back(QString().sprintf("%lu",stdout_bytes_written));
+
+  if(stdout_fifo!=NULL) {
+    hdrs->push_back("Device|Output FIFO Bytes");
+    values->push_back(QString().sprintf("%lu",
+			glass_ringbuffer_read_space(stdout_fifo)));
+
+    hdrs->push_back("Device|Bytes Dropped");
+    values->push_back(QString().sprintf("%lu",stdout_bytes_dropped));
+  }
+}
+
+
+void DevStdout::writeReadyData(int fd)
+{
+  Drain();
+}
+
+
+void DevStdout::Output(struct iovec *iov,int iovcnt)
+{
+  ssize_t n;
+
+  //
+  // Anything still queued has to go out first
+  //
+  if((stdout_fifo!=NULL)&&(glass_ringbuffer_read_space(stdout_fifo)>0)) {
+    Enqueue(iov,iovcnt);
+    Drain();
+    return;
+  }
+  while(iovcnt>0) {
+    if((n=writev(1,iov,iovcnt))<0) {
+      if(errno==EINTR) {
+	continue;
+      }
+      if(((errno==EAGAIN)||(errno==EWOULDBLOCK))&&(stdout_fifo!=NULL)) {
+	Enqueue(iov,iovcnt);
+	stdout_notifier->setEnabled(true);
+	return;
+      }
+      for(int i=0;i<iovcnt;i++) {
+	Dropped(iov[i].iov_len);
+      }
+      return;
+    }
+    stdout_bytes_written+=n;
+    stdout_bytes_accepted+=n;
+    AdvanceIovec(&iov,&iovcnt,n);
+  }
+}
+
+
+void DevStdout::Enqueue(const struct iovec *iov,int iovcnt)
+{
+  //
+  // Queue the whole block or none of it. A short writev() can have
+  // left a frame half written though, and the rest of that frame has
+  // to go out regardless or everything after it would be misaligned;
+  // that only happens with the FIFO empty, so there is always room.
+  //
+  size_t total=0;
+  size_t n;
+  size_t head=
+    (stdout_frame_bytes-stdout_bytes_accepted%stdout_frame_bytes)%
+    stdout_frame_bytes;
+  size_t space=stdout_fifo_size-glass_ringbuffer_read_space(stdout_fifo);
+
+  for(int i=0;i<iovcnt;i++) {
+    total+=iov[i].iov_len;
+  }
+  if(total>space) {
+    Dropped(total-head);
+    total=head;
+  }
+  stdout_bytes_accepted+=total;
+  for(int i=0;(i<iovcnt)&&(total>0);i++) {
+    n=iov[i].iov_len<total?iov[i].iov_len:total;
+    glass_ringbuffer_write(stdout_fifo,(const char *)iov[i].iov_base,n);
+    total-=n;
+  }
+}
+
+
+void DevStdout::Dropped(uint64_t bytes)
+{
+  //
+  // Counted for the stats, and logged now and then rather than for
+  // every block
+  //
+  time_t now=time(NULL);
+
+  stdout_bytes_dropped+=bytes;
+  if((now-stdout_drop_log_time)>=STDOUT_DROP_LOG_INTERVAL) {
+    Log(LOG_WARNING,tr("standard output is not keeping up")+
+	QString().sprintf(", %lu bytes dropped",
+			  stdout_bytes_dropped-stdout_bytes_dropped_logged));
+    stdout_bytes_dropped_logged=stdout_bytes_dropped;
+    stdout_drop_log_time=now;
+  }
+}
+
+
+void DevStdout::Drain()
+{
+  glass_ringbuffer_data_t vec[2];
+  struct iovec iov[2];
+  ssize_t n;
+
+  while(glass_ringbuffer_read_space(stdout_fifo)>0) {
+    glass_ringbuffer_get_read_vector(stdout_fifo,vec);
+    for(int i=0;i<2;i++) {
+      iov[i].iov_base=vec[i].buf;
+      iov[i].iov_len=vec[i].len;
+    }
+    if((n=writev(1,iov,vec[1].len>0?2:1))<0) {
+      if(errno==EINTR) {
+	continue;
+      }
+      if((errno==EAGAIN)||(errno==EWOULDBLOCK)) {
+	stdout_notifier->setEnabled(true);
+	return;
+      }
+      Log(LOG_WARNING,QString("error writing to standard output [")+
+	  strerror(errno)+"]");
+      Dropped(glass_ringbuffer_read_space(stdout_fifo));
+      glass_ringbuffer_reset(stdout_fifo);
+      break;
+    }
+    stdout_bytes_written+=n;
+    glass_ringbuffer_read_advance(stdout_fifo,n);
+  }
+  stdout_notifier->setEnabled(false);
+}
+
+
+void DevStdout::Flush()
+{
+  //
+  // Go back to blocking so that the rest of the FIFO goes out before we
+  // exit
+  //
+  if(stdout_flags>=0) {
+    fcntl(1,F_SETFL,stdout_flags);
+    stdout_flags=-1;
+  }
+  if(stdout_fifo!=NULL) {
+    Drain();
   }
 }
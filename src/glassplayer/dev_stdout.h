@@ -21,7 +21,18 @@
 #ifndef DEV_STDOUT_H
 #define DEV_STDOUT_H
 
+#include <sys/uio.h>
+#include <time.h>
+
+#include <vector>
+
+#include <QSocketNotifier>
+
 #include "audiodevice.h"
+#include "ringbuffer.h"
+
+#define STDOUT_DEFAULT_FIFO_MSECS 5000
+#define STDOUT_DROP_LOG_INTERVAL 10
 
 class DevStdout : public AudioDevice
 {
@@ -39,8 +50,30 @@ class DevStdout : public AudioDevice
  protected:
    void loadStats(QStringList *hdrs,QStringList *values,bool is_first);
 
+ private slots:
+  void writeReadyData(int fd);
+
  private:
+  void Output(struct iovec *iov,int iovcnt);
+  void Enqueue(const struct iovec *iov,int iovcnt);
+  void Dropped(uint64_t bytes);
+  void Drain();
+  void Flush();
   AudioDevice::Format stdout_format;
+  std::vector<char> stdout_buffer;
+  std::vector<float> stdout_pcm;
+  bool stdout_nonblocking;
+  unsigned stdout_fifo_msecs;
+  glass_ringbuffer_t *stdout_fifo;
+  size_t stdout_fifo_size;
+  size_t stdout_frame_bytes;
+  uint64_t stdout_bytes_accepted;
+  QSocketNotifier *stdout_notifier;
+  int stdout_flags;
+  uint64_t stdout_bytes_written;
+  uint64_t stdout_bytes_dropped;
+  uint64_t stdout_bytes_dropped_logged;
+  time_t stdout_drop_log_time;
 };
 
 
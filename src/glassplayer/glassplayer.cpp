@@ -53,6 +53,7 @@ MainObject::MainObject(QObject *parent)
 {
   sir_connector=NULL;
   sir_codec=NULL;
+  sir_decode_worker=NULL;
   sir_ring=NULL;
   sir_audio_device=NULL;
   sir_meter_data=false;
@@ -62,9 +63,19 @@ MainObject::MainObject(QObject *parent)
 
   audio_device_type=DEFAULT_AUDIO_DEVICE;
   dump_bitstream=false;
+  decode_thread=false;
+  buffer_msecs=0;
+  max_latency_msecs=0;
   list_codecs=false;
   list_devices=false;
   pregap=0;
+  prebuffer_msecs=0;
+  adaptive_prebuffer=false;
+  receive_buffer_size=0;
+  min_chunk_bytes=0;
+  server_cache_ttl=0;
+  http_read_window=0;
+  src_quality=AudioDevice::SrcLinear;
   sir_stats_out=false;
   sir_metadata_out=false;
   sir_json=false;
@@ -81,6 +92,10 @@ MainObject::MainObject(QObject *parent)
     exit(GLASS_EXIT_ARGUMENT_ERROR);
   }
   for(unsigned i=0;i<(cmd->keys()-1);i++) {
+    if(cmd->key(i)=="--adaptive-prebuffer") {
+      adaptive_prebuffer=true;
+      cmd->setProcessed(i,true);
+    }
     if(cmd->key(i)=="--audio-device") {
       for(int j=0;j<AudioDevice::LastType;j++) {
 	if(cmd->value(i).toLower()==
@@ -90,6 +105,18 @@ MainObject::MainObject(QObject *parent)
 	}
       }
     }
+    if(cmd->key(i)=="--buffer-ms") {
+      buffer_msecs=cmd->value(i).toUInt(&ok);
+      if((!ok)||(buffer_msecs==0)) {
+	fprintf(stderr,"glassplayer: invalid argument to --buffer-ms\n");
+	exit(GLASS_EXIT_ARGUMENT_ERROR);
+      }
+      cmd->setProcessed(i,true);
+    }
+    if(cmd->key(i)=="--decode-thread") {
+      decode_thread=true;
+      cmd->setProcessed(i,true);
+    }
     if(cmd->key(i)=="--dump-bitstream") {
       dump_bitstream=true;
       cmd->setProcessed(i,true);
@@ -98,6 +125,15 @@ MainObject::MainObject(QObject *parent)
       dump_headers=true;
       cmd->setProcessed(i,true);
     }
+    if(cmd->key(i)=="--http-read-window") {
+      http_read_window=cmd->value(i).toUInt(&ok);
+      if(!ok) {
+	fprintf(stderr,
+		"glassplayer: invalid argument to --http-read-window\n");
+	exit(GLASS_EXIT_ARGUMENT_ERROR);
+      }
+      cmd->setProcessed(i,true);
+    }
     if(cmd->key(i)=="--json") {
       sir_json=true;
       cmd->setProcessed(i,true);
@@ -110,6 +146,14 @@ MainObject::MainObject(QObject *parent)
       list_devices=true;
       cmd->setProcessed(i,true);
     }
+    if(cmd->key(i)=="--max-latency-ms") {
+      max_latency_msecs=cmd->value(i).toUInt(&ok);
+      if((!ok)||(max_latency_msecs==0)) {
+	fprintf(stderr,"glassplayer: invalid argument to --max-latency-ms\n");
+	exit(GLASS_EXIT_ARGUMENT_ERROR);
+      }
+      cmd->setProcessed(i,true);
+    }
     if(cmd->key(i)=="--metadata-out") {
       sir_metadata_out=true;
       cmd->setProcessed(i,true);
@@ -118,10 +162,27 @@ MainObject::MainObject(QObject *parent)
       sir_meter_data=true;
       cmd->setProcessed(i,true);
     }
+    if(cmd->key(i)=="--min-chunk-bytes") {
+      min_chunk_bytes=cmd->value(i).toUInt(&ok);
+      if(!ok) {
+	fprintf(stderr,
+		"glassplayer: invalid argument to --min-chunk-bytes\n");
+	exit(GLASS_EXIT_ARGUMENT_ERROR);
+      }
+      cmd->setProcessed(i,true);
+    }
     if(cmd->key(i)=="--post-data") {
       post_data=cmd->value(i);
       cmd->setProcessed(i,true);
     }
+    if(cmd->key(i)=="--prebuffer-ms") {
+      prebuffer_msecs=cmd->value(i).toUInt(&ok);
+      if((!ok)||(prebuffer_msecs==0)) {
+	fprintf(stderr,"glassplayer: invalid argument to --prebuffer-ms\n");
+	exit(GLASS_EXIT_ARGUMENT_ERROR);
+      }
+      cmd->setProcessed(i,true);
+    }
     if(cmd->key(i)=="--pregap") {
       pregap=cmd->value(i).toUInt(&ok);
       if(!ok) {
@@ -130,6 +191,24 @@ MainObject::MainObject(QObject *parent)
       }
       cmd->setProcessed(i,true);
     }
+    if(cmd->key(i)=="--receive-buffer-size") {
+      receive_buffer_size=cmd->value(i).toUInt(&ok);
+      if(!ok) {
+	fprintf(stderr,
+		"glassplayer: invalid argument to --receive-buffer-size\n");
+	exit(GLASS_EXIT_ARGUMENT_ERROR);
+      }
+      cmd->setProcessed(i,true);
+    }
+    if(cmd->key(i)=="--server-cache-ttl") {
+      server_cache_ttl=cmd->value(i).toUInt(&ok);
+      if(!ok) {
+	fprintf(stderr,
+		"glassplayer: invalid argument to --server-cache-ttl\n");
+	exit(GLASS_EXIT_ARGUMENT_ERROR);
+      }
+      cmd->setProcessed(i,true);
+    }
     if(cmd->key(i)=="--server-script-down") {
       sir_server_script_down=cmd->value(i);
       cmd->setProcessed(i,true);
@@ -138,6 +217,14 @@ MainObject::MainObject(QObject *parent)
       sir_server_script_up=cmd->value(i);
       cmd->setProcessed(i,true);
     }
+    if(cmd->key(i)=="--src-quality") {
+      src_quality=AudioDevice::srcQuality(cmd->value(i));
+      if(src_quality==AudioDevice::SrcLastQuality) {
+	fprintf(stderr,"glassplayer: invalid argument to --src-quality\n");
+	exit(GLASS_EXIT_ARGUMENT_ERROR);
+      }
+      cmd->setProcessed(i,true);
+    }
     if(cmd->key(i)=="--stats-out") {
       sir_stats_out=true;
       cmd->setProcessed(i,true);
@@ -159,6 +246,37 @@ MainObject::MainObject(QObject *parent)
       device_values.push_back(cmd->value(i));
     }
   }
+
+  //
+  // The decoder ring must hold the initial prebuffer plus a device
+  // period, so that output can start without stalling the decoder
+  //
+  unsigned min_buffer_msecs=AUDIO_DEFAULT_PREBUFFER_MSECS;
+  if(prebuffer_msecs>0) {
+    min_buffer_msecs=prebuffer_msecs;
+  }
+  else {
+    if(adaptive_prebuffer) {
+      min_buffer_msecs=AUDIO_ADAPTIVE_PREBUFFER_MSECS;
+    }
+  }
+  min_buffer_msecs+=AUDIO_MAX_PERIOD_MSECS;
+  if((buffer_msecs>0)&&(buffer_msecs<min_buffer_msecs)) {
+    fprintf(stderr,"glassplayer: --buffer-ms must be at least %u\n",
+	    min_buffer_msecs);
+    exit(GLASS_EXIT_ARGUMENT_ERROR);
+  }
+  if((max_latency_msecs>0)&&(max_latency_msecs<min_buffer_msecs)) {
+    fprintf(stderr,"glassplayer: --max-latency-ms must be at least %u\n",
+	    min_buffer_msecs);
+    exit(GLASS_EXIT_ARGUMENT_ERROR);
+  }
+  if((buffer_msecs>0)&&(max_latency_msecs>0)&&
+     (max_latency_msecs<buffer_msecs)) {
+    fprintf(stderr,
+	    "glassplayer: --max-latency-ms is less than --buffer-ms\n");
+    exit(GLASS_EXIT_ARGUMENT_ERROR);
+  }
   if(cmd->key(cmd->keys()-1)=="--list-codecs") {
     list_codecs=true;
   }
@@ -242,6 +360,8 @@ MainObject::MainObject(QObject *parent)
 	  this,
 	  SLOT(serverTypeFoundData(Connector::ServerType,const QString &,
 				   const QUrl &)));
+  sir_server_id->setStreamMetadataEnabled(sir_metadata_out);
+  sir_server_id->setCacheTtl(server_cache_ttl);
   sir_server_id->connectToServer(server_url,post_data,sir_user,sir_password);
 }
 
@@ -249,6 +369,9 @@ MainObject::MainObject(QObject *parent)
 void MainObject::serverTypeFoundData(Connector::ServerType type,
 				     const QString &mimetype,const QUrl &url)
 {
+  QTcpSocket *sock=NULL;
+  QByteArray data;
+
   //  printf("serverTypeFound(%d,%s,%s)\n",type,
   //  	 mimetype.toUtf8().constData(),url.toString().toUtf8().constData());
   sir_connector=ConnectorFactory(type,mimetype,this);
@@ -256,11 +379,24 @@ void MainObject::serverTypeFoundData(Connector::ServerType type,
   connect(sir_connector,SIGNAL(connected(bool)),
 	  this,SLOT(serverConnectedData(bool)));
   sir_connector->setServerUrl(url);
+  sir_connector->setPrebufferMsecs(prebuffer_msecs);
+  sir_connector->setReceiveBufferSize(receive_buffer_size);
+  sir_connector->setMinimumChunkSize(min_chunk_bytes);
+  sir_connector->setReadWindowSize(http_read_window);
   sir_connector->setServerUsername(sir_user);
   sir_connector->setServerPassword(sir_password);
   sir_connector->setPublicUrl(server_url);
   sir_connector->setPostData(post_data);
   sir_connector->setDumpHeaders(dump_headers);
+
+  //
+  // Reuse the probe connection if the connector can take it
+  //
+  if((sock=sir_server_id->takeSocket(&data))!=NULL) {
+    if(!sir_connector->adoptConnection(sock,data)) {
+      sock->deleteLater();
+    }
+  }
   sir_connector->connectToServer();
 }
 
@@ -288,14 +424,31 @@ void MainObject::serverConnectedData(bool state)
     }
     sir_codec->setChannels(sir_connector->audioChannels());
     sir_codec->setSamplerate(sir_connector->audioSamplerate());
+    sir_codec->setBufferMsecs(buffer_msecs);
+    sir_codec->setMaxLatencyMsecs(max_latency_msecs);
     if(global_log_verbose) {
       Log(LOG_INFO,"Streaming from "+
 	  Connector::serverTypeText(sir_connector->serverType())+" server");
     }
-    connect(sir_connector,SIGNAL(dataReceived(const QByteArray &,bool)),
-    	    sir_codec,SLOT(processBitstream(const QByteArray &,bool)));
-    connect(sir_connector,SIGNAL(metadataReceived(uint64_t,MetaEvent *)),
-	    sir_codec,SLOT(processMetadata(uint64_t,MetaEvent *)));
+    if(decode_thread&&(!dump_bitstream)) {
+      QString err;
+      sir_decode_worker=new DecodeWorker(sir_codec,this);
+      connect(sir_connector,SIGNAL(dataReceived(const QByteArray &,bool)),
+	      sir_decode_worker,
+	      SLOT(processBitstream(const QByteArray &,bool)));
+      connect(sir_connector,SIGNAL(metadataReceived(uint64_t,MetaEvent *)),
+	      sir_decode_worker,SLOT(processMetadata(uint64_t,MetaEvent *)));
+      if(!sir_decode_worker->start(&err)) {
+	Log(LOG_ERR,err);
+	exit(GLASS_EXIT_GENERAL_ERROR);
+      }
+    }
+    else {
+      connect(sir_connector,SIGNAL(dataReceived(const QByteArray &,bool)),
+	      sir_codec,SLOT(processBitstream(const QByteArray &,bool)));
+      connect(sir_connector,SIGNAL(metadataReceived(uint64_t,MetaEvent *)),
+	      sir_codec,SLOT(processMetadata(uint64_t,MetaEvent *)));
+    }
     connect(sir_codec,SIGNAL(framed(unsigned,unsigned,unsigned,Ringbuffer *)),
 	    this,
 	    SLOT(codecFramedData(unsigned,unsigned,unsigned,Ringbuffer *)));
@@ -306,6 +459,10 @@ void MainObject::serverConnectedData(bool state)
   else {
     sir_starvation_timer->stop();
     sir_meter_timer->stop();
+    if(sir_decode_worker!=NULL) {
+      delete sir_decode_worker;
+      sir_decode_worker=NULL;
+    }
     if(sir_audio_device!=NULL) {
       delete sir_audio_device;
       sir_audio_device=NULL;
@@ -326,6 +483,14 @@ void MainObject::codecFramedData(unsigned chans,unsigned samprate,
 {
   QString err;
 
+  //
+  // With the decode thread, this arrives queued, so it may come from a
+  // codec (or for a ring) that a reconnect has since replaced
+  //
+  if((sir_codec==NULL)||(sender()!=sir_codec)||(ring!=sir_codec->ring())||
+     (sir_audio_device!=NULL)) {
+    return;
+  }
   if(global_log_verbose) {
     if(bitrate==0) {
       Log(LOG_INFO,"Using "+Codec::typeText(sir_codec->type())+
@@ -347,8 +512,24 @@ void MainObject::codecFramedData(unsigned chans,unsigned samprate,
     Log(LOG_ERR,err);
     exit(GLASS_EXIT_ARGUMENT_ERROR);
   }
-  connect(sir_codec,SIGNAL(metadataReceived(uint64_t,MetaEvent *)),
-	  sir_audio_device,SLOT(processMetadata(uint64_t,MetaEvent *)));
+  sir_audio_device->setSrcQuality(src_quality);
+  if(prebuffer_msecs>0) {
+    sir_audio_device->setPrebufferMsecs(prebuffer_msecs);
+  }
+  else {
+    if(adaptive_prebuffer) {
+      sir_audio_device->setPrebufferMsecs(AUDIO_ADAPTIVE_PREBUFFER_MSECS);
+    }
+  }
+  sir_audio_device->setAdaptivePrebuffer(adaptive_prebuffer);
+  if(sir_decode_worker!=NULL) {
+    connect(sir_decode_worker,SIGNAL(metadataReceived(uint64_t,MetaEvent *)),
+	    sir_audio_device,SLOT(processMetadata(uint64_t,MetaEvent *)));
+  }
+  else {
+    connect(sir_codec,SIGNAL(metadataReceived(uint64_t,MetaEvent *)),
+	    sir_audio_device,SLOT(processMetadata(uint64_t,MetaEvent *)));
+  }
   connect(sir_audio_device,SIGNAL(metadataReceived(MetaEvent *)),
 	  this,SLOT(metadataReceivedData(MetaEvent *)));
   if(!sir_audio_device->start(&err)) {
@@ -427,6 +608,9 @@ void MainObject::statsData()
   if(sir_codec!=NULL) {
     sir_codec->getStats(&hdrs,&values,sir_first_stats);
   }
+  if(sir_decode_worker!=NULL) {
+    sir_decode_worker->getStats(&hdrs,&values,sir_first_stats);
+  }
   if(sir_audio_device!=NULL) {
     sir_audio_device->getStats(&hdrs,&values,sir_first_stats);
   }
@@ -452,20 +636,28 @@ void MainObject::statsData()
 void MainObject::meterData()
 {
   int lvls[MAX_AUDIO_CHANNELS];
+  int rms_lvls[MAX_AUDIO_CHANNELS];
   QString hex;
+  QString rms_hex;
 
   sir_audio_device->meterLevels(lvls);
+  sir_audio_device->rmsMeterLevels(rms_lvls);
   switch(sir_codec->channels()) {
   case 1:
     hex=QString().sprintf("ME %04X%04X",0xFFFF&lvls[0],0xFFFF&lvls[0]);
+    rms_hex=QString().sprintf("RM %04X%04X",
+			      0xFFFF&rms_lvls[0],0xFFFF&rms_lvls[0]);
     break;
 
   case 2:
     hex=QString().sprintf("ME %04X%04X",0xFFFF&lvls[0],0xFFFF&lvls[1]);
+    rms_hex=QString().sprintf("RM %04X%04X",
+			      0xFFFF&rms_lvls[0],0xFFFF&rms_lvls[1]);
     break;
   }
   if(sir_json) {
     sir_json_engine->addEvent("Meter|Update: "+hex);
+    sir_json_engine->addEvent("Meter|Rms: "+rms_hex);
     printf("%s\n",(const char *)sir_json_engine->generate().toUtf8());
     sir_json_engine->clear();
   }
@@ -488,6 +680,9 @@ void MainObject::exitData()
       sir_connector->stop();
       delete sir_connector;
     }
+    if(sir_decode_worker!=NULL) {
+      delete sir_decode_worker;
+    }
     if(sir_codec!=NULL) {
       delete sir_codec;
     }
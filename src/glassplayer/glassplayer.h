@@ -29,6 +29,7 @@
 #include "audiodevice.h"
 #include "codec.h"
 #include "connector.h"
+#include "decodeworker.h"
 #include "jsonengine.h"
 #include "ringbuffer.h"
 #include "serverid.h"
@@ -61,7 +62,17 @@ class MainObject : public QObject
   AudioDevice::Type audio_device_type;
   QUrl server_url;
   bool dump_bitstream;
+  bool decode_thread;
+  unsigned buffer_msecs;
+  unsigned max_latency_msecs;
   unsigned pregap;
+  unsigned prebuffer_msecs;
+  bool adaptive_prebuffer;
+  unsigned receive_buffer_size;
+  unsigned min_chunk_bytes;
+  unsigned server_cache_ttl;
+  unsigned http_read_window;
+  AudioDevice::SrcQuality src_quality;
   QString post_data;
   bool sir_stats_out;
   bool sir_json;
@@ -77,6 +88,7 @@ class MainObject : public QObject
   bool dump_headers;
   Ringbuffer *sir_ring;
   Codec *sir_codec;
+  DecodeWorker *sir_decode_worker;
   Connector *sir_connector;
   AudioDevice *sir_audio_device;
   QTimer *sir_starvation_timer;
@@ -0,0 +1,105 @@
+// headerparser.cpp
+//
+// Incremental parser for HTTP and ICY response headers.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#include <string.h>
+
+#include "headerparser.h"
+
+HeaderParser::HeaderParser()
+{
+  reset();
+}
+
+
+void HeaderParser::reset()
+{
+  hdr_active=true;
+  hdr_partial.clear();
+  hdr_line=NULL;
+  hdr_line_length=0;
+}
+
+
+bool HeaderParser::isActive() const
+{
+  return hdr_active;
+}
+
+
+HeaderParser::Result HeaderParser::next(const char *data,int len,int *used)
+{
+  //
+  // Each call consumes '*used' bytes from the front of 'data', up to
+  // and including the next LF. A complete line is then available from
+  // line(), without its CR/LF; if it is empty, the headers are done and
+  // the body starts right after it. A line cut off by the end of a read
+  // is carried over to the next call. Once the headers are done,
+  // nothing more is consumed until reset().
+  //
+  const char *nl;
+  int n;
+
+  if((!hdr_active)||(len<=0)) {
+    *used=0;
+    return HeaderParser::NeedMore;
+  }
+  if(hdr_line!=NULL) {  // Done with the last line
+    hdr_partial.clear();
+    hdr_line=NULL;
+    hdr_line_length=0;
+  }
+  if((nl=(const char *)memchr(data,'\n',len))==NULL) {
+    hdr_partial.append(data,len);
+    *used=len;
+    return HeaderParser::NeedMore;
+  }
+  n=nl-data;
+  *used=n+1;
+  if(hdr_partial.empty()) {
+    hdr_line=data;  // The usual case, used in place
+  }
+  else {
+    hdr_partial.append(data,n);
+    hdr_line=hdr_partial.data();
+    n=hdr_partial.length();
+  }
+  if((n>0)&&(hdr_line[n-1]=='\r')) {
+    n--;
+  }
+  hdr_line_length=n;
+  if(n==0) {
+    hdr_active=false;
+    return HeaderParser::HeaderEnd;
+  }
+
+  return HeaderParser::HeaderLine;
+}
+
+
+const char *HeaderParser::line() const
+{
+  return hdr_line;
+}
+
+
+int HeaderParser::lineLength() const
+{
+  return hdr_line_length;
+}
@@ -0,0 +1,45 @@
+// headerparser.h
+//
+// Incremental parser for HTTP and ICY response headers.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#ifndef HEADERPARSER_H
+#define HEADERPARSER_H
+
+#include <string>
+
+class HeaderParser
+{
+ public:
+  enum Result {HeaderLine=0,HeaderEnd=1,NeedMore=2};
+  HeaderParser();
+  void reset();
+  bool isActive() const;
+  Result next(const char *data,int len,int *used);
+  const char *line() const;
+  int lineLength() const;
+
+ private:
+  bool hdr_active;
+  std::string hdr_partial;
+  const char *hdr_line;
+  int hdr_line_length;
+};
+
+
+#endif  // HEADERPARSER_H
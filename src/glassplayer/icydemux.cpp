@@ -0,0 +1,119 @@
+// icydemux.cpp
+//
+// Split an ICY stream into audio and metadata.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#include <string.h>
+
+#include "icydemux.h"
+
+IcyDemux::IcyDemux()
+{
+  reset(0);
+}
+
+
+void IcyDemux::reset(int interval)
+{
+  icy_interval=interval;
+  icy_state=IcyDemux::Audio;
+  icy_remaining=interval;
+  icy_length=0;
+}
+
+
+int IcyDemux::interval() const
+{
+  return icy_interval;
+}
+
+
+IcyDemux::Span IcyDemux::next(const char *data,int len,int *used)
+{
+  //
+  // After every 'icy-metaint' bytes of audio comes a length byte N and
+  // then N*16 bytes of metadata; any of these can fall anywhere in a
+  // read, so this picks up where the last call left off. Each call
+  // consumes '*used' bytes from the front of 'data', which are either
+  // a span of audio to be used in place, the last of a metadata block
+  // (now available from metadata()) or neither.
+  //
+  Span ret=IcyDemux::NoSpan;
+  int n=len;
+
+  if(icy_interval<=0) {
+    *used=len;
+    return len>0?IcyDemux::AudioSpan:IcyDemux::NoSpan;
+  }
+  if(len<=0) {
+    *used=0;
+    return IcyDemux::NoSpan;
+  }
+  switch(icy_state) {
+  case IcyDemux::Audio:
+    if(n>icy_remaining) {
+      n=icy_remaining;
+    }
+    if((icy_remaining-=n)==0) {
+      icy_state=IcyDemux::Length;
+    }
+    ret=IcyDemux::AudioSpan;
+    break;
+
+  case IcyDemux::Length:
+    n=1;
+    icy_remaining=16*(0xFF&*data);
+    icy_length=0;
+    if(icy_remaining==0) {
+      icy_state=IcyDemux::Audio;
+      icy_remaining=icy_interval;
+    }
+    else {
+      icy_state=IcyDemux::Metadata;
+    }
+    break;
+
+  case IcyDemux::Metadata:
+    if(n>icy_remaining) {
+      n=icy_remaining;
+    }
+    memcpy(icy_metadata+icy_length,data,n);
+    icy_length+=n;
+    if((icy_remaining-=n)==0) {
+      icy_state=IcyDemux::Audio;
+      icy_remaining=icy_interval;
+      ret=IcyDemux::MetadataBlock;
+    }
+    break;
+  }
+  *used=n;
+
+  return ret;
+}
+
+
+const char *IcyDemux::metadata() const
+{
+  return icy_metadata;
+}
+
+
+int IcyDemux::metadataLength() const
+{
+  return icy_length;
+}
@@ -0,0 +1,47 @@
+// icydemux.h
+//
+// Split an ICY stream into audio and metadata.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#ifndef ICYDEMUX_H
+#define ICYDEMUX_H
+
+#define ICYDEMUX_MAX_METADATA_LENGTH (255*16)
+
+class IcyDemux
+{
+ public:
+  enum State {Audio=0,Length=1,Metadata=2};
+  enum Span {AudioSpan=0,MetadataBlock=1,NoSpan=2};
+  IcyDemux();
+  void reset(int interval);
+  int interval() const;
+  Span next(const char *data,int len,int *used);
+  const char *metadata() const;
+  int metadataLength() const;
+
+ private:
+  int icy_interval;
+  State icy_state;
+  int icy_remaining;
+  int icy_length;
+  char icy_metadata[ICYDEMUX_MAX_METADATA_LENGTH];
+};
+
+
+#endif  // ICYDEMUX_H
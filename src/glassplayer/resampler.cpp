@@ -0,0 +1,273 @@
+// resampler.cpp
+//
+// Sample rate converter for audio devices.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "resampler.h"
+
+//
+// Kaiser window shape and passband edge (as a fraction of Nyquist) for
+// the polyphase filter
+//
+#define RESAMPLER_POLYPHASE_BETA 8.0
+#define RESAMPLER_POLYPHASE_CUTOFF 0.9
+
+//
+// Rebuild the polyphase filter when the ratio drifts this far from the
+// one it was designed for
+//
+#define RESAMPLER_POLYPHASE_REDESIGN 0.01
+
+static double BesselI0(double x)
+{
+  double sum=1.0;
+  double term=1.0;
+
+  for(int k=1;k<32;k++) {
+    term*=(x/(2.0*k))*(x/(2.0*k));
+    sum+=term;
+  }
+  return sum;
+}
+
+
+Resampler::Resampler(AudioDevice::SrcQuality qual,unsigned chans,
+		     double ratio,unsigned max_frames,int *err)
+{
+  rs_quality=qual;
+  rs_channels=chans;
+  rs_src=NULL;
+  rs_ratio=ratio;
+  rs_filter_ratio=0.0;
+  rs_position=0.0;
+  rs_history_start=0;
+  rs_history_frames=0;
+  *err=0;
+
+  switch(qual) {
+  case AudioDevice::SrcLinear:
+    rs_src=src_new(SRC_LINEAR,chans,err);
+    break;
+
+  case AudioDevice::SrcSincFastest:
+    rs_src=src_new(SRC_SINC_FASTEST,chans,err);
+    break;
+
+  case AudioDevice::SrcSincMedium:
+    rs_src=src_new(SRC_SINC_MEDIUM_QUALITY,chans,err);
+    break;
+
+  case AudioDevice::SrcPolyphase:
+  case AudioDevice::SrcLastQuality:
+    rs_quality=AudioDevice::SrcPolyphase;
+    MakeFilter(ratio);
+
+    //
+    // Prime the history so that the first output frame is centered on the
+    // first input frame
+    //
+    reserve(max_frames);
+    rs_history_frames=RESAMPLER_POLYPHASE_TAPS/2-1;
+    rs_position=RESAMPLER_POLYPHASE_TAPS/2-1;
+    break;
+  }
+  if(rs_src!=NULL) {
+    src_set_ratio(rs_src,ratio);
+  }
+}
+
+
+Resampler::~Resampler()
+{
+  if(rs_src!=NULL) {
+    src_delete(rs_src);
+  }
+}
+
+
+AudioDevice::SrcQuality Resampler::quality() const
+{
+  return rs_quality;
+}
+
+
+int Resampler::setRatio(double ratio)
+{
+  rs_ratio=ratio;
+  if(rs_src!=NULL) {
+    return src_set_ratio(rs_src,ratio);
+  }
+  if(fabs(ratio/rs_filter_ratio-1.0)>RESAMPLER_POLYPHASE_REDESIGN) {
+    MakeFilter(ratio);
+  }
+  return 0;
+}
+
+
+void Resampler::reserve(unsigned max_frames)
+{
+  //
+  // Size the polyphase history for input blocks of up to 'max_frames',
+  // with room for two of them so that ProcessPolyphase() only has to
+  // move the leftover frames back to the front every other call at most
+  //
+  size_t size=2*(RESAMPLER_POLYPHASE_TAPS+max_frames)*rs_channels;
+
+  if((rs_quality==AudioDevice::SrcPolyphase)&&(size>rs_history.size())) {
+    memmove(rs_history.data(),rs_history.data()+rs_history_start*rs_channels,
+	    rs_history_frames*rs_channels*sizeof(float));
+    rs_history_start=0;
+    rs_history.resize(size,0.0);
+  }
+}
+
+
+int Resampler::process(SRC_DATA *data)
+{
+  if(rs_src!=NULL) {
+    return src_process(rs_src,data);
+  }
+  return ProcessPolyphase(data);
+}
+
+
+void Resampler::MakeFilter(double ratio)
+{
+  //
+  // Kaiser-windowed sinc, tabulated at RESAMPLER_POLYPHASE_PHASES+1
+  // fractional offsets so that ProcessPolyphase() can interpolate between
+  // adjacent rows. Each row is normalized to unity gain at DC.
+  //
+  const int taps=RESAMPLER_POLYPHASE_TAPS;
+  const int half=RESAMPLER_POLYPHASE_TAPS/2;
+  double fc=RESAMPLER_POLYPHASE_CUTOFF*(ratio<1.0?ratio:1.0);
+  double i0_beta=BesselI0(RESAMPLER_POLYPHASE_BETA);
+
+  rs_filter.resize((RESAMPLER_POLYPHASE_PHASES+1)*taps);
+  for(int p=0;p<=RESAMPLER_POLYPHASE_PHASES;p++) {
+    double frac=(double)p/(double)RESAMPLER_POLYPHASE_PHASES;
+    double sum=0.0;
+    double row[RESAMPLER_POLYPHASE_TAPS];
+    for(int t=0;t<taps;t++) {
+      double x=(double)(t-(half-1))-frac;
+      double w=x/(double)half;
+      double h=fc;
+      if(x!=0.0) {
+	h=sin(M_PI*fc*x)/(M_PI*x);
+      }
+      if(fabs(w)<1.0) {
+	h*=BesselI0(RESAMPLER_POLYPHASE_BETA*sqrt(1.0-w*w))/i0_beta;
+      }
+      else {
+	h=0.0;
+      }
+      row[t]=h;
+      sum+=h;
+    }
+    for(int t=0;t<taps;t++) {
+      rs_filter[p*taps+t]=row[t]/sum;
+    }
+  }
+  rs_filter_ratio=ratio;
+}
+
+
+int Resampler::ProcessPolyphase(SRC_DATA *data)
+{
+  const long taps=RESAMPLER_POLYPHASE_TAPS;
+  const long half=RESAMPLER_POLYPHASE_TAPS/2;
+  long frames=data->input_frames;
+  const float *history;
+  double step;
+  long avail;
+  long gen=0;
+  long drop;
+
+  if(data->src_ratio!=rs_ratio) {
+    setRatio(data->src_ratio);
+  }
+  step=1.0/rs_ratio;
+
+  //
+  // Everything passed in is consumed; frames that can't be used yet are
+  // kept in the history for the next call. The history is allocated up
+  // front by reserve(), so when the new frames won't fit after the ones
+  // being kept, the latter are moved back to the front of it. It only
+  // grows here if handed a bigger block than was reserved for.
+  //
+  if((size_t)(rs_history_start+rs_history_frames+frames)*rs_channels>
+     rs_history.size()) {
+    memmove(rs_history.data(),rs_history.data()+rs_history_start*rs_channels,
+	    rs_history_frames*rs_channels*sizeof(float));
+    rs_history_start=0;
+    if((size_t)(rs_history_frames+frames)*rs_channels>rs_history.size()) {
+      rs_history.resize((rs_history_frames+frames)*rs_channels);
+    }
+  }
+  memcpy(rs_history.data()+(rs_history_start+rs_history_frames)*rs_channels,
+	 data->data_in,frames*rs_channels*sizeof(float));
+  rs_history_frames+=frames;
+  avail=rs_history_frames;
+  history=rs_history.data()+rs_history_start*rs_channels;
+
+  while(gen<data->output_frames) {
+    long base=(long)rs_position;
+    if((base+half)>=avail) {
+      break;
+    }
+    double phase=(rs_position-base)*RESAMPLER_POLYPHASE_PHASES;
+    long p=(long)phase;
+    float pf=phase-p;
+    const float *c0=&rs_filter[p*taps];
+    const float *c1=c0+taps;
+    for(long t=0;t<taps;t++) {
+      rs_coeffs[t]=c0[t]+pf*(c1[t]-c0[t]);
+    }
+    const float *in=history+(base-half+1)*rs_channels;
+    float *out=data->data_out+gen*rs_channels;
+    for(unsigned i=0;i<rs_channels;i++) {
+      float acc=0.0;
+      for(long t=0;t<taps;t++) {
+	acc+=rs_coeffs[t]*in[t*rs_channels+i];
+      }
+      out[i]=acc;
+    }
+    rs_position+=step;
+    gen++;
+  }
+
+  //
+  // Drop history that no future output frame can reach
+  //
+  if((drop=(long)rs_position-half+1)>0) {
+    if(drop>avail) {
+      drop=avail;
+    }
+    rs_history_start+=drop;
+    rs_history_frames-=drop;
+    rs_position-=drop;
+  }
+
+  data->input_frames_used=data->input_frames;
+  data->output_frames_gen=gen;
+
+  return 0;
+}
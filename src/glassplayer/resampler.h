@@ -0,0 +1,64 @@
+// resampler.h
+//
+// Sample rate converter for audio devices.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <vector>
+
+#include <samplerate.h>
+
+#include "audiodevice.h"
+
+//
+// Polyphase filter geometry
+//
+#define RESAMPLER_POLYPHASE_TAPS 32
+#define RESAMPLER_POLYPHASE_PHASES 256
+
+class Resampler
+{
+ public:
+  Resampler(AudioDevice::SrcQuality qual,unsigned chans,double ratio,
+	    unsigned max_frames,int *err);
+  ~Resampler();
+  AudioDevice::SrcQuality quality() const;
+  int setRatio(double ratio);
+  void reserve(unsigned max_frames);
+  int process(SRC_DATA *data);
+
+ private:
+  void MakeFilter(double ratio);
+  int ProcessPolyphase(SRC_DATA *data);
+  AudioDevice::SrcQuality rs_quality;
+  unsigned rs_channels;
+  SRC_STATE *rs_src;
+  double rs_ratio;
+  double rs_filter_ratio;
+  double rs_position;
+  std::vector<float> rs_filter;
+  std::vector<float> rs_history;
+  long rs_history_start;
+  long rs_history_frames;
+  float rs_coeffs[RESAMPLER_POLYPHASE_TAPS];
+};
+
+
+#endif  // RESAMPLER_H
@@ -20,10 +20,17 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QProcess>
+#include <QSaveFile>
+#include <QStringList>
 
+#include "codec.h"
 #include "logging.h"
 #include "m3uplaylist.h"
 #include "serverid.h"
@@ -31,9 +38,12 @@
 ServerId::ServerId(QObject *parent)
   : QObject(parent)
 {
-  id_socket=CreateSocket();
+  id_socket=NULL;
   id_restarting=false;
   id_tempfile=NULL;
+  id_handoff=false;
+  id_metadata_enabled=false;
+  id_cache_ttl=0;
 
   id_restart_timer=new QTimer(this);
   id_restart_timer->setSingleShot(true);
@@ -68,6 +78,10 @@ void ServerId::connectToServer(const QUrl &url,const QString &post_data,
   if(id_url.path().isEmpty()) {
     id_url.setPath("/");
   }
+  id_cache_key="";
+  if(post_data.isEmpty()) {
+    id_cache_key=id_url.toString();
+  }
   if(id_url.scheme().isEmpty()||(id_url.scheme().toLower()=="file")) {
     id_content_type=GetContentType(id_url.path());
     if(id_content_type=="text/plain") {  // Could be a playlist
@@ -98,35 +112,71 @@ void ServerId::connectToServer(const QUrl &url,const QString &post_data,
       emit typeFound(Connector::SignalGenerator,"audio/tone",id_url);
     }
     else {
-      if(id_url.scheme()=="https") {
-	emit typeFound(Connector::HlsServer,"",id_url);
-	return;
-      }
-      else {
-	id_socket->connectToHost(url.host(),url.port(80));
+      if(!LookupCache()) {
+	ConnectSocket();
       }
     }
   }
 }
 
 
+void ServerId::setStreamMetadataEnabled(bool state)
+{
+  id_metadata_enabled=state;
+}
+
+
+void ServerId::setCacheTtl(unsigned secs)
+{
+  id_cache_ttl=secs;
+}
+
+
+QTcpSocket *ServerId::takeSocket(QByteArray *data)
+{
+  //
+  // Hand the probe connection of a live stream on to the connector,
+  // together with everything read from it so far
+  //
+  QTcpSocket *sock=NULL;
+
+  if(id_handoff&&(id_socket!=NULL)) {
+    sock=id_socket;
+    id_socket=NULL;
+    sock->disconnect(this);
+    *data=id_raw;
+  }
+  id_handoff=false;
+  id_raw.clear();
+
+  return sock;
+}
+
+
 void ServerId::connectedData()
 {
   id_header_active=true;
+  id_headers.reset();
   id_result_code=0;
   id_result_text="";
   id_body="";
+  id_raw.clear();
+  id_handoff=false;
   id_content_type="";
   id_location="";
   id_restarting=false;
   id_icy=false;
+  id_chunked=false;
   if(id_post_data.isEmpty()) {
     SendHeader("GET "+id_url.path()+" HTTP/1.1");
   }
   else {
     SendHeader("POST "+id_url.path()+" HTTP/1.1");
   }
-  SendHeader("Host: "+id_url.host()+":"+QString().sprintf("%u",id_url.port(80)));
+  SendHeader("Host: "+id_url.host()+":"+
+	     QString().sprintf("%u",id_url.port(id_url.scheme().toLower()==
+						  "https"?443:80)));
+  SendHeader(QString().sprintf("icy-metadata: %d",id_metadata_enabled));
   SendHeader("Accept: */*");
   SendHeader("User-Agent: glassplayer/"+QString(VERSION));
   SendHeader("Cache-control: no-cache");
@@ -145,35 +195,39 @@ void ServerId::connectedData()
 void ServerId::readyReadData()
 {
   QByteArray data;
-
-  while(id_socket->bytesAvailable()>0) {
-    data=id_socket->read(1024);
-    for(int i=0;i<data.length();i++) {
-      if(id_header_active) {   // Get headers
-	switch(0xFF&data.data()[i]) {
-	case 13:
-	  if(!id_header.isEmpty()) {
-	    ProcessHeader(id_header);
-	  }
-	  break;
-
-	case 10:
-	  if(id_header.isEmpty()) {
-	    id_header_active=false;
-	    ProcessResult();
-	  }
-	  id_header="";
-	  break;
-
-	default:
-	  id_header+=data.data()[i];
-	  break;
+  const char *p;
+  int len;
+  int n;
+
+  while((id_socket!=NULL)&&(id_socket->bytesAvailable()>0)) {
+    data=id_socket->read(SERVERID_READ_SIZE);
+    p=data.constData();
+    len=data.length();
+    if(id_header_active) {
+      id_raw+=data;
+    }
+    while(id_header_active&&(len>0)) {  // Get headers
+      switch(id_headers.next(p,len,&n)) {
+      case HeaderParser::HeaderLine:
+	ProcessHeader(QString::fromUtf8(id_headers.line(),
+					id_headers.lineLength()));
+	break;
+
+      case HeaderParser::HeaderEnd:
+	id_header_active=false;
+	ProcessResult();
+	if(id_socket==NULL) {  // Taken over by the connector
+	  return;
 	}
+	break;
+
+      case HeaderParser::NeedMore:
+	break;
       }
-      else {
-	id_body+=data.data()[i];
-      }
+      p+=n;
+      len-=n;
     }
+    id_body.append(p,len);
   }
 }
 
@@ -192,7 +246,7 @@ void ServerId::errorData(QAbstractSocket::SocketError err)
 	M3uPlaylist *playlist=new M3uPlaylist();
 	if(playlist->parse(id_body.constData(),id_url)) {
 	  if(playlist->isExtended()) {
-	    emit typeFound(Connector::HlsServer,"",id_url);
+	    FoundType(Connector::HlsServer,"",id_url);
 	  }
 	  else {
 	    //
@@ -203,7 +257,7 @@ void ServerId::errorData(QAbstractSocket::SocketError err)
 		Log(LOG_INFO,tr("using mountpoint")+
 		    ": "+playlist->segmentUrl(0).toString());
 	      }
-	      emit typeFound(Connector::XCastServer,"",playlist->segmentUrl(0));
+	      FoundType(Connector::XCastServer,"",playlist->segmentUrl(0));
 	    }
 	    else {
 	      Log(LOG_ERR,"playlist contains no media segments");
@@ -253,10 +307,7 @@ void ServerId::killData()
 
 void ServerId::restartData()
 {
-  delete id_socket;
-  id_socket=CreateSocket();
-  
-  id_socket->connectToHost(id_url.host(),id_url.port(80));
+  ConnectSocket();
 }
 
 
@@ -267,7 +318,14 @@ void ServerId::ProcessResult()
   case 200:   // OK
   case 203:   // Non-Authoritative Information
     if(id_icy) {
-      emit typeFound(Connector::XCastServer,id_content_type,id_url);
+      id_handoff=true;
+      FoundType(Connector::XCastServer,id_content_type,id_url);
+      id_kill_timer->start(0);
+      return;
+    }
+    if(IsProgressive()) {
+      id_handoff=true;
+      FoundType(Connector::HttpFileServer,id_content_type,id_url);
       id_kill_timer->start(0);
       return;
     }
@@ -278,7 +336,7 @@ void ServerId::ProcessResult()
   case 303:   // See Other
   case 307:   // Temporary Redirect
     if(!id_location.isEmpty()) {
-      id_url=QUrl(id_location);
+      id_url=id_url.resolved(QUrl(id_location));
       if(id_url.path().isEmpty()) {
 	id_url.setPath("/");
       }
@@ -303,6 +361,26 @@ void ServerId::ProcessResult()
 }
 
 
+bool ServerId::IsProgressive() const
+{
+  //
+  // Static files that a bitstream codec can decode as they arrive are
+  // streamed. Anything else (playlists, and formats read with libsndfile,
+  // which needs to seek) is downloaded in full first.
+  //
+  if(id_chunked) {
+    return false;
+  }
+  for(int i=0;i<Codec::TypeLast;i++) {
+    if((i!=Codec::TypeNull)&&(i!=Codec::TypePassthrough)&&
+       Codec::acceptsContentType((Codec::Type)i,id_content_type)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
 void ServerId::SendHeader(const QString &str)
 {
   id_socket->write((str+"\r\n").toUtf8(),str.length()+2);
@@ -337,6 +415,9 @@ void ServerId::ProcessHeader(const QString &str)
       if(hdr=="location") {
 	id_location=value;
       }
+      if(hdr=="transfer-encoding") {
+	id_chunked=value.toLower().contains("chunked");
+      }
       id_icy=id_icy||(hdr.split("-")[0].toLower()=="icy");
     }
   }
@@ -345,8 +426,20 @@ void ServerId::ProcessHeader(const QString &str)
 
 QTcpSocket *ServerId::CreateSocket()
 {
-  QTcpSocket *sock=new QTcpSocket(this);
-  connect(sock,SIGNAL(connected()),this,SLOT(connectedData()));
+  QTcpSocket *sock=NULL;
+
+  if(id_url.scheme().toLower()=="https") {
+    if(!QSslSocket::supportsSsl()) {
+      Log(LOG_ERR,tr("TLS support is not available"));
+      exit(GLASS_EXIT_NETWORK_ERROR);
+    }
+    sock=new QSslSocket(this);
+    connect(sock,SIGNAL(encrypted()),this,SLOT(connectedData()));
+  }
+  else {
+    sock=new QTcpSocket(this);
+    connect(sock,SIGNAL(connected()),this,SLOT(connectedData()));
+  }
   connect(sock,SIGNAL(readyRead()),this,SLOT(readyReadData()));
   connect(sock,SIGNAL(error(QAbstractSocket::SocketError)),
 	  this,SLOT(errorData(QAbstractSocket::SocketError)));
@@ -354,6 +447,116 @@ QTcpSocket *ServerId::CreateSocket()
 }
 
 
+void ServerId::ConnectSocket()
+{
+  if(id_socket!=NULL) {
+    delete id_socket;
+  }
+  id_socket=CreateSocket();
+  if(id_url.scheme().toLower()=="https") {
+    ((QSslSocket *)id_socket)->
+      connectToHostEncrypted(id_url.host(),id_url.port(443));
+  }
+  else {
+    id_socket->connectToHost(id_url.host(),id_url.port(80));
+  }
+}
+
+
+void ServerId::FoundType(Connector::ServerType type,const QString &mimetype,
+			 const QUrl &url)
+{
+  StoreCache(type,mimetype,url);
+  emit typeFound(type,mimetype,url);
+}
+
+
+bool ServerId::LookupCache()
+{
+  //
+  // Each line is: <stored-time> <type> <url> <mimetype> <final-url>,
+  // separated by tabs
+  //
+  QFile file(CacheFilename());
+  QStringList f0;
+  time_t now=time(NULL);
+
+  if((id_cache_ttl==0)||id_cache_key.isEmpty()) {
+    return false;
+  }
+  if(!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  while(!file.atEnd()) {
+    f0=QString::fromUtf8(file.readLine()).trimmed().split("\t");
+    if((f0.size()==5)&&(f0.at(2)==id_cache_key)&&
+       ((now-(time_t)f0.at(0).toLongLong())<(time_t)id_cache_ttl)) {
+      int type=f0.at(1).toInt();
+      if((type>0)&&(type<Connector::LastServer)) {
+	if(global_log_verbose) {
+	  Log(LOG_INFO,tr("using cached server type for")+" "+id_cache_key);
+	}
+	emit typeFound((Connector::ServerType)type,f0.at(3),QUrl(f0.at(4)));
+	return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+void ServerId::StoreCache(Connector::ServerType type,const QString &mimetype,
+			  const QUrl &url)
+{
+  QString filename=CacheFilename();
+  QFile file(filename);
+  QSaveFile save(filename);
+  QStringList lines;
+  QStringList f0;
+  QString line;
+  time_t now=time(NULL);
+
+  //
+  // A file downloaded to a temporary location can't be reused
+  //
+  if((id_cache_ttl==0)||id_cache_key.isEmpty()||
+     ((type!=Connector::XCastServer)&&(type!=Connector::HlsServer)&&
+      (type!=Connector::HttpFileServer))) {
+    return;
+  }
+  if(file.open(QIODevice::ReadOnly)) {
+    while(!file.atEnd()) {
+      line=QString::fromUtf8(file.readLine()).trimmed();
+      f0=line.split("\t");
+      if((f0.size()==5)&&(f0.at(2)!=id_cache_key)&&
+	 ((now-(time_t)f0.at(0).toLongLong())<(time_t)id_cache_ttl)) {
+	lines.push_back(line);
+      }
+    }
+    file.close();
+  }
+  lines.push_back(QString().sprintf("%ld\t%d\t",(long)now,type)+
+		  id_cache_key+"\t"+mimetype+"\t"+url.toString());
+  QDir().mkpath(QFileInfo(filename).path());
+  if(!save.open(QIODevice::WriteOnly)) {
+    Log(LOG_WARNING,tr("unable to write server cache")+" ["+filename+"]");
+    return;
+  }
+  save.write((lines.join("\n")+"\n").toUtf8());
+  save.commit();
+}
+
+
+QString ServerId::CacheFilename() const
+{
+  if(getenv("XDG_CACHE_HOME")!=NULL) {
+    return QString(getenv("XDG_CACHE_HOME"))+"/"+SERVERID_CACHE_FILE;
+  }
+  return QDir::homePath()+"/.cache/"+SERVERID_CACHE_FILE;
+}
+
+
 QString ServerId::GetContentType(const QString &filename)
 {
   QStringList args;
@@ -21,6 +21,7 @@
 #ifndef SERVERID_H
 #define SERVERID_H
 
+#include <QSslSocket>
 #include <QString>
 #include <QTcpSocket>
 #include <QTemporaryFile>
@@ -28,6 +29,10 @@
 #include <QUrl>
 
 #include "connector.h"
+#include "headerparser.h"
+
+#define SERVERID_CACHE_FILE "glassplayer/servertypes"
+#define SERVERID_READ_SIZE 65536
 
 class ServerId : public QObject
 {
@@ -37,6 +42,9 @@ class ServerId : public QObject
   ~ServerId();
   void connectToServer(const QUrl &url,const QString &post_data,
 		       const QString &username,const QString &passwd);
+  void setStreamMetadataEnabled(bool state);
+  void setCacheTtl(unsigned secs);
+  QTcpSocket *takeSocket(QByteArray *data);
 
  signals:
   void typeFound(Connector::ServerType type,const QString &mimetype,
@@ -51,9 +59,17 @@ class ServerId : public QObject
 
  private:
   void ProcessResult();
+  bool IsProgressive() const;
+  void FoundType(Connector::ServerType type,const QString &mimetype,
+		 const QUrl &url);
+  bool LookupCache();
+  void StoreCache(Connector::ServerType type,const QString &mimetype,
+		  const QUrl &url);
+  QString CacheFilename() const;
   void SendHeader(const QString &str);
   void ProcessHeader(const QString &str);
   QTcpSocket *CreateSocket();
+  void ConnectSocket();
   QString GetContentType(const QString &filename);
   QTcpSocket *id_socket;
   QTimer *id_kill_timer;
@@ -61,16 +77,22 @@ class ServerId : public QObject
   QString id_post_data;
   QString id_username;
   QString id_password;
-  QString id_header;
+  HeaderParser id_headers;
   QString id_content_type;
   QString id_location;
   bool id_header_active;
   unsigned id_result_code;
   QString id_result_text;
   QByteArray id_body;
+  QByteArray id_raw;
+  bool id_handoff;
+  bool id_metadata_enabled;
+  unsigned id_cache_ttl;
+  QString id_cache_key;
   QTimer *id_restart_timer;
   bool id_restarting;
   bool id_icy;
+  bool id_chunked;
   QTemporaryFile *id_tempfile;
 };
 
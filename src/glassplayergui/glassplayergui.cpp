@@ -44,11 +44,19 @@ MainWidget::MainWidget(QWidget *parent)
   //
   valid_pt_args.push_back("--audio-device");
   valid_pt_args.push_back("--alsa-device");
+  valid_pt_args.push_back("--alsa-format");
+  valid_pt_args.push_back("--alsa-mmap");
+  valid_pt_args.push_back("--file-batch-ms");
   valid_pt_args.push_back("--file-format");
   valid_pt_args.push_back("--file-name");
+  valid_pt_args.push_back("--file-preallocate");
+  valid_pt_args.push_back("--file-segment-seconds");
+  valid_pt_args.push_back("--file-type");
   valid_pt_args.push_back("--jack-client-name");
   valid_pt_args.push_back("--jack-server-name");
   valid_pt_args.push_back("--mme-device-id");
+  valid_pt_args.push_back("--realtime");
+  valid_pt_args.push_back("--realtime-cpu");
   valid_pt_args.push_back("--server-script-down");
   valid_pt_args.push_back("--server-script-up");
   valid_pt_args.push_back("--user");
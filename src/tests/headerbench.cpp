@@ -0,0 +1,248 @@
+// headerbench.cpp
+//
+// Check and benchmark the HTTP response header parser.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+//
+// A typical ICY response is run through HeaderParser in reads cut at
+// random, and the header lines and body must come out the same as
+// from a single pass. It is then timed against the byte-at-a-time
+// loop that XCast and ServerId used before, which read 1024 bytes at
+// a time and appended each character to the current line or the body
+// (std::string stands in here for QString and QByteArray, so if
+// anything this flatters the old loop).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "headerparser.h"
+
+#define HEADERBENCH_OLD_READ_SIZE 1024
+#define HEADERBENCH_NEW_READ_SIZE 65536
+#define HEADERBENCH_BODY_BYTES (1024*1024)
+#define HEADERBENCH_RESPONSES 100000
+#define HEADERBENCH_BODIES 50
+#define HEADERBENCH_SPLITS 2000
+
+static const char *response_headers=
+  "HTTP/1.0 200 OK\r\n"
+  "Server: Icecast 2.4.4\r\n"
+  "Date: Sat, 17 Oct 2026 12:00:00 GMT\r\n"
+  "Content-Type: audio/mpeg\r\n"
+  "Cache-Control: no-cache, no-store\r\n"
+  "Expires: Mon, 26 Jul 1997 05:00:00 GMT\r\n"
+  "Pragma: no-cache\r\n"
+  "Access-Control-Allow-Origin: *\r\n"
+  "icy-br:128\r\n"
+  "ice-audio-info: ice-samplerate=44100;ice-bitrate=128;ice-channels=2\r\n"
+  "icy-description:Paravel Systems Test Stream\r\n"
+  "icy-genre:Various\r\n"
+  "icy-name:Paravel Test\r\n"
+  "icy-pub:0\r\n"
+  "icy-url:http://www.paravelsystems.com/\r\n"
+  "icy-metaint:16000\r\n"
+  "\r\n";
+
+struct Result
+{
+  std::vector<std::string> lines;
+  std::string body;
+  bool operator==(const Result &r) const
+  {
+    return (lines==r.lines)&&(body==r.body);
+  }
+};
+
+
+double Now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (double)ts.tv_sec+(double)ts.tv_nsec/1e9;
+}
+
+
+void ParseOld(Result *r,const std::string &resp)
+{
+  //
+  // The loop from XCast::readyReadData() and ServerId::readyReadData()
+  //
+  std::string header;
+  bool header_active=true;
+
+  for(size_t pos=0;pos<resp.size();pos+=HEADERBENCH_OLD_READ_SIZE) {
+    std::string data=resp.substr(pos,HEADERBENCH_OLD_READ_SIZE);
+    for(size_t i=0;i<data.length();i++) {
+      if(header_active) {
+	switch(0xFF&data.data()[i]) {
+	case 13:
+	  if(!header.empty()) {
+	    r->lines.push_back(header);
+	  }
+	  break;
+
+	case 10:
+	  if(header.empty()) {
+	    header_active=false;
+	  }
+	  header="";
+	  break;
+
+	default:
+	  header+=data.data()[i];
+	  break;
+	}
+      }
+      else {
+	r->body+=data.data()[i];
+      }
+    }
+  }
+}
+
+
+void ParseNew(Result *r,const std::string &resp,bool split)
+{
+  HeaderParser parser;
+  size_t pos=0;
+  int len;
+  int n;
+
+  while(pos<resp.size()) {
+    len=resp.size()-pos;
+    if(split) {
+      n=1+rand()%(rand()%2?8:256);
+    }
+    else {
+      n=HEADERBENCH_NEW_READ_SIZE;
+    }
+    if(len>n) {
+      len=n;
+    }
+    const char *p=resp.data()+pos;
+    pos+=len;
+    while(parser.isActive()&&(len>0)) {
+      switch(parser.next(p,len,&n)) {
+      case HeaderParser::HeaderLine:
+	r->lines.push_back(std::string(parser.line(),parser.lineLength()));
+	break;
+
+      case HeaderParser::HeaderEnd:
+      case HeaderParser::NeedMore:
+	break;
+      }
+      p+=n;
+      len-=n;
+    }
+    r->body.append(p,len);
+  }
+}
+
+
+int main(int argc,char *argv[])
+{
+  std::string headers=response_headers;
+  std::string resp=headers;
+  Result old_result;
+  Result whole;
+  double start;
+  double old_secs;
+  double new_secs;
+
+  srand(1);
+  for(int i=0;i<HEADERBENCH_BODY_BYTES;i++) {
+    resp+=(char)rand();
+  }
+
+  //
+  // Check
+  //
+  ParseOld(&old_result,resp);
+  ParseNew(&whole,resp,false);
+  if(!(whole==old_result)) {
+    fprintf(stderr,"headerbench: parser disagrees with the old loop\n");
+    return 1;
+  }
+  for(int i=0;i<HEADERBENCH_SPLITS;i++) {
+    Result r;
+    std::string s=i%2?resp.substr(0,headers.size()+1000):headers+"body";
+    Result ref;
+    ParseNew(&ref,s,false);
+    ParseNew(&r,s,true);
+    if(!(r==ref)) {
+      fprintf(stderr,"headerbench: split reads give different results\n");
+      return 1;
+    }
+  }
+  Result lf;
+  std::string bare=headers;
+  for(size_t i=bare.find('\r');i!=std::string::npos;i=bare.find('\r')) {
+    bare.erase(i,1);
+  }
+  ParseNew(&lf,bare+"body",true);
+  if((lf.lines!=whole.lines)||(lf.body!="body")) {
+    fprintf(stderr,"headerbench: bare LF line endings not handled\n");
+    return 1;
+  }
+  printf("parser ok\n");
+
+  //
+  // Benchmark
+  //
+  printf("%lu byte header, %d byte body\n",headers.size(),
+	 HEADERBENCH_BODY_BYTES);
+  start=Now();
+  for(int i=0;i<HEADERBENCH_RESPONSES;i++) {
+    Result r;
+    ParseOld(&r,headers);
+  }
+  old_secs=Now()-start;
+  start=Now();
+  for(int i=0;i<HEADERBENCH_RESPONSES;i++) {
+    Result r;
+    ParseNew(&r,headers,false);
+  }
+  new_secs=Now()-start;
+  printf("  headers:   old %10.0f responses/s  new %10.0f responses/s\n",
+	 HEADERBENCH_RESPONSES/old_secs,HEADERBENCH_RESPONSES/new_secs);
+
+  start=Now();
+  for(int i=0;i<HEADERBENCH_BODIES;i++) {
+    Result r;
+    ParseOld(&r,resp);
+  }
+  old_secs=Now()-start;
+  start=Now();
+  for(int i=0;i<HEADERBENCH_BODIES;i++) {
+    Result r;
+    ParseNew(&r,resp,false);
+  }
+  new_secs=Now()-start;
+  printf("  with body: old %9.1f MB/s        new %9.1f MB/s\n",
+	 HEADERBENCH_BODIES*resp.size()/old_secs/(1024.0*1024.0),
+	 HEADERBENCH_BODIES*resp.size()/new_secs/(1024.0*1024.0));
+
+  return 0;
+}
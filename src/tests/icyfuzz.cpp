@@ -0,0 +1,289 @@
+// icyfuzz.cpp
+//
+// Fuzz driver for the ICY stream demultiplexer.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+//
+// With no files, this builds random ICY streams (random 'icy-metaint',
+// audio and metadata blocks, including empty ones), cuts them into
+// random reads and checks that IcyDemux hands back exactly the audio
+// and metadata that went in. Random bytes that aren't a well-formed
+// stream are thrown at it as well, to make sure every byte is
+// accounted for and nothing overruns.
+//
+// Given captures of a response body (e.g. from
+// 'curl -H "Icy-MetaData: 1" -o capture.bin <url>') and the server's
+// 'icy-metaint', each is demultiplexed in one pass and then again cut
+// into random reads, and the results must be the same.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "icydemux.h"
+
+#define ICYFUZZ_DEFAULT_ITERATIONS 2000
+#define ICYFUZZ_SPLITS 50
+
+struct Result
+{
+  std::string audio;
+  std::vector<std::string> metadata;
+  bool operator==(const Result &r) const
+  {
+    return (audio==r.audio)&&(metadata==r.metadata);
+  }
+};
+
+
+unsigned Random(unsigned max)
+{
+  return (unsigned)rand()%(max+1);
+}
+
+
+int ReadSize()
+{
+  //
+  // Mostly small reads, so that every state gets split often, with the
+  // odd big one
+  //
+  switch(Random(3)) {
+  case 0:
+    return 1;
+
+  case 1:
+    return 1+Random(16);
+
+  case 2:
+    return 1+Random(1024);
+  }
+  return 1+Random(65536);
+}
+
+
+bool Demux(Result *r,const std::string &stream,int interval,bool split)
+{
+  IcyDemux icy;
+  size_t pos=0;
+  int len;
+  int n;
+
+  icy.reset(interval);
+  while(pos<stream.size()) {
+    len=stream.size()-pos;
+    if(split&&(len>(n=ReadSize()))) {
+      len=n;
+    }
+    const char *p=stream.data()+pos;
+    while(len>0) {
+      switch(icy.next(p,len,&n)) {
+      case IcyDemux::AudioSpan:
+	r->audio.append(p,n);
+	break;
+
+      case IcyDemux::MetadataBlock:
+	r->metadata.push_back(std::string(icy.metadata(),
+					  icy.metadataLength()));
+	break;
+
+      case IcyDemux::NoSpan:
+	break;
+      }
+      if((n<=0)||(n>len)) {
+	fprintf(stderr,"icyfuzz: bad span length %d of %d\n",n,len);
+	return false;
+      }
+      if(icy.metadataLength()>ICYDEMUX_MAX_METADATA_LENGTH) {
+	fprintf(stderr,"icyfuzz: metadata overrun\n");
+	return false;
+      }
+      p+=n;
+      len-=n;
+      pos+=n;
+    }
+  }
+  return true;
+}
+
+
+bool FuzzStream()
+{
+  //
+  // A well-formed stream
+  //
+  int interval=Random(1)?1+Random(32):1+Random(16384);
+  unsigned blocks=Random(40);
+  std::string stream;
+  Result expected;
+  Result r;
+
+  for(unsigned i=0;i<blocks;i++) {
+    std::string audio;
+    for(int j=0;j<interval;j++) {
+      audio+=(char)Random(255);
+    }
+    expected.audio+=audio;
+    stream+=audio;
+    unsigned mlen=Random(2)?0:Random(255);
+    std::string meta;
+    for(unsigned j=0;j<16*mlen;j++) {
+      meta+=(char)Random(255);
+    }
+    stream+=(char)mlen;
+    stream+=meta;
+    if(mlen>0) {
+      expected.metadata.push_back(meta);
+    }
+  }
+  std::string tail;
+  for(unsigned j=Random(interval-1);j>0;j--) {  // A partial last block
+    tail+=(char)Random(255);
+  }
+  expected.audio+=tail;
+  stream+=tail;
+
+  if(!Demux(&r,stream,interval,true)) {
+    return false;
+  }
+  if(!(r==expected)) {
+    fprintf(stderr,"icyfuzz: mismatch [icy-metaint: %d  blocks: %u]\n",
+	    interval,blocks);
+    return false;
+  }
+
+  //
+  // Garbage
+  //
+  stream.resize(Random(65536));
+  for(unsigned i=0;i<stream.size();i++) {
+    stream[i]=(char)Random(255);
+  }
+  r=Result();
+  if(!Demux(&r,stream,Random(1)?1+Random(32):Random(16384),true)) {
+    return false;
+  }
+  size_t total=r.audio.size();
+  for(unsigned i=0;i<r.metadata.size();i++) {
+    total+=r.metadata[i].size();
+  }
+  if(total>stream.size()) {
+    fprintf(stderr,"icyfuzz: more out than went in\n");
+    return false;
+  }
+
+  return true;
+}
+
+
+bool CheckCapture(const char *filename,int interval)
+{
+  FILE *f;
+  std::string stream;
+  char buf[65536];
+  size_t n;
+  Result whole;
+
+  if((f=fopen(filename,"r"))==NULL) {
+    fprintf(stderr,"icyfuzz: unable to open \"%s\"\n",filename);
+    return false;
+  }
+  while((n=fread(buf,1,sizeof(buf),f))>0) {
+    stream.append(buf,n);
+  }
+  fclose(f);
+
+  if(!Demux(&whole,stream,interval,false)) {
+    return false;
+  }
+  for(int i=0;i<ICYFUZZ_SPLITS;i++) {
+    Result r;
+    if(!Demux(&r,stream,interval,true)) {
+      return false;
+    }
+    if(!(r==whole)) {
+      fprintf(stderr,"icyfuzz: %s: split reads give different results\n",
+	      filename);
+      return false;
+    }
+  }
+  printf("%s: %lu bytes of audio, %lu metadata blocks\n",filename,
+	 whole.audio.size(),whole.metadata.size());
+  for(unsigned i=0;i<whole.metadata.size();i++) {
+    printf("  %s\n",whole.metadata[i].c_str());
+  }
+
+  return true;
+}
+
+
+int main(int argc,char *argv[])
+{
+  unsigned iterations=ICYFUZZ_DEFAULT_ITERATIONS;
+  unsigned seed=1;
+  int interval=-1;
+  std::vector<const char *> files;
+
+  for(int i=1;i<argc;i++) {
+    if(strncmp(argv[i],"--iterations=",13)==0) {
+      iterations=strtoul(argv[i]+13,NULL,10);
+    }
+    else if(strncmp(argv[i],"--seed=",7)==0) {
+      seed=strtoul(argv[i]+7,NULL,10);
+    }
+    else if(strncmp(argv[i],"--metaint=",10)==0) {
+      interval=atoi(argv[i]+10);
+    }
+    else if(argv[i][0]!='-') {
+      files.push_back(argv[i]);
+    }
+    else {
+      fprintf(stderr,"usage: icyfuzz [--iterations=<n>] [--seed=<n>]\n"
+	      "       icyfuzz --metaint=<bytes> <capture> [...]\n");
+      return 2;
+    }
+  }
+  srand(seed);
+
+  if(files.size()>0) {
+    if(interval<0) {
+      fprintf(stderr,"icyfuzz: --metaint is required with captures\n");
+      return 2;
+    }
+    for(unsigned i=0;i<files.size();i++) {
+      if(!CheckCapture(files[i],interval)) {
+	return 1;
+      }
+    }
+    return 0;
+  }
+
+  for(unsigned i=0;i<iterations;i++) {
+    if(!FuzzStream()) {
+      fprintf(stderr,"icyfuzz: failed at iteration %u [seed: %u]\n",i,seed);
+      return 1;
+    }
+  }
+  printf("%u streams ok\n",iterations);
+
+  return 0;
+}
@@ -0,0 +1,356 @@
+// pcmcheck.cpp
+//
+// Check the SIMD PCM kernels against the plain C ones, and time them.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+//
+// The per-ISA kernel tables are private to pcmkernels.cpp, so it is
+// pulled in whole here rather than linked.
+//
+#include "pcmkernels.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#define PCMCHECK_MAX_CHANNELS 8
+#define PCMCHECK_BENCH_FRAMES 1024
+#define PCMCHECK_BENCH_SECONDS 0.25
+
+static unsigned check_failures=0;
+
+//
+// Lengths either side of every vector width, plus a few big ones
+//
+static const unsigned check_frames[]=
+  {0,1,2,3,4,5,7,8,9,15,16,17,31,32,33,63,64,65,255,1000,4097};
+
+
+float RandomSample()
+{
+  //
+  // Mostly in range, with some past full scale to exercise the clipping
+  //
+  return 3.0f*((float)rand()/(float)RAND_MAX)-1.5f;
+}
+
+
+void FillSamples(float *pcm,unsigned samples)
+{
+  static const float edges[]=
+    {0.0f,1.0f,-1.0f,0.5f/32768.0f,1.5f/32768.0f,-0.5f/32768.0f,
+     32767.5f/32768.0f,-32768.5f/32768.0f,1e-30f,-1e-30f};
+
+  for(unsigned i=0;i<samples;i++) {
+    if((i%7)==3) {
+      pcm[i]=edges[(i/7)%(sizeof(edges)/sizeof(float))];
+    }
+    else {
+      pcm[i]=RandomSample();
+    }
+  }
+}
+
+
+void Fail(const PcmKernelTable *k,const char *func,unsigned chans,
+	  unsigned frames,unsigned offset)
+{
+  fprintf(stderr,"%s: %s mismatch [chans: %u  frames: %u  offset: %u]\n",
+	  k->name,func,chans,frames,offset);
+  check_failures++;
+}
+
+
+bool SameFloats(const float *a,const float *b,unsigned n,float tol)
+{
+  for(unsigned i=0;i<n;i++) {
+    if(tol==0.0f) {
+      if(memcmp(a+i,b+i,sizeof(float))!=0) {
+	return false;
+      }
+    }
+    else {
+      if(fabsf(a[i]-b[i])>tol*fabsf(b[i])) {
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+void Check(const PcmKernelTable *k)
+{
+  const PcmKernelTable *c=&pcm_kernels_c;
+  unsigned max=4097*PCMCHECK_MAX_CHANNELS+8;
+  std::vector<float> in(max);
+  std::vector<float> out0(max);
+  std::vector<float> out1(max);
+  std::vector<float> planes[PCMCHECK_MAX_CHANNELS];
+  std::vector<int32_t> fixed[PCMCHECK_MAX_CHANNELS];
+  float *pl0[PCMCHECK_MAX_CHANNELS];
+  float *pl1[PCMCHECK_MAX_CHANNELS];
+  const int32_t *fx[PCMCHECK_MAX_CHANNELS];
+  std::vector<int16_t> s0(max);
+  std::vector<int16_t> s1(max);
+  std::vector<int32_t> i0(max);
+  std::vector<int32_t> i1(max);
+
+  for(unsigned i=0;i<PCMCHECK_MAX_CHANNELS;i++) {
+    planes[i].resize(3*4104);
+    fixed[i].resize(4104);
+    for(unsigned j=0;j<fixed[i].size();j++) {
+      fixed[i][j]=(rand()-RAND_MAX/2)/16;
+    }
+  }
+  for(unsigned f=0;f<(sizeof(check_frames)/sizeof(unsigned));f++) {
+    unsigned frames=check_frames[f];
+    for(unsigned offset=0;offset<2;offset++) {  // Aligned and not
+      for(unsigned chans=1;chans<=PCMCHECK_MAX_CHANNELS;chans++) {
+	unsigned n=frames*chans;
+	FillSamples(in.data(),n+offset);
+	for(unsigned j=0;j<chans;j++) {
+	  FillSamples(planes[j].data(),frames+offset);
+	  fx[j]=fixed[j].data()+offset;
+	}
+
+	//
+	// Interleave / De-interleave
+	//
+	for(unsigned j=0;j<chans;j++) {
+	  pl0[j]=planes[j].data()+offset;
+	}
+	memset(out0.data(),0,max*sizeof(float));
+	memset(out1.data(),0,max*sizeof(float));
+	c->interleave(out0.data()+offset,pl0,chans,frames);
+	k->interleave(out1.data()+offset,pl0,chans,frames);
+	if(!SameFloats(out0.data(),out1.data(),n+offset+1,0.0f)) {
+	  Fail(k,"Interleave",chans,frames,offset);
+	}
+	for(unsigned j=0;j<chans;j++) {
+	  pl0[j]=planes[j].data()+4104+offset;
+	  pl1[j]=planes[j].data()+2*4104+offset;
+	}
+	c->deinterleave(pl0,in.data()+offset,chans,frames);
+	k->deinterleave(pl1,in.data()+offset,chans,frames);
+	for(unsigned j=0;j<chans;j++) {
+	  if(!SameFloats(pl0[j],pl1[j],frames,0.0f)) {
+	    Fail(k,"Deinterleave",chans,frames,offset);
+	    break;
+	  }
+	}
+
+	//
+	// Fixed point
+	//
+	c->interleave_fixed(out0.data()+offset,fx,chans,frames,28);
+	k->interleave_fixed(out1.data()+offset,fx,chans,frames,28);
+	if(!SameFloats(out0.data()+offset,out1.data()+offset,n,0.0f)) {
+	  Fail(k,"InterleaveFixed",chans,frames,offset);
+	}
+
+	//
+	// Meters
+	//
+	float lv0[PCMCHECK_MAX_CHANNELS];
+	float lv1[PCMCHECK_MAX_CHANNELS];
+	c->peaks(lv0,in.data()+offset,frames,chans);
+	k->peaks(lv1,in.data()+offset,frames,chans);
+	if(!SameFloats(lv0,lv1,chans,0.0f)) {
+	  Fail(k,"Peaks",chans,frames,offset);
+	}
+	c->sum_squares(lv0,in.data()+offset,frames,chans);
+	k->sum_squares(lv1,in.data()+offset,frames,chans);
+	if(!SameFloats(lv0,lv1,chans,1e-4)) {  // Summed in another order
+	  Fail(k,"SumSquares",chans,frames,offset);
+	}
+      }
+
+      //
+      // Remixing
+      //
+      FillSamples(in.data(),2*frames+offset);
+      c->mono_to_stereo(out0.data()+offset,in.data()+offset,frames);
+      k->mono_to_stereo(out1.data()+offset,in.data()+offset,frames);
+      if(!SameFloats(out0.data()+offset,out1.data()+offset,2*frames,
+		     0.0f)) {
+	Fail(k,"MonoToStereo",2,frames,offset);
+      }
+      c->stereo_to_mono(out0.data()+offset,in.data()+offset,frames);
+      k->stereo_to_mono(out1.data()+offset,in.data()+offset,frames);
+      if(!SameFloats(out0.data()+offset,out1.data()+offset,frames,
+		     0.0f)) {
+	Fail(k,"StereoToMono",2,frames,offset);
+      }
+
+      //
+      // Integer conversions
+      //
+      c->float_to_s16(s0.data()+offset,in.data()+offset,2*frames);
+      k->float_to_s16(s1.data()+offset,in.data()+offset,2*frames);
+      if(memcmp(s0.data()+offset,s1.data()+offset,
+		2*frames*sizeof(int16_t))!=0) {
+	Fail(k,"FloatToS16",1,2*frames,offset);
+      }
+      for(unsigned bits=24;bits<=32;bits+=8) {
+	c->float_to_int(i0.data()+offset,in.data()+offset,2*frames,bits);
+	k->float_to_int(i1.data()+offset,in.data()+offset,2*frames,bits);
+	if(memcmp(i0.data()+offset,i1.data()+offset,
+		  2*frames*sizeof(int32_t))!=0) {
+	  Fail(k,bits==24?"FloatToInt(24)":"FloatToInt(32)",1,2*frames,
+	       offset);
+	}
+      }
+    }
+  }
+}
+
+
+double Now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (double)ts.tv_sec+(double)ts.tv_nsec/1e9;
+}
+
+
+//
+// Run 'func' over PCMCHECK_BENCH_FRAMES of stereo for a while, and
+// return the throughput in millions of frames per second
+//
+template<class F> double Bench(F func)
+{
+  unsigned long long frames=0;
+  double start=Now();
+  double now;
+
+  do {
+    for(int i=0;i<100;i++) {
+      func();
+    }
+    frames+=100*PCMCHECK_BENCH_FRAMES;
+  } while((now=Now())-start<PCMCHECK_BENCH_SECONDS);
+
+  return (double)frames/(now-start)/1e6;
+}
+
+
+void Benchmark(const PcmKernelTable *const *tables)
+{
+  std::vector<float> in(2*PCMCHECK_BENCH_FRAMES);
+  std::vector<float> out(2*PCMCHECK_BENCH_FRAMES);
+  std::vector<float> pl[2];
+  std::vector<int32_t> fix[2];
+  std::vector<int16_t> s16(2*PCMCHECK_BENCH_FRAMES);
+  std::vector<int32_t> s32(2*PCMCHECK_BENCH_FRAMES);
+  float *planes[2];
+  const int32_t *fixed[2];
+  float lvls[2];
+
+  FillSamples(in.data(),2*PCMCHECK_BENCH_FRAMES);
+  for(unsigned i=0;i<2;i++) {
+    pl[i].resize(PCMCHECK_BENCH_FRAMES);
+    fix[i].resize(PCMCHECK_BENCH_FRAMES);
+    planes[i]=pl[i].data();
+    fixed[i]=fix[i].data();
+  }
+
+  printf("Stereo, %u frame blocks, Mframes/s\n",PCMCHECK_BENCH_FRAMES);
+  printf("%-16s","");
+  for(unsigned t=0;tables[t]!=NULL;t++) {
+    printf("%10s",tables[t]->name);
+  }
+  printf("\n");
+
+#define PCMCHECK_ROW(label,call)				\
+  printf("%-16s",label);					\
+  for(unsigned t=0;tables[t]!=NULL;t++) {			\
+    const PcmKernelTable *k=tables[t];				\
+    printf("%10.1f",Bench([&](){call;}));			\
+  }								\
+  printf("\n");
+
+  PCMCHECK_ROW("Interleave",
+	       k->interleave(out.data(),planes,2,PCMCHECK_BENCH_FRAMES));
+  PCMCHECK_ROW("Deinterleave",
+	       k->deinterleave(planes,in.data(),2,PCMCHECK_BENCH_FRAMES));
+  PCMCHECK_ROW("InterleaveFixed",
+	       k->interleave_fixed(out.data(),fixed,2,PCMCHECK_BENCH_FRAMES,
+				   28));
+  PCMCHECK_ROW("MonoToStereo",
+	       k->mono_to_stereo(out.data(),in.data(),PCMCHECK_BENCH_FRAMES));
+  PCMCHECK_ROW("StereoToMono",
+	       k->stereo_to_mono(out.data(),in.data(),PCMCHECK_BENCH_FRAMES));
+  PCMCHECK_ROW("Peaks",k->peaks(lvls,in.data(),PCMCHECK_BENCH_FRAMES,2));
+  PCMCHECK_ROW("SumSquares",
+	       k->sum_squares(lvls,in.data(),PCMCHECK_BENCH_FRAMES,2));
+  PCMCHECK_ROW("FloatToS16",
+	       k->float_to_s16(s16.data(),in.data(),
+			       2*PCMCHECK_BENCH_FRAMES));
+  PCMCHECK_ROW("FloatToInt(24)",
+	       k->float_to_int(s32.data(),in.data(),
+			       2*PCMCHECK_BENCH_FRAMES,24));
+#undef PCMCHECK_ROW
+}
+
+
+int main(int argc,char *argv[])
+{
+  const PcmKernelTable *tables[4];
+  unsigned n=0;
+  bool bench=true;
+
+  for(int i=1;i<argc;i++) {
+    if(strcmp(argv[i],"--check-only")==0) {
+      bench=false;
+    }
+    else {
+      fprintf(stderr,"usage: pcmcheck [--check-only]\n");
+      return 2;
+    }
+  }
+
+  tables[n++]=&pcm_kernels_c;
+#ifdef PCMKERNELS_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse2")) {
+    tables[n++]=&pcm_kernels_sse2;
+  }
+  if(__builtin_cpu_supports("avx2")) {
+    tables[n++]=&pcm_kernels_avx2;
+  }
+#endif  // PCMKERNELS_X86
+  tables[n]=NULL;
+
+  srand(1);
+  for(unsigned i=1;i<n;i++) {
+    unsigned failures=check_failures;
+    Check(tables[i]);
+    printf("%s: %s\n",tables[i]->name,
+	   check_failures==failures?"ok":"FAILED");
+  }
+  if(bench) {
+    Benchmark(tables);
+  }
+
+  return check_failures==0?0:1;
+}
@@ -0,0 +1,236 @@
+// ringbench.cpp
+//
+// Throughput benchmark for the SPSC ringbuffer.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+//
+// A producer and a consumer thread push a fixed amount of data through
+// the ring, and the time taken gives operations and bytes (or frames)
+// per second. The first set of runs uses only the C API, which is the
+// same as it was before the SPSC rewrite; building with
+// -DRINGBENCH_C_API_ONLY against an older ringbuffer.cpp gives the
+// baseline figures.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ringbuffer.h"
+
+#define RINGBENCH_RING_SIZE 65536
+#define RINGBENCH_TOTAL_BYTES (1024ull*1024ull*1024ull)
+#define RINGBENCH_CHANNELS 2
+
+struct BenchParams
+{
+  glass_ringbuffer_t *ring;
+#ifndef RINGBENCH_C_API_ONLY
+  Ringbuffer *cls;
+#endif  // RINGBENCH_C_API_ONLY
+  size_t block;
+  unsigned long long total;
+  unsigned long long errors;
+};
+
+
+double Now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (double)ts.tv_sec+(double)ts.tv_nsec/1e9;
+}
+
+
+void *CProducer(void *ptr)
+{
+  BenchParams *p=(BenchParams *)ptr;
+  char *data=new char[p->block];
+  unsigned long long sent=0;
+  unsigned char seq=0;
+
+  while(sent<p->total) {
+    if(glass_ringbuffer_write_space(p->ring)<p->block) {
+      sched_yield();
+      continue;
+    }
+    for(size_t i=0;i<p->block;i++) {
+      data[i]=seq++;
+    }
+    sent+=glass_ringbuffer_write(p->ring,data,p->block);
+  }
+  delete[] data;
+
+  return NULL;
+}
+
+
+void *CConsumer(void *ptr)
+{
+  BenchParams *p=(BenchParams *)ptr;
+  char *data=new char[p->block];
+  unsigned long long received=0;
+  unsigned char seq=0;
+  size_t n;
+
+  while(received<p->total) {
+    if((n=glass_ringbuffer_read(p->ring,data,p->block))==0) {
+      sched_yield();
+      continue;
+    }
+    for(size_t i=0;i<n;i++) {
+      if((unsigned char)data[i]!=seq++) {
+	p->errors++;
+	seq=(unsigned char)data[i]+1;
+      }
+    }
+    received+=n;
+  }
+  delete[] data;
+
+  return NULL;
+}
+
+
+#ifndef RINGBENCH_C_API_ONLY
+void *ClassProducer(void *ptr)
+{
+  BenchParams *p=(BenchParams *)ptr;
+  unsigned long long sent=0;
+  unsigned frames;
+  float *pcm;
+
+  while(sent<p->total) {
+    frames=p->block;
+    pcm=p->cls->reserveContiguous(&frames);
+    if(frames==0) {
+      sched_yield();
+      continue;
+    }
+    for(unsigned i=0;i<frames*RINGBENCH_CHANNELS;i++) {
+      pcm[i]=(float)((sent*RINGBENCH_CHANNELS+i)&0xFFFF);
+    }
+    p->cls->commitWrite(frames);
+    sent+=frames;
+  }
+
+  return NULL;
+}
+
+
+void *ClassConsumer(void *ptr)
+{
+  BenchParams *p=(BenchParams *)ptr;
+  unsigned long long received=0;
+  unsigned frames;
+  float *pcm;
+
+  while(received<p->total) {
+    frames=p->block;
+    pcm=p->cls->peekContiguous(&frames);
+    if(frames==0) {
+      sched_yield();
+      continue;
+    }
+    for(unsigned i=0;i<frames*RINGBENCH_CHANNELS;i++) {
+      if(pcm[i]!=(float)((received*RINGBENCH_CHANNELS+i)&0xFFFF)) {
+	p->errors++;
+      }
+    }
+    p->cls->commitRead(frames);
+    received+=frames;
+  }
+
+  return NULL;
+}
+#endif  // RINGBENCH_C_API_ONLY
+
+
+double RunThreads(void *(*producer)(void *),void *(*consumer)(void *),
+		  BenchParams *p)
+{
+  pthread_t prod;
+  pthread_t cons;
+  double start=Now();
+
+  if((pthread_create(&cons,NULL,consumer,p)!=0)||
+     (pthread_create(&prod,NULL,producer,p)!=0)) {
+    fprintf(stderr,"ringbench: unable to start threads\n");
+    exit(1);
+  }
+  pthread_join(prod,NULL);
+  pthread_join(cons,NULL);
+
+  return Now()-start;
+}
+
+
+int main(int argc,char *argv[])
+{
+  static const size_t blocks[]={4,64,1024,16384,0};
+  BenchParams p;
+  double secs;
+  int ret=0;
+
+  printf("C API, %d byte ring, %llu MB per run\n",RINGBENCH_RING_SIZE,
+	 RINGBENCH_TOTAL_BYTES/(1024*1024));
+  for(int i=0;blocks[i]!=0;i++) {
+    memset(&p,0,sizeof(p));
+    p.ring=glass_ringbuffer_create(RINGBENCH_RING_SIZE);
+    p.block=blocks[i];
+    p.total=RINGBENCH_TOTAL_BYTES/(blocks[i]<1024?16:1);
+    p.total-=p.total%p.block;
+    secs=RunThreads(CProducer,CConsumer,&p);
+    printf("  %6lu byte blocks: %12.0f ops/s %10.1f MB/s%s\n",blocks[i],
+	   (double)(p.total/p.block)/secs,
+	   (double)p.total/secs/(1024.0*1024.0),
+	   p.errors==0?"":"  DATA ERRORS");
+    if(p.errors!=0) {
+      ret=1;
+    }
+    glass_ringbuffer_free(p.ring);
+  }
+
+#ifndef RINGBENCH_C_API_ONLY
+  for(int mirrored=0;mirrored<2;mirrored++) {
+    printf("Ringbuffer class, %d channels, %s, zero-copy\n",
+	   RINGBENCH_CHANNELS,mirrored?"mirrored":"plain");
+    for(int i=0;blocks[i]!=0;i++) {
+      memset(&p,0,sizeof(p));
+      p.cls=new Ringbuffer(RINGBENCH_RING_SIZE*RINGBENCH_CHANNELS*
+			   sizeof(float),RINGBENCH_CHANNELS,0,mirrored);
+      p.block=blocks[i];
+      p.total=RINGBENCH_TOTAL_BYTES/(RINGBENCH_CHANNELS*sizeof(float))/
+	(blocks[i]<1024?16:1);
+      secs=RunThreads(ClassProducer,ClassConsumer,&p);
+      printf("  %6lu frame blocks: %12.0f frames/s%s\n",blocks[i],
+	     (double)p.total/secs,p.errors==0?"":"  DATA ERRORS");
+      if(p.errors!=0) {
+	ret=1;
+      }
+      delete p.cls;
+    }
+  }
+#endif  // RINGBENCH_C_API_ONLY
+
+  return ret;
+}
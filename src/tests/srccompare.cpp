@@ -0,0 +1,187 @@
+// srccompare.cpp
+//
+// Compare the polyphase resampler with the libsamplerate converters.
+//
+//   (C) Copyright 2026 Fred Gleason <fredg@paravelsystems.com>
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License version 2 as
+//   published by the Free Software Foundation.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public
+//   License along with this program; if not, write to the Free Software
+//   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+
+//
+// Each converter resamples a stereo sine in device-sized blocks, the
+// way DevAlsa and DevJack drive it. The output is compared with the
+// same sine computed directly at the output rate, giving a
+// signal-to-error ratio, and the time taken gives the throughput.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "resampler.h"
+
+#define SRCCOMPARE_CHANNELS 2
+#define SRCCOMPARE_BLOCK_FRAMES 1024
+#define SRCCOMPARE_SECONDS 10
+#define SRCCOMPARE_SKIP_SECONDS 0.1
+#define SRCCOMPARE_AMPLITUDE 0.5
+
+//
+// Indexed by AudioDevice::SrcQuality; AudioDevice::srcQualityText()
+// would drag in the whole of the device class
+//
+static const char *quality_names[]=
+  {"Linear","Sinc (fastest)","Sinc (medium quality)","Polyphase"};
+
+struct Rates
+{
+  unsigned in;
+  unsigned out;
+};
+
+
+double Now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (double)ts.tv_sec+(double)ts.tv_nsec/1e9;
+}
+
+
+double Sine(double freq,double rate,double frame,unsigned chan)
+{
+  //
+  // The second channel is a quarter cycle behind the first
+  //
+  return SRCCOMPARE_AMPLITUDE*sin(2.0*M_PI*freq*frame/rate-M_PI*chan/2.0);
+}
+
+
+//
+// Resample 'freq' Hz from rates.in to rates.out, returning the
+// signal-to-error ratio in dB and the throughput in input Mframes/s
+//
+bool Run(AudioDevice::SrcQuality qual,const Rates &rates,double freq,
+	 double *snr,double *speed)
+{
+  double ratio=(double)rates.out/(double)rates.in;
+  unsigned in_frames=SRCCOMPARE_SECONDS*rates.in;
+  unsigned max_out=ratio*SRCCOMPARE_BLOCK_FRAMES+16;
+  std::vector<float> in(in_frames*SRCCOMPARE_CHANNELS);
+  std::vector<float> out;
+  std::vector<float> block(max_out*SRCCOMPARE_CHANNELS);
+  Resampler *rs;
+  SRC_DATA data;
+  double start;
+  double sig=0.0;
+  double err=0.0;
+  int srcerr;
+
+  for(unsigned i=0;i<in_frames;i++) {
+    for(unsigned j=0;j<SRCCOMPARE_CHANNELS;j++) {
+      in[i*SRCCOMPARE_CHANNELS+j]=Sine(freq,rates.in,i,j);
+    }
+  }
+  out.reserve((ratio*in_frames+max_out)*SRCCOMPARE_CHANNELS);
+  rs=new Resampler(qual,SRCCOMPARE_CHANNELS,ratio,SRCCOMPARE_BLOCK_FRAMES,
+		   &srcerr);
+  if(srcerr!=0) {
+    fprintf(stderr,"srccompare: %s\n",src_strerror(srcerr));
+    exit(1);
+  }
+
+  memset(&data,0,sizeof(data));
+  data.src_ratio=ratio;
+  start=Now();
+  for(unsigned i=0;i<in_frames;) {
+    data.data_in=in.data()+i*SRCCOMPARE_CHANNELS;
+    data.input_frames=in_frames-i;
+    if(data.input_frames>SRCCOMPARE_BLOCK_FRAMES) {
+      data.input_frames=SRCCOMPARE_BLOCK_FRAMES;
+    }
+    data.data_out=block.data();
+    data.output_frames=max_out;
+    if((srcerr=rs->process(&data))!=0) {
+      fprintf(stderr,"srccompare: %s\n",src_strerror(srcerr));
+      exit(1);
+    }
+    out.insert(out.end(),block.begin(),
+	       block.begin()+data.output_frames_gen*SRCCOMPARE_CHANNELS);
+    i+=data.input_frames_used;
+  }
+  *speed=(double)in_frames/(Now()-start)/1e6;
+  delete rs;
+
+  //
+  // Output frame 'n' lines up with input time n/ratio. The start and
+  // the end, where the converters are working on zero padding or
+  // holding frames back, are left out.
+  //
+  unsigned skip=SRCCOMPARE_SKIP_SECONDS*rates.out;
+  unsigned frames=out.size()/SRCCOMPARE_CHANNELS;
+  if(frames<=2*skip) {
+    return false;
+  }
+  for(unsigned i=skip;i<frames-skip;i++) {
+    for(unsigned j=0;j<SRCCOMPARE_CHANNELS;j++) {
+      double ref=Sine(freq,rates.out,i,j);
+      double diff=out[i*SRCCOMPARE_CHANNELS+j]-ref;
+      sig+=ref*ref;
+      err+=diff*diff;
+    }
+  }
+  *snr=10.0*log10(sig/(err>0.0?err:1e-30));
+
+  return true;
+}
+
+
+int main(int argc,char *argv[])
+{
+  static const Rates rates[]={{44100,48000},{48000,44100},{48000,48048}};
+  static const double freqs[]={1000.0,10000.0,18000.0};
+  double snr;
+  double speed;
+
+  printf("%u frame blocks, %u channels, signal-to-error in dB, "
+	 "input Mframes/s\n",SRCCOMPARE_BLOCK_FRAMES,SRCCOMPARE_CHANNELS);
+  for(unsigned r=0;r<(sizeof(rates)/sizeof(Rates));r++) {
+    printf("\n%u -> %u Hz\n",rates[r].in,rates[r].out);
+    printf("%-28s","");
+    for(unsigned f=0;f<(sizeof(freqs)/sizeof(double));f++) {
+      printf("%7.0f Hz",freqs[f]);
+    }
+    printf("%10s\n","Mframes/s");
+    for(int q=0;q<AudioDevice::SrcLastQuality;q++) {
+      AudioDevice::SrcQuality qual=(AudioDevice::SrcQuality)q;
+      printf("%-28s",quality_names[q]);
+      for(unsigned f=0;f<(sizeof(freqs)/sizeof(double));f++) {
+	if(Run(qual,rates[r],freqs[f],&snr,&speed)) {
+	  printf("%10.1f",snr);
+	}
+	else {
+	  printf("%10s","-");
+	}
+      }
+      printf("%10.1f\n",speed);
+    }
+  }
+
+  return 0;
+}